@@ -0,0 +1,362 @@
+#include "simcc/flat_ini_parser.h"
+#include "simcc/data_stream.h"
+#include "simcc/memmem.h"
+#include "simcc/string_util.h"
+
+namespace simcc {
+
+namespace {
+// The default trim characters of INIParser : " \t\r\n"
+inline bool IsTrimChar(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+inline unsigned char ToLower(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+const char* SkipTrimChars(const char* p, const char* end) {
+    while (p < end && IsTrimChar(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+Slice Trim(const char* begin, const char* end) {
+    begin = SkipTrimChars(begin, end);
+    while (end > begin && IsTrimChar(end[-1])) {
+        --end;
+    }
+    return Slice(begin, end - begin);
+}
+
+// Skip the comment lines which start with ';', '#' or '//'
+const char* SkipComments(const char* p, const char* end) {
+    for (;;) {
+        p = SkipTrimChars(p, end);
+        if (p >= end) {
+            return end;
+        }
+
+        if (*p != ';' && *p != '#' && !(*p == '/' && p + 1 < end && p[1] == '/')) {
+            return p;
+        }
+
+        p = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!p) {
+            return end;
+        }
+        ++p;
+    }
+}
+
+const char* FindSeparator(const char* begin, const char* end, const Slice& sep) {
+    if (sep.size() == 1) {
+        return static_cast<const char*>(memchr(begin, sep[0], end - begin));
+    }
+    return static_cast<const char*>(memmem(begin, end - begin, sep.data(), sep.size()));
+}
+
+// FNV-1a
+const simcc::uint32 kFNVOffsetBasis = 2166136261u;
+const simcc::uint32 kFNVPrime = 16777619u;
+}
+
+FlatINIParser::FlatINIParser(bool case_sensitive /*= true*/, bool compatible /*= false*/)
+    : case_sensitive_(case_sensitive)
+    , compatible_(compatible)
+    , zero_copy_(false)
+    , error_code_(INIParser::kNoError)
+    , size_(0) {
+    sections_.push_back(Slice()); // The default section
+}
+
+bool FlatINIParser::ParseFile(const string& filename) {
+    DataStream ds;
+    if (!ds.ReadFile(filename)) {
+        return false;
+    }
+
+    return Parse(ds.data(), ds.size(), "\n", "=");
+}
+
+bool FlatINIParser::Parse(const char* data, size_t datalen) {
+    return Parse(data, datalen, "\n", "=");
+}
+
+bool FlatINIParser::Parse(const char* data, size_t data_len, const Slice& line_sep, const Slice& kv_sep) {
+    Reset();
+    if (!data || 0 == data_len || line_sep.empty() || kv_sep.empty()) {
+        return false;
+    }
+
+    // avoid string ending with many '\0'
+    while (data_len > 0 && data[data_len - 1] == '\0') {
+        data_len -= 1;
+    }
+
+    const char* p = data;
+    if (!zero_copy_) {
+        // All the Slices point into this copy
+        arena_.assign(data, data_len);
+        p = arena_.data();
+    }
+
+    const char* end = p + data_len;
+    entries_.reserve(data_len / 16 + 1);
+    simcc::uint32 section = 0;
+    bool result = true;
+    while (p < end) {
+        p = SkipComments(p, end);
+        if (p >= end) {
+            break;
+        }
+
+        if (static_cast<size_t>(end - p) >= line_sep.size() && memcmp(p, line_sep.data(), line_sep.size()) == 0) {
+            // skip one empty line
+            p += line_sep.size();
+            continue;
+        }
+
+        const char* line_end = FindSeparator(p, end, line_sep);
+        if (!line_end) {
+            line_end = end;
+        }
+
+        if (!ParseLine(p, line_end, kv_sep, section)) {
+            // It is only an error in the strict mode
+            result = compatible_;
+            break;
+        }
+
+        p = line_end + line_sep.size();
+    }
+
+    BuildIndex();
+    return result;
+}
+
+bool FlatINIParser::ParseLine(const char* begin, const char* end, const Slice& kv_sep, simcc::uint32& section) {
+    if (*begin == '[') {
+        const char* section_end = static_cast<const char*>(memchr(begin, ']', end - begin));
+        if (!section_end) {
+            error_code_ = INIParser::kErrorSectionFormatWrong;
+            if (!compatible_ || begin + 1 == end) {
+                return false;
+            }
+
+            // Use the rest of the line as the section name and try to read the next line
+            section_end = end;
+        }
+
+        sections_.push_back(Trim(begin + 1, section_end));
+        section = static_cast<simcc::uint32>(sections_.size() - 1);
+        return true;
+    }
+
+    const char* kv_sep_pos = FindSeparator(begin, end, kv_sep);
+    if (!kv_sep_pos) {
+        error_code_ = INIParser::kErrorCannotFindKVSeperator;
+
+        // try to read the next line in the compatible mode
+        return compatible_;
+    }
+
+    Entry e;
+    e.section = section;
+    e.overridden = false;
+    e.key = Trim(begin, kv_sep_pos);
+    e.value = Trim(kv_sep_pos + kv_sep.size(), end);
+    if (!e.key.empty()) {
+        e.hash = Hash(sections_[section], e.key);
+        entries_.push_back(e);
+    }
+
+    return true;
+}
+
+void FlatINIParser::Reset() {
+    error_code_ = INIParser::kNoError;
+    arena_.clear();
+    sections_.clear();
+    sections_.push_back(Slice()); // The default section
+    entries_.clear();
+    buckets_.clear();
+    size_ = 0;
+}
+
+simcc::uint32 FlatINIParser::Hash(const Slice& section, const Slice& key) const {
+    simcc::uint32 h = kFNVOffsetBasis;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(section.data());
+    const unsigned char* end = p + section.size();
+    if (case_sensitive_) {
+        for (; p < end; ++p) {
+            h = (h ^ *p) * kFNVPrime;
+        }
+    } else {
+        for (; p < end; ++p) {
+            h = (h ^ ToLower(*p)) * kFNVPrime;
+        }
+    }
+
+    // A separator which can't appear in a trimmed section
+    h = (h ^ '\n') * kFNVPrime;
+
+    p = reinterpret_cast<const unsigned char*>(key.data());
+    end = p + key.size();
+    if (case_sensitive_) {
+        for (; p < end; ++p) {
+            h = (h ^ *p) * kFNVPrime;
+        }
+    } else {
+        for (; p < end; ++p) {
+            h = (h ^ ToLower(*p)) * kFNVPrime;
+        }
+    }
+
+    return h;
+}
+
+bool FlatINIParser::Equals(const Slice& x, const Slice& y) const {
+    if (x.size() != y.size()) {
+        return false;
+    }
+
+    if (case_sensitive_) {
+        return memcmp(x.data(), y.data(), x.size()) == 0;
+    }
+
+    for (size_t i = 0; i < x.size(); ++i) {
+        if (ToLower(x[i]) != ToLower(y[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void FlatINIParser::BuildIndex() {
+    // Keep the load factor under 0.5
+    size_t capacity = 8;
+    while (capacity < entries_.size() * 2) {
+        capacity <<= 1;
+    }
+
+    buckets_.assign(capacity, 0);
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        Entry& e = entries_[i];
+        for (size_t b = e.hash & mask;; b = (b + 1) & mask) {
+            simcc::uint32 index = buckets_[b];
+            if (index == 0) {
+                buckets_[b] = static_cast<simcc::uint32>(i + 1);
+                ++size_;
+                break;
+            }
+
+            // The last one wins
+            Entry& old = entries_[index - 1];
+            if (old.hash == e.hash && Equals(old.key, e.key) && Equals(sections_[old.section], sections_[e.section])) {
+                old.overridden = true;
+                buckets_[b] = static_cast<simcc::uint32>(i + 1);
+                break;
+            }
+        }
+    }
+}
+
+int FlatINIParser::Find(const Slice& section, const Slice& key) const {
+    if (size_ == 0) {
+        return -1;
+    }
+
+    simcc::uint32 hash = Hash(section, key);
+    size_t mask = buckets_.size() - 1;
+    for (size_t b = hash & mask;; b = (b + 1) & mask) {
+        simcc::uint32 index = buckets_[b];
+        if (index == 0) {
+            return -1;
+        }
+
+        const Entry& e = entries_[index - 1];
+        if (e.hash == hash && Equals(e.key, key) && Equals(sections_[e.section], section)) {
+            return static_cast<int>(index - 1);
+        }
+    }
+}
+
+Slice FlatINIParser::Get(const Slice& key, bool* found) const {
+    return Get(Slice(), key, found);
+}
+
+Slice FlatINIParser::Get(const Slice& section, const Slice& key, bool* found) const {
+    int index = Find(section, key);
+    if (found) {
+        *found = (index >= 0);
+    }
+
+    if (index < 0) {
+        return Slice();
+    }
+
+    return entries_[index].value;
+}
+
+int64_t FlatINIParser::GetInteger(const Slice& section, const Slice& key, int64_t default_value /*= 0*/) const {
+    bool found = false;
+    Slice value = Get(section, key, &found);
+    if (!found) {
+        return default_value;
+    }
+
+    return std::stoll(value.ToString());
+}
+
+bool FlatINIParser::GetBool(const Slice& section, const Slice& key, bool default_value /*= false*/) const {
+    bool found = false;
+    Slice value = Get(section, key, &found);
+    if (!found) {
+        return default_value;
+    }
+
+    return value.size() >= 4 && strnicmp(value.data(), "true", 4) == 0;
+}
+
+double FlatINIParser::GetDouble(const Slice& section, const Slice& key, double default_value /*= 0.0*/) const {
+    bool found = false;
+    Slice value = Get(section, key, &found);
+    if (!found) {
+        return default_value;
+    }
+
+    return std::stod(value.ToString());
+}
+
+string FlatINIParser::GetURLDecoded(const Slice& key, bool* found) const {
+    return GetURLDecoded(Slice(), key, found);
+}
+
+string FlatINIParser::GetURLDecoded(const Slice& section, const Slice& key, bool* found) const {
+    Slice value = Get(section, key, found);
+    string decoded;
+    if (value.empty()) {
+        return decoded; // data() may be NULL, which memchr must not get
+    }
+
+    if (!memchr(value.data(), '%', value.size()) && !memchr(value.data(), '+', value.size())) {
+        decoded.assign(value.data(), value.size());
+    } else {
+        StringUtil::URLDecode(value.data(), value.size(), decoded);
+    }
+    return decoded;
+}
+
+void FlatINIParser::Visit(const Visitor& visitor) const {
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        const Entry& e = entries_[i];
+        if (!e.overridden) {
+            visitor(sections_[e.section], e.key, e.value);
+        }
+    }
+}
+
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "simcc/inner_pre.h"
+#include "simcc/slice.h"
+#include "simcc/ini_parser.h"
+
+#include <vector>
+
+namespace simcc {
+
+// @brief A read-only INI parser with a flat, hashed storage.
+//
+// INIParser keeps the data in a std::map of std::map of strings, so every
+// key and value is a separate allocation and a lookup walks two trees.
+// FlatINIParser copies the source data into one arena and records every
+// key/value pair as Slices into it, indexed by an open-addressing hash table.
+// A parsed INI is only a handful of allocations and a lookup is O(1).
+//
+// The syntax is the same as INIParser: comment lines start with '#', '//'
+// or ';', a section line is "[section]", and spaces are trimmed.
+// A key which appears more than once has the last value.
+// When it is not case sensitive, sections and keys are compared ignoring
+// case, but they are kept as they are in the source.
+//
+// In the zero copy mode, the source data is not copied and the Slices point
+// into the caller's buffer directly, which must outlive the parser.
+// It is intended for the transient data, e.g. query strings and form bodies:
+//     simcc::FlatINIParser ini(true, true);
+//     ini.set_zero_copy(true);
+//     ini.Parse(query, query_len, "&", "=");
+//     string name = ini.GetURLDecoded("name"); // only decode what is used
+class SIMCC_EXPORT FlatINIParser {
+public:
+    typedef INIParser::ErrorCode ErrorCode;
+    typedef std::function<void(const Slice& section, const Slice& key, const Slice& value)> Visitor;
+
+    FlatINIParser(bool case_sensitive = true, bool compatible = false);
+
+    // @brief Parse the raw data. The lines are separated by '\n'
+    //     and key/value is separated by '='
+    bool Parse(const char* data, size_t datalen);
+
+    // @brief Parse the raw data
+    // @param line_sep - the line separator
+    // @param kv_sep - the key/value separator
+    // @return true if parse successfully
+    bool Parse(const char* data, size_t datalen, const Slice& line_sep, const Slice& kv_sep);
+
+    // @brief Parse an INI file
+    bool ParseFile(const string& filename);
+
+    void Reset();
+
+    ErrorCode error() const {
+        return error_code_;
+    }
+    bool ok() const {
+        return error_code_ == INIParser::kNoError;
+    }
+
+    // Query
+public:
+    // @brief Get the value of specified key from the default section or a certain section
+    // @param[out] found - If it is provided, whether the key is found is stored here
+    // @return the value, or an empty Slice if it is not found.
+    //     The Slice is valid until the next Parse or Reset.
+    Slice Get(const Slice& key, bool* found = NULL) const;
+    Slice Get(const Slice& section, const Slice& key, bool* found = NULL) const;
+
+    int64_t GetInteger(const Slice& section, const Slice& key, int64_t default_value = 0) const;
+    bool GetBool(const Slice& section, const Slice& key, bool default_value = false) const;
+    double GetDouble(const Slice& section, const Slice& key, double default_value = 0.0) const;
+
+    // @brief Get the URL-decoded value. The value is decoded on each call,
+    //     and it is copied as it is if there is nothing to decode.
+    string GetURLDecoded(const Slice& key, bool* found = NULL) const;
+    string GetURLDecoded(const Slice& section, const Slice& key, bool* found = NULL) const;
+
+    // @brief Visit all the section/key/value in the input order
+    void Visit(const Visitor& visitor) const;
+
+    // The count of the distinct section/key pairs
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    bool case_sensitive() const {
+        return case_sensitive_;
+    }
+
+    bool compatible() const {
+        return compatible_;
+    }
+    void set_compatible(bool val) {
+        compatible_ = val;
+    }
+
+    bool zero_copy() const {
+        return zero_copy_;
+    }
+    // It takes effect from the next Parse
+    void set_zero_copy(bool val) {
+        zero_copy_ = val;
+    }
+
+private:
+    struct Entry {
+        simcc::uint32 section; // The index of sections_
+        simcc::uint32 hash;    // The hash code of the section and key
+        bool overridden;       // There is a later value of the same key
+        Slice key;
+        Slice value;
+    };
+
+    // @return false if the parsing needs to stop
+    bool ParseLine(const char* begin, const char* end, const Slice& kv_sep, simcc::uint32& section);
+
+    simcc::uint32 Hash(const Slice& section, const Slice& key) const;
+    bool Equals(const Slice& x, const Slice& y) const;
+
+    // Build the hash index of entries_
+    void BuildIndex();
+
+    // @return the index of entries_, or -1 if not found
+    int Find(const Slice& section, const Slice& key) const;
+
+private:
+    bool case_sensitive_;
+    bool compatible_;
+    bool zero_copy_;
+    ErrorCode error_code_;
+
+    string arena_;                        // The copy of the source data, empty in the zero copy mode
+    std::vector<Slice> sections_;         // The section names, the first one is the default section ""
+    std::vector<Entry> entries_;          // The key/value pairs in the input order
+    std::vector<simcc::uint32> buckets_;  // The open-addressing hash index, stores the index of entries_ plus 1
+    size_t size_;
+};
+
+}
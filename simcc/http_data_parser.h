@@ -3,6 +3,7 @@
 #include "memmem.h"
 #include "slice.h"
 #include "ini_parser.h"
+#include "flat_ini_parser.h"
 
 namespace simcc {
 class URIParser {
@@ -29,15 +30,10 @@ public:
             return true;
         }
 
-        bool r = true;
-        INIParser ini;
-        ini.set_compatible(true);
-        if (!ini.Parse(p + 1, len, "&", "=")) {
-            r = false;
-        }
-
-        kv.insert(ini.GetDefaultKeyValueMap().begin(), ini.GetDefaultKeyValueMap().end());
-
+        FlatINIParser ini(true, true);
+        ini.set_zero_copy(true);
+        bool r = ini.Parse(p + 1, len, "&", "=");
+        Insert(ini, kv);
         return r;
     }
 
@@ -71,16 +67,37 @@ public:
             return true;
         }
 
-        bool r = true;
-        INIParser ini;
-        ini.set_compatible(true);
-        if (!ini.Parse(p + 1, len, "&", "=")) {
-            r = false;
+        FlatINIParser ini(true, true);
+        ini.set_zero_copy(true);
+        bool r = ini.Parse(p + 1, len, "&", "=");
+        Insert(ini, *kv);
+        return r;
+    }
+
+    // @brief Parse the query string of the URI into a FlatINIParser without copying.
+    //     The key/value pairs point into <code>d</code>, which must outlive <code>kv</code>.
+    //     The values are not URL-decoded, use FlatINIParser::GetURLDecoded to decode them.
+    static bool Parse(const char* d, size_t dlen, FlatINIParser& kv) {
+        kv.Reset();
+        const char* p = static_cast<const char*>(memchr(d, '?', dlen));
+        if (!p || p + 1 >= d + dlen) {
+            return true;
         }
 
-        kv->insert(ini.GetDefaultKeyValueMap().begin(), ini.GetDefaultKeyValueMap().end());
+        kv.set_compatible(true);
+        kv.set_zero_copy(true);
+        return kv.Parse(p + 1, dlen + d - p - 1, "&", "=");
+    }
 
-        return r;
+private:
+    // Insert the key/value pairs of the default section and keep the existing ones of kv
+    template<class _TMAP>
+    static void Insert(const FlatINIParser& ini, _TMAP& kv) {
+        ini.Visit([&kv](const Slice& section, const Slice& key, const Slice& value) {
+            if (section.empty()) {
+                kv.insert(typename _TMAP::value_type(key.ToString(), value.ToString()));
+            }
+        });
     }
 };
 
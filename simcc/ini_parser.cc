@@ -3,9 +3,69 @@
 #include "simcc/data_stream.h"
 #include "simcc/tokener.h"
 #include "simcc/string_util.h"
+#include "simcc/ini_snapshot.h"
+#include "simcc/misc/md5.h"
+
+#include <thread>
+
+#ifndef H_OS_WINDOWS
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace simcc {
 
+namespace {
+// Find the first position in [p, end) where the byte a or b is
+const char* FindEitherByte(const char* p, const char* end, char a, char b) {
+#if defined(__SSE2__)
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; p < end; ++p) {
+        if (*p == a || *p == b) {
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+inline bool StartsWith(const char* p, const char* end, const string& sep) {
+    return static_cast<size_t>(end - p) >= sep.size() && memcmp(p, sep.data(), sep.size()) == 0;
+}
+
+// Find the separator in [p, end). A multi-char separator is located by
+// its first byte and then compared with the rest.
+const char* FindSeparator(const char* p, const char* end, const string& sep) {
+    for (;;) {
+        p = static_cast<const char*>(memchr(p, sep[0], end - p));
+        if (!p || sep.size() == 1) {
+            return p;
+        }
+
+        if (StartsWith(p, end, sep)) {
+            return p;
+        }
+        ++p;
+    }
+}
+}
+
 static const string default_trim_chars = " \t\r\n";
 INIParser::INIParser(bool _case_sensitive /*= true*/, bool _compatible /*= false*/, bool keep_sequence /*= false*/)
     : case_sensitive_(_case_sensitive)
@@ -13,7 +73,8 @@ INIParser::INIParser(bool _case_sensitive /*= true*/, bool _compatible /*= false
     , keep_sequence_(keep_sequence)
     , error_code_(kNoError)
     , compatible_(_compatible)
-    , trim_chars_(default_trim_chars) {
+    , trim_chars_(default_trim_chars)
+    , change_type_(kKeyAdded) {
     InitTrimCharsTable();
 }
 
@@ -43,6 +104,12 @@ public:
     SequenceParseListener(INIParser* parser) : parser_(parser) {
         listener_ = std::bind(&SequenceParseListener::OnValue, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4);
         parser_->SetParseListener(listener_);
+        position_ = --parser_->listeners_.end();
+    }
+
+    // Unregister itself, or the parser would call a dangling listener in the next parsing
+    ~SequenceParseListener() {
+        parser_->listeners_.erase(position_);
     }
 
     void OnValue(INIParser& /*parser*/, const string& section, const string& key, const string& /*value*/) {
@@ -60,6 +127,7 @@ public:
 private:
     INIParser* parser_;
     INIParser::ParseListener listener_;
+    INIParser::ListenerList::iterator position_;
 };
 
 bool INIParser::Parse(const char* data, size_t datalen, const char* linesep, const char* kvsep) {
@@ -67,6 +135,11 @@ bool INIParser::Parse(const char* data, size_t datalen, const char* linesep, con
 }
 
 bool INIParser::Parse(const char* data, size_t data_len, const string& line_sep, const string& kv_sep) {
+    string section;
+    return DoParse(data, data_len, line_sep, kv_sep, section);
+}
+
+bool INIParser::DoParse(const char* data, size_t data_len, const string& line_sep, const string& kv_sep, string& section) {
     if (!data || 0 == data_len || line_sep.empty() || kv_sep.empty()) {
         return false;
     }
@@ -94,7 +167,6 @@ bool INIParser::Parse(const char* data, size_t data_len, const string& line_sep,
     size_t line_sep_len = line_sep.size();
     size_t kv_sep_len   = kv_sep.size();
     string line;
-    string section;
     const char kSectionOpen = '[';
     const char kSectionClose = ']';
     while (line_begin && !stop_parsing_ && line_begin < data_end) {
@@ -109,7 +181,7 @@ bool INIParser::Parse(const char* data, size_t data_len, const string& line_sep,
             }
         }
 
-        if (strncmp(line_begin, line_sep.data(), line_sep_len) == 0) {
+        if (StartsWith(line_begin, data_end, line_sep)) {
             // skip one empty line
             // fix bug:
             //  "a:1||||c:3"
@@ -119,7 +191,7 @@ bool INIParser::Parse(const char* data, size_t data_len, const string& line_sep,
         }
 
         if (*line_begin == kSectionOpen) {
-            line_end = strstr(line_begin, line_sep.data());
+            line_end = FindSeparator(line_begin, data_end, line_sep);
             if (!line_end) {
                 // last line is : "["
                 if (line_begin + 1 == data_end) {
@@ -149,7 +221,7 @@ bool INIParser::Parse(const char* data, size_t data_len, const string& line_sep,
                 return true;
             }
 
-            const char* section_end = strchr(line_begin, kSectionClose);
+            const char* section_end = static_cast<const char*>(memchr(line_begin, kSectionClose, line_end - line_begin));
             if (!section_end || section_end <= line_begin || section_end >= line_end) {
                 error_code_ = kErrorSectionFormatWrong;
                 if (compatible_) {
@@ -177,8 +249,9 @@ bool INIParser::Parse(const char* data, size_t data_len, const string& line_sep,
             continue;
         }
 
-        const char* kv_sep_pos = strstr(line_begin, kv_sep.data());
-        line_end  = strstr(line_begin, line_sep.data());
+        const char* kv_sep_pos = NULL;
+        line_end = NULL;
+        FindSeparators(line_begin, data_end, kv_sep_pos, line_end);
         Status e = CheckStatus(data_end, kv_sep_pos, line_end);
         switch (e) {
         case kFoundKeyAndValue:
@@ -196,18 +269,18 @@ bool INIParser::Parse(const char* data, size_t data_len, const string& line_sep,
             break;
         }
 
-        string key = string(line_begin, kv_sep_pos - line_begin);
-        string value;
-        if (line_end) {
-            value = string(kv_sep_pos + kv_sep_len, line_end - kv_sep_pos - kv_sep_len);
-        } else {
-            value = string(kv_sep_pos + kv_sep_len, data_end - kv_sep_pos - kv_sep_len);
-        }
-
+        // Trim before copying
+        const char* key_begin = line_begin;
+        const char* key_end = kv_sep_pos;
+        const char* value_begin = kv_sep_pos + kv_sep_len;
+        const char* value_end = (line_end ? line_end : data_end);
         if (!trim_chars_.empty()) {
-            StringUtil::Trim(key, trim_chars_.c_str(), true, true);
-            StringUtil::Trim(value, trim_chars_.c_str(), true, true);
+            TrimRange(key_begin, key_end);
+            TrimRange(value_begin, value_end);
         }
+
+        string key(key_begin, key_end - key_begin);
+        string value(value_begin, value_end - value_begin);
         if (key.length()) {
             if (!case_sensitive_) {
                 std::transform(key.begin(), key.end(), key.begin(), towlower);
@@ -232,6 +305,307 @@ bool INIParser::Parse(const char* data, size_t data_len, const string& line_sep,
     return true;
 }
 
+bool INIParser::Reload(const string& filename) {
+    DataStream ds;
+    if (!ds.ReadFile(filename)) {
+        return false;
+    }
+
+    return Reload(ds.data(), ds.size(), "\n", "=");
+}
+
+bool INIParser::Reload(const char* data, size_t datalen) {
+    return Reload(data, datalen, "\n", "=");
+}
+
+bool INIParser::Reload(const char* data, size_t datalen, const string& linesep, const string& keyvaluesep) {
+    INIParser ini(case_sensitive_, compatible_, keep_sequence_);
+    ini.set_trim_chars(trim_chars_);
+    bool r = ini.Parse(data, datalen, linesep, keyvaluesep);
+    error_code_ = ini.error_code_;
+    if (!r) {
+        // Keep the current data
+        return false;
+    }
+
+    kv_sep_ = ini.kv_sep_;
+    line_sep_ = ini.line_sep_;
+    section_map_.swap(ini.section_map_);
+    section_list_.swap(ini.section_list_);
+    if (listeners_.empty()) {
+        return true;
+    }
+
+    // Both of the maps are sorted, walk them side by side.
+    // ini holds the old data now.
+    SectionMap::const_iterator oit(ini.section_map_.begin()), oite(ini.section_map_.end());
+    SectionMap::const_iterator nit(section_map_.begin()), nite(section_map_.end());
+    static const ssmap empty;
+    while (oit != oite || nit != nite) {
+        int cmp = 0;
+        if (oit == oite) {
+            cmp = 1;
+        } else if (nit == nite) {
+            cmp = -1;
+        } else {
+            cmp = oit->first.compare(nit->first);
+        }
+
+        const string& section = (cmp <= 0 ? oit->first : nit->first);
+        const ssmap& old_map = (cmp <= 0 ? oit->second : empty);
+        const ssmap& new_map = (cmp >= 0 ? nit->second : empty);
+        ssmap::const_iterator o(old_map.begin()), n(new_map.begin());
+        while (o != old_map.end() || n != new_map.end()) {
+            int c = 0;
+            if (o == old_map.end()) {
+                c = 1;
+            } else if (n == new_map.end()) {
+                c = -1;
+            } else {
+                c = o->first.compare(n->first);
+            }
+
+            if (c < 0) {
+                NotifyChange(kKeyRemoved, section, o->first, o->second);
+                ++o;
+            } else if (c > 0) {
+                NotifyChange(kKeyAdded, section, n->first, n->second);
+                ++n;
+            } else {
+                if (o->second != n->second) {
+                    NotifyChange(kKeyChanged, section, n->first, n->second);
+                }
+                ++o;
+                ++n;
+            }
+        }
+
+        if (cmp <= 0) {
+            ++oit;
+        }
+        if (cmp >= 0) {
+            ++nit;
+        }
+    }
+
+    change_type_ = kKeyAdded;
+    return true;
+}
+
+void INIParser::NotifyChange(ChangeType type, const string& section, const string& key, const string& value) {
+    change_type_ = type;
+    for (ListenerList::iterator it(listeners_.begin()), ite(listeners_.end()); it != ite; ++it) {
+        (*it)(*this, section, key, value);
+    }
+}
+
+bool INIParser::ParseWithSnapshot(const string& filename, const string& snapshot_filename) {
+    DataStream ds;
+    if (!ds.ReadFile(filename)) {
+        return false;
+    }
+
+    kv_sep_ = "=";
+    line_sep_ = "\n";
+
+    string md5 = MD5::Sumh(ds.data(), ds.size());
+    if (LoadSnapshot(snapshot_filename, md5)) {
+        return true;
+    }
+
+    if (!Parse(ds.data(), ds.size(), line_sep_, kv_sep_)) {
+        return false;
+    }
+
+    // It is only a cache, so a failure of writing it is not an error
+    SaveSnapshot(snapshot_filename, md5);
+    return true;
+}
+
+bool INIParser::SaveSnapshot(const string& snapshot_filename, const string& source_md5) const {
+    return INISnapshot::Save(*this, source_md5, snapshot_filename);
+}
+
+bool INIParser::LoadSnapshot(const string& snapshot_filename, const string& source_md5) {
+    INISnapshot snapshot;
+    if (!snapshot.Open(snapshot_filename, source_md5)) {
+        return false;
+    }
+
+    // The image parsed under the other rules is not the same as parsing the source again
+    if (snapshot.case_sensitive() != case_sensitive_ || (keep_sequence_ && !snapshot.has_sequence())
+            || snapshot.compatible() != compatible_ || snapshot.trim_chars() != trim_chars_) {
+        return false;
+    }
+
+    return snapshot.Restore(*this);
+}
+
+bool INIParser::ParseFileParallel(const string& filename, int thread_count /*= 0*/) {
+#ifdef H_OS_WINDOWS
+    DataStream ds;
+    if (!ds.ReadFile(filename)) {
+        return false;
+    }
+
+    return ParseParallel(ds.data(), ds.size(), thread_count);
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        return false;
+    }
+
+    size_t len = static_cast<size_t>(st.st_size);
+    void* addr = ::mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+
+    ::madvise(addr, len, MADV_SEQUENTIAL);
+    bool r = ParseParallel(static_cast<const char*>(addr), len, thread_count);
+    ::munmap(addr, len);
+    return r;
+#endif
+}
+
+bool INIParser::ParseParallel(const char* data, size_t data_len, int thread_count /*= 0*/) {
+    // Too small pieces are not worth a thread
+    const size_t kMinChunkSize = 1024 * 1024;
+    if (thread_count <= 0) {
+        thread_count = static_cast<int>(std::thread::hardware_concurrency());
+    }
+    if (data_len / kMinChunkSize < static_cast<size_t>(thread_count)) {
+        thread_count = static_cast<int>(data_len / kMinChunkSize);
+    }
+    if (thread_count <= 1) {
+        return Parse(data, data_len, "\n", "=");
+    }
+
+    kv_sep_ = "=";
+    line_sep_ = "\n";
+
+    // Split the data after a '\n' near every (data_len / thread_count) bytes
+    const char* data_end = data + data_len;
+    std::vector<const char*> bounds(1, data);
+    for (int i = 1; i < thread_count; ++i) {
+        const char* p = data + data_len / thread_count * i;
+        if (p <= bounds.back()) {
+            continue;
+        }
+
+        p = static_cast<const char*>(memchr(p, '\n', data_end - p));
+        if (!p || p + 1 >= data_end) {
+            break;
+        }
+        bounds.push_back(p + 1);
+    }
+    bounds.push_back(data_end);
+
+    // Every piece but the first one starts within the section where the
+    // previous piece ends, which is not known until the previous piece is
+    // parsed. So it starts within kUnknownSection, which is never a real
+    // section since a section name never contains the line separator. The
+    // keys before its first section line are moved to the right section when
+    // merging, which walks the pieces forward in order.
+    static const string kUnknownSection("\n");
+
+    // The listeners of this parser are called in the input order when merging
+    typedef std::vector<std::pair<string, ssmap::value_type> > ValueList;
+    size_t n = bounds.size() - 1;
+    std::vector<std::unique_ptr<INIParser> > parsers(n);
+    std::vector<ValueList> values(n);
+    std::vector<string> end_sections(n); // The section at the end of every piece
+    std::vector<char> results(n, 0); // not vector<bool>, it is written by several threads
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < n; ++i) {
+        parsers[i].reset(new INIParser(case_sensitive_, compatible_, keep_sequence_));
+        parsers[i]->set_trim_chars(trim_chars_);
+        if (!listeners_.empty()) {
+            ValueList* v = &values[i];
+            parsers[i]->SetParseListener([v](INIParser&, const string & section, const string & key, const string & value) {
+                v->push_back(std::make_pair(section, ssmap::value_type(key, value)));
+            });
+        }
+
+        end_sections[i] = (i == 0 ? string() : kUnknownSection);
+        threads.push_back(std::thread([&, i]() {
+            results[i] = parsers[i]->DoParse(bounds[i], bounds[i + 1] - bounds[i], "\n", "=", end_sections[i]);
+        }));
+    }
+
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+
+    // Merge the pieces in order. The later values override the earlier ones.
+    string section; // The section where the current piece starts
+    for (size_t i = 0; i < n; ++i) {
+        INIParser& p = *parsers[i];
+        for (SectionMap::iterator it = p.section_map_.begin(); it != p.section_map_.end(); ++it) {
+            const string& name = (it->first == kUnknownSection ? section : it->first);
+            SectionMap::iterator pos = section_map_.find(name);
+            if (pos == section_map_.end()) {
+                // Only in this piece, the whole map is moved
+                section_map_[name].swap(it->second);
+                continue;
+            }
+
+            // Insert the smaller map into the larger one
+            ssmap& m = pos->second;
+            if (m.size() < it->second.size()) {
+                m.swap(it->second);
+                m.insert(it->second.begin(), it->second.end()); // the existing later values are kept
+                continue;
+            }
+
+            for (ssmap::iterator kv = it->second.begin(); kv != it->second.end(); ++kv) {
+                m[kv->first].swap(kv->second);
+            }
+        }
+
+        if (keep_sequence_ && !p.section_list_.empty()) {
+            if (p.section_list_.begin()->first == kUnknownSection) {
+                p.section_list_.begin()->first = section;
+            }
+
+            SectionList::reverse_iterator last = section_list_.rbegin();
+            if (last != section_list_.rend() && last->first == p.section_list_.begin()->first) {
+                last->second.splice(last->second.end(), p.section_list_.begin()->second);
+                p.section_list_.pop_front();
+            }
+            section_list_.splice(section_list_.end(), p.section_list_);
+        }
+
+        for (ValueList::iterator it = values[i].begin(); it != values[i].end(); ++it) {
+            const string& name = (it->first == kUnknownSection ? section : it->first);
+            for (ListenerList::iterator l = listeners_.begin(); l != listeners_.end(); ++l) {
+                (*l)(*this, name, it->second.first, it->second.second);
+            }
+        }
+
+        if (end_sections[i] != kUnknownSection) {
+            section = end_sections[i];
+        }
+
+        if (p.error_code_ != kNoError) {
+            error_code_ = p.error_code_;
+        }
+
+        if (!results[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 void INIParser::SetParseListener(ParseListener pl) {
     listeners_.push_back(pl);
 }
@@ -329,6 +703,11 @@ void INIParser::Set(const string& key, const string& value) {
 }
 
 const char* INIParser::SkipCommits(const char* szsrc, size_t len) {
+    // Most of the lines are not comments
+    if (len == 0 || (static_cast<unsigned char>(*szsrc) > ' ' && *szsrc != ';' && *szsrc != '#' && *szsrc != '/')) {
+        return szsrc;
+    }
+
     bool commit = false;
     Tokener token(szsrc, len);
 
@@ -604,6 +983,40 @@ void INIParser::set_trim_chars(const string& trimchars) {
     InitTrimCharsTable();
 }
 
+void INIParser::FindSeparators(const char* line_begin, const char* data_end, const char*& kv_sep_pos, const char*& line_end) const {
+    // Scan the line once for the first bytes of the two separators
+    const char* p = line_begin;
+    while ((p = FindEitherByte(p, data_end, kv_sep_[0], line_sep_[0])) != NULL) {
+        if (StartsWith(p, data_end, line_sep_)) {
+            // No key/value separator in this line, find the next one as strstr did
+            line_end = p;
+            kv_sep_pos = FindSeparator(p, data_end, kv_sep_);
+            return;
+        }
+
+        if (StartsWith(p, data_end, kv_sep_)) {
+            kv_sep_pos = p;
+            line_end = FindSeparator(p + 1, data_end, line_sep_);
+            return;
+        }
+
+        ++p;
+    }
+}
+
+void INIParser::TrimRange(const char*& begin, const char*& end) const {
+    const uint8_t* b = reinterpret_cast<const uint8_t*>(begin);
+    const uint8_t* e = reinterpret_cast<const uint8_t*>(end);
+    while (b < e && trim_chars_table_[*b]) {
+        ++b;
+    }
+    while (e > b && trim_chars_table_[e[-1]]) {
+        --e;
+    }
+    begin = reinterpret_cast<const char*>(b);
+    end = reinterpret_cast<const char*>(e);
+}
+
 const char* INIParser::SkipTrimChars(const char* szsrc, const char* end) {
     const uint8_t* t = (const unsigned char*)szsrc;
     for (; t && t < (const uint8_t*)end && trim_chars_table_[*t]; ++t) {
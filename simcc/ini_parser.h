@@ -33,6 +33,13 @@ public:
         kErrorCannotFindKVSeperatorAndLineSeperator = 3,
         kErrorSectionFormatWrong = 4,
     };
+
+    // The kind of a change reported by Reload
+    enum ChangeType {
+        kKeyAdded = 0,
+        kKeyRemoved = 1,
+        kKeyChanged = 2,
+    };
 public:
     // @brief
     // @param[in] is_case_sensitive -
@@ -75,6 +82,66 @@ public:
     bool Parse(const char* data, size_t datalen, const char* linesep, const char* keyvaluesep);
     bool Parse(const char* data, size_t datalen, const string& linesep, const string& keyvaluesep);
 
+    // @brief Parse a large INI file with several threads.
+    //     The file is mapped into memory and split into pieces at the line
+    //     boundaries, each piece is parsed by a thread and the results are
+    //     merged in the input order, so the result is the same as
+    //     <code>Parse(filename)</code>. The sequence of the keys is kept if
+    //     <code>keep_sequence</code> is set, and the ParseListeners are called
+    //     in the input order after all the pieces are parsed.
+    //     A small file is parsed in the current thread.
+    //     The merging is serial. A section found in only one piece is moved
+    //     in whole, but the keys of a section shared by several pieces, e.g.
+    //     a file without sections, are inserted one by one, which limits the
+    //     speed-up to well below the count of the threads.
+    // @param const string & filename - The INI file name
+    // @param int thread_count - The count of the threads, 0 means the count of the CPU cores
+    // @return bool - return true if parse successfully
+    bool ParseFileParallel(const string& filename, int thread_count = 0);
+
+    // @brief Parse the raw data with several threads.
+    //     Lines are separated by '\n' and key-value is separated by '='.
+    // @see ParseFileParallel
+    bool ParseParallel(const char* data, size_t datalen, int thread_count = 0);
+
+    // @brief Parse the new contents and replace the current data with it.
+    //     Instead of every value, the ParseListeners are called only for the keys
+    //     which are added, removed or changed, after the new data is in place.
+    //     Call <code>change_type()</code> in a listener to know which kind of
+    //     change it is. The value of a removed key is its old value.
+    //     If the parsing fails, the current data is kept.
+    // @return bool - return true if parse successfully
+    bool Reload(const string& filename);
+    bool Reload(const char* data, size_t datalen);
+    bool Reload(const char* data, size_t datalen, const string& linesep, const string& keyvaluesep);
+
+    // @brief The kind of the change being reported in a ParseListener.
+    //     It is always kKeyAdded when parsing.
+    ChangeType change_type() const {
+        return change_type_;
+    }
+
+    // @brief Parse the INI file, or load its binary snapshot if it is made from
+    //     the same contents of the file. If the snapshot is missing or stale, the file
+    //     is parsed and a new snapshot is written.
+    //     The snapshot must be made by a parser with the same options.
+    // @see INISnapshot
+    // @param const string & filename - The INI file name
+    // @param const string & snapshot_filename - The snapshot file name
+    // @return bool - return true if the snapshot is loaded or the file is parsed successfully
+    bool ParseWithSnapshot(const string& filename, const string& snapshot_filename);
+
+    // @brief Write the binary snapshot of the parsed data into a file
+    // @param const string & source_md5 - The 32 bytes hex MD5 of the source data
+    bool SaveSnapshot(const string& snapshot_filename, const string& source_md5) const;
+
+    // @brief Replace the parsed data with the contents of a binary snapshot
+    // @param const string & source_md5 - The 32 bytes hex MD5 of the source data,
+    //     if it is not empty, the snapshot must be made from the same source data
+    // @return bool - false if the snapshot is invalid or stale, or it does not match the options of this parser:
+    //     the case sensitivity, the compatible mode, the trim chars and the sequence if it is kept
+    bool LoadSnapshot(const string& snapshot_filename, const string& source_md5);
+
     // @brief When parsing the INI file, you can call this function to stop the parsing
     // @return void -
     void StopParsing(bool stop_parsing);
@@ -228,6 +295,21 @@ private:
     // @return const char* - The pointer to the next character
     const char* SkipTrimChars(const char* szsrc, const char* dataend);
 
+    // @brief Find the first key/value separator and line separator from line_begin.
+    //     The line is scanned only once in the common case. The results are the
+    //     same as strstr, but nothing after data_end is touched.
+    void FindSeparators(const char* line_begin, const char* data_end, const char*& kv_sep_pos, const char*& line_end) const;
+
+    // @brief Parse the raw data which starts within <code>section</code>
+    // @param[in,out] string & section - The section at the end of the data is stored here
+    bool DoParse(const char* data, size_t datalen, const string& linesep, const string& keyvaluesep, string& section);
+
+    // @brief Call the ParseListeners for a change found by Reload
+    void NotifyChange(ChangeType type, const string& section, const string& key, const string& value);
+
+    // @brief Remove the characters within <code>trim_chars_</code> from the both ends of [begin, end)
+    void TrimRange(const char*& begin, const char*& end) const;
+
     template<class stream_t>
     void serialize(stream_t& os, bool input_order = false) const;
 
@@ -258,7 +340,10 @@ private:
     typedef std::list<ParseListener> ListenerList;
     ListenerList listeners_;
 
+    ChangeType change_type_;
+
     class SequenceParseListener;
+    friend class INISnapshot;
 };
 
 inline void INIParser::Reset() {
@@ -0,0 +1,496 @@
+#include "simcc/ini_snapshot.h"
+#include "simcc/data_stream.h"
+#include "simcc/misc/md5.h"
+
+#include <unordered_map>
+#include <wctype.h>
+
+#ifndef H_OS_WINDOWS
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace simcc {
+
+namespace {
+const char kMagic[8] = {'S', 'I', 'M', 'C', 'C', 'I', 'N', 'I'};
+const simcc::uint32 kVersion = 2;
+
+// Read back as another number on a host of the other byte order
+const simcc::uint32 kByteOrder = 0x01020304;
+
+// The flags of an Entry
+enum {
+    kSectionOnly = 1, // An empty section, which is not in the hash index
+};
+
+enum {
+    kCaseSensitive = 1,
+    kHasSequence = 2,
+    kCompatible = 4,
+};
+
+struct Header {
+    char magic[8];
+    simcc::uint32 version;
+    simcc::uint32 byte_order;
+    simcc::uint32 flags;
+    char source_md5[32]; // hex
+    simcc::uint32 entry_count;
+    simcc::uint32 bucket_count; // a power of 2
+    simcc::uint32 sequence_count;
+    simcc::uint32 string_size;
+    simcc::uint32 line_sep_len; // The separators and the trim chars are at the beginning of the string pool
+    simcc::uint32 kv_sep_len;
+    simcc::uint32 trim_chars_len;
+    simcc::uint32 entries_offset;
+    simcc::uint32 buckets_offset;
+    simcc::uint32 sequence_offset;
+    simcc::uint32 strings_offset;
+    simcc::uint32 total_size;
+};
+
+// FNV-1a of section + '\n' + key
+class Hasher {
+public:
+    Hasher() : h_(2166136261u) {}
+
+    void Update(const char* p, size_t len, bool fold) {
+        for (size_t i = 0; i < len; ++i) {
+            char c = (fold ? static_cast<char>(towlower(p[i])) : p[i]);
+            h_ = (h_ ^ static_cast<unsigned char>(c)) * 16777619u;
+        }
+    }
+
+    simcc::uint32 Hash(const Slice& section, const Slice& key, bool fold) {
+        Update(section.data(), section.size(), fold);
+        Update("\n", 1, false);
+        Update(key.data(), key.size(), fold);
+        return h_;
+    }
+
+private:
+    simcc::uint32 h_;
+};
+
+// Compare the stored string s with the query q which may need to be folded
+bool Equals(const Slice& s, const Slice& q, bool fold) {
+    if (s.size() != q.size()) {
+        return false;
+    }
+
+    if (!fold) {
+        return memcmp(s.data(), q.data(), s.size()) == 0;
+    }
+
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] != static_cast<char>(towlower(q[i]))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+const Header* GetHeader(const char* data) {
+    return reinterpret_cast<const Header*>(data);
+}
+}
+
+struct INISnapshot::Entry {
+    simcc::uint32 hash;
+    simcc::uint32 flags;
+    simcc::uint32 section_offset;
+    simcc::uint32 section_len;
+    simcc::uint32 key_offset;
+    simcc::uint32 key_len;
+    simcc::uint32 value_offset;
+    simcc::uint32 value_len;
+};
+
+INISnapshot::INISnapshot()
+    : data_(NULL)
+    , len_(0)
+    , mapped_(NULL)
+    , entries_(NULL)
+    , buckets_(NULL)
+    , sequence_(NULL)
+    , strings_(NULL) {
+}
+
+INISnapshot::~INISnapshot() {
+    Close();
+}
+
+bool INISnapshot::Write(const INIParser& ini, const string& source_md5, DataStream& image) {
+    if (source_md5.size() != MD5::kHexDigestLength) {
+        return false;
+    }
+
+    const INIParser::SectionMap& m = ini.GetSectionMap();
+    std::vector<Entry> entries;
+    string strings = ini.line_separator() + ini.kv_separator() + ini.trim_chars_;
+    std::unordered_map<string, simcc::uint32> indexes; // section + '\n' + key => entry index
+    INIParser::SectionMap::const_iterator it(m.begin()), ite(m.end());
+    for (; it != ite; ++it) {
+        simcc::uint32 section_offset = static_cast<simcc::uint32>(strings.size());
+        strings.append(it->first);
+        if (it->second.empty()) {
+            // A section without any key, e.g. "[foo]" on the last line, is kept by the parser too
+            Entry e;
+            memset(&e, 0, sizeof(e));
+            e.flags = kSectionOnly;
+            e.section_offset = section_offset;
+            e.section_len = static_cast<simcc::uint32>(it->first.size());
+            entries.push_back(e);
+            continue;
+        }
+
+        INIParser::ssmap::const_iterator kv(it->second.begin()), kve(it->second.end());
+        for (; kv != kve; ++kv) {
+            Entry e;
+            e.hash = Hasher().Hash(it->first, kv->first, false);
+            e.flags = 0;
+            e.section_offset = section_offset;
+            e.section_len = static_cast<simcc::uint32>(it->first.size());
+            e.key_offset = static_cast<simcc::uint32>(strings.size());
+            e.key_len = static_cast<simcc::uint32>(kv->first.size());
+            strings.append(kv->first);
+            e.value_offset = static_cast<simcc::uint32>(strings.size());
+            e.value_len = static_cast<simcc::uint32>(kv->second.size());
+            strings.append(kv->second);
+            if (ini.keep_sequence_) {
+                indexes[it->first + "\n" + kv->first] = static_cast<simcc::uint32>(entries.size());
+            }
+            entries.push_back(e);
+        }
+    }
+
+    std::vector<simcc::uint32> sequence;
+    if (ini.keep_sequence_) {
+        INIParser::SectionList::const_iterator sit(ini.section_list_.begin()), site(ini.section_list_.end());
+        for (; sit != site; ++sit) {
+            INIParser::StringList::const_iterator kit(sit->second.begin()), kite(sit->second.end());
+            for (; kit != kite; ++kit) {
+                std::unordered_map<string, simcc::uint32>::const_iterator found = indexes.find(sit->first + "\n" + *kit);
+                if (found != indexes.end()) {
+                    sequence.push_back(found->second);
+                }
+            }
+        }
+    }
+
+    // Keep the load factor under 0.5
+    simcc::uint32 bucket_count = 8;
+    while (bucket_count < entries.size() * 2) {
+        bucket_count <<= 1;
+    }
+
+    std::vector<simcc::uint32> buckets(bucket_count, 0);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].flags & kSectionOnly) {
+            continue;
+        }
+
+        simcc::uint32 b = entries[i].hash & (bucket_count - 1);
+        while (buckets[b] != 0) {
+            b = (b + 1) & (bucket_count - 1);
+        }
+        buckets[b] = static_cast<simcc::uint32>(i + 1);
+    }
+
+    Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.version = kVersion;
+    h.byte_order = kByteOrder;
+    h.flags = (ini.case_sensitive() ? kCaseSensitive : 0) | (ini.keep_sequence_ ? kHasSequence : 0)
+              | (ini.compatible() ? kCompatible : 0);
+    memcpy(h.source_md5, source_md5.data(), sizeof(h.source_md5));
+    h.entry_count = static_cast<simcc::uint32>(entries.size());
+    h.bucket_count = bucket_count;
+    h.sequence_count = static_cast<simcc::uint32>(sequence.size());
+    h.string_size = static_cast<simcc::uint32>(strings.size());
+    h.line_sep_len = static_cast<simcc::uint32>(ini.line_separator().size());
+    h.kv_sep_len = static_cast<simcc::uint32>(ini.kv_separator().size());
+    h.trim_chars_len = static_cast<simcc::uint32>(ini.trim_chars_.size());
+    h.entries_offset = sizeof(h);
+    h.buckets_offset = h.entries_offset + h.entry_count * sizeof(Entry);
+    h.sequence_offset = h.buckets_offset + h.bucket_count * sizeof(simcc::uint32);
+    h.strings_offset = h.sequence_offset + h.sequence_count * sizeof(simcc::uint32);
+    h.total_size = h.strings_offset + h.string_size;
+
+    image.Reserve(image.size() + h.total_size);
+    image.Write(&h, sizeof(h));
+    if (!entries.empty()) {
+        image.Write(&entries[0], entries.size() * sizeof(Entry));
+    }
+    image.Write(&buckets[0], buckets.size() * sizeof(simcc::uint32));
+    if (!sequence.empty()) {
+        image.Write(&sequence[0], sequence.size() * sizeof(simcc::uint32));
+    }
+    image.Write(strings.data(), strings.size());
+    return true;
+}
+
+bool INISnapshot::Save(const INIParser& ini, const string& source_md5, const string& filename) {
+    DataStream image;
+    return Write(ini, source_md5, image) && image.WriteFile(filename);
+}
+
+bool INISnapshot::Open(const string& filename, const string& source_md5 /*= ""*/) {
+    Close();
+
+#ifdef H_OS_WINDOWS
+    DataStream ds;
+    if (!ds.ReadFile(filename)) {
+        return false;
+    }
+
+    copy_.assign(ds.data(), ds.size());
+    data_ = copy_.data();
+    len_ = copy_.size();
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(Header))) {
+        ::close(fd);
+        return false;
+    }
+
+    len_ = static_cast<size_t>(st.st_size);
+    void* addr = ::mmap(NULL, len_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        len_ = 0;
+        return false;
+    }
+
+    mapped_ = addr;
+    data_ = static_cast<const char*>(addr);
+#endif
+
+    if (!Validate(source_md5)) {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+bool INISnapshot::Attach(const void* data, size_t len, const string& source_md5 /*= ""*/) {
+    Close();
+
+    // The entries are accessed in place
+    if (!data || reinterpret_cast<uintptr_t>(data) % sizeof(simcc::uint32) != 0) {
+        return false;
+    }
+
+    data_ = static_cast<const char*>(data);
+    len_ = len;
+    if (!Validate(source_md5)) {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void INISnapshot::Close() {
+#ifndef H_OS_WINDOWS
+    if (mapped_) {
+        ::munmap(mapped_, len_);
+    }
+#endif
+    mapped_ = NULL;
+    copy_.clear();
+    data_ = NULL;
+    len_ = 0;
+    entries_ = NULL;
+    buckets_ = NULL;
+    sequence_ = NULL;
+    strings_ = NULL;
+}
+
+bool INISnapshot::Validate(const string& source_md5) {
+    if (len_ < sizeof(Header)) {
+        return false;
+    }
+
+    const Header* h = GetHeader(data_);
+    if (memcmp(h->magic, kMagic, sizeof(kMagic)) != 0 || h->version != kVersion
+            || h->byte_order != kByteOrder || h->total_size != len_) {
+        return false;
+    }
+
+    if (!source_md5.empty() && (source_md5.size() != sizeof(h->source_md5) || memcmp(source_md5.data(), h->source_md5, sizeof(h->source_md5)) != 0)) {
+        return false;
+    }
+
+    // The parts are in order and the counts are checked against the sizes,
+    // so none of the numbers below can overflow
+    if (h->bucket_count == 0 || (h->bucket_count & (h->bucket_count - 1)) != 0
+            || h->entries_offset != sizeof(Header)
+            || h->entry_count > (len_ - h->entries_offset) / sizeof(Entry)
+            || h->buckets_offset != h->entries_offset + h->entry_count * sizeof(Entry)
+            || h->bucket_count > (len_ - h->buckets_offset) / sizeof(simcc::uint32)
+            || h->sequence_offset != h->buckets_offset + h->bucket_count * sizeof(simcc::uint32)
+            || h->sequence_count > (len_ - h->sequence_offset) / sizeof(simcc::uint32)
+            || h->strings_offset != h->sequence_offset + h->sequence_count * sizeof(simcc::uint32)
+            || h->string_size != len_ - h->strings_offset
+            || h->line_sep_len > h->string_size || h->kv_sep_len > h->string_size - h->line_sep_len
+            || h->trim_chars_len > h->string_size - h->line_sep_len - h->kv_sep_len) {
+        return false;
+    }
+
+    entries_ = data_ + h->entries_offset;
+    buckets_ = data_ + h->buckets_offset;
+    sequence_ = data_ + h->sequence_offset;
+    strings_ = data_ + h->strings_offset;
+
+    // Check every reference, then the queries need no more checking
+    for (size_t i = 0; i < h->entry_count; ++i) {
+        const Entry* e = entry(i);
+        if (e->section_offset > h->string_size || e->section_len > h->string_size - e->section_offset
+                || e->key_offset > h->string_size || e->key_len > h->string_size - e->key_offset
+                || e->value_offset > h->string_size || e->value_len > h->string_size - e->value_offset) {
+            return false;
+        }
+    }
+
+    const simcc::uint32* buckets = reinterpret_cast<const simcc::uint32*>(buckets_);
+    size_t used = 0;
+    for (size_t i = 0; i < h->bucket_count; ++i) {
+        if (buckets[i] > h->entry_count || (buckets[i] != 0 && (entry(buckets[i] - 1)->flags & kSectionOnly))) {
+            return false;
+        }
+        used += (buckets[i] != 0 ? 1 : 0);
+    }
+
+    // There must be an empty bucket to stop the probing
+    if (used == h->bucket_count) {
+        return false;
+    }
+
+    const simcc::uint32* sequence = reinterpret_cast<const simcc::uint32*>(sequence_);
+    for (size_t i = 0; i < h->sequence_count; ++i) {
+        if (sequence[i] >= h->entry_count || (entry(sequence[i])->flags & kSectionOnly)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+const INISnapshot::Entry* INISnapshot::entry(size_t index) const {
+    return reinterpret_cast<const Entry*>(entries_) + index;
+}
+
+Slice INISnapshot::Get(const Slice& key, bool* found) const {
+    return Get(Slice(), key, found);
+}
+
+Slice INISnapshot::Get(const Slice& section, const Slice& key, bool* found) const {
+    if (found) {
+        *found = false;
+    }
+
+    if (!data_) {
+        return Slice();
+    }
+
+    const Header* h = GetHeader(data_);
+    bool fold = !case_sensitive();
+    simcc::uint32 hash = Hasher().Hash(section, key, fold);
+    simcc::uint32 mask = h->bucket_count - 1;
+    const simcc::uint32* buckets = reinterpret_cast<const simcc::uint32*>(buckets_);
+    for (simcc::uint32 b = hash & mask; buckets[b] != 0; b = (b + 1) & mask) {
+        const Entry* e = entry(buckets[b] - 1);
+        if (e->hash == hash && Equals(String(e->key_offset, e->key_len), key, fold)
+                && Equals(String(e->section_offset, e->section_len), section, fold)) {
+            if (found) {
+                *found = true;
+            }
+            return String(e->value_offset, e->value_len);
+        }
+    }
+
+    return Slice();
+}
+
+bool INISnapshot::Restore(INIParser& ini) const {
+    if (!data_) {
+        return false;
+    }
+
+    const Header* h = GetHeader(data_);
+    ini.section_map_.clear();
+    ini.section_list_.clear();
+    ini.line_sep_ = String(0, h->line_sep_len).ToString();
+    ini.kv_sep_ = String(h->line_sep_len, h->kv_sep_len).ToString();
+
+    // The entries are sorted as the maps, so every insertion is at the end
+    INIParser::ssmap* kvmap = NULL;
+    Slice last_section;
+    for (size_t i = 0; i < h->entry_count; ++i) {
+        const Entry* e = entry(i);
+        Slice section = String(e->section_offset, e->section_len);
+        if (!kvmap || section != last_section) {
+            kvmap = &ini.section_map_.insert(ini.section_map_.end(), INIParser::SectionMap::value_type(section.ToString(), INIParser::ssmap()))->second;
+            last_section = section;
+        }
+        if (e->flags & kSectionOnly) {
+            continue;
+        }
+        kvmap->insert(kvmap->end(), INIParser::ssmap::value_type(String(e->key_offset, e->key_len).ToString(), String(e->value_offset, e->value_len).ToString()));
+    }
+
+    const simcc::uint32* sequence = reinterpret_cast<const simcc::uint32*>(sequence_);
+    for (size_t i = 0; i < h->sequence_count; ++i) {
+        const Entry* e = entry(sequence[i]);
+        Slice section = String(e->section_offset, e->section_len);
+        if (ini.section_list_.empty() || ini.section_list_.rbegin()->first != section) {
+            ini.section_list_.push_back(INIParser::SectionPairEntry(section.ToString(), INIParser::StringList()));
+        }
+        ini.section_list_.rbegin()->second.push_back(String(e->key_offset, e->key_len).ToString());
+    }
+
+    return true;
+}
+
+size_t INISnapshot::size() const {
+    return data_ ? GetHeader(data_)->entry_count : 0;
+}
+
+bool INISnapshot::case_sensitive() const {
+    return data_ ? (GetHeader(data_)->flags & kCaseSensitive) != 0 : true;
+}
+
+bool INISnapshot::compatible() const {
+    return data_ ? (GetHeader(data_)->flags & kCompatible) != 0 : false;
+}
+
+string INISnapshot::trim_chars() const {
+    if (!data_) {
+        return string();
+    }
+
+    const Header* h = GetHeader(data_);
+    return String(h->line_sep_len + h->kv_sep_len, h->trim_chars_len).ToString();
+}
+
+bool INISnapshot::has_sequence() const {
+    return data_ ? (GetHeader(data_)->flags & kHasSequence) != 0 : false;
+}
+
+string INISnapshot::source_md5() const {
+    return data_ ? string(GetHeader(data_)->source_md5, sizeof(GetHeader(data_)->source_md5)) : string();
+}
+
+}
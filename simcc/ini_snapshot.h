@@ -0,0 +1,111 @@
+#pragma once
+
+#include "simcc/inner_pre.h"
+#include "simcc/slice.h"
+#include "simcc/ini_parser.h"
+
+namespace simcc {
+
+class DataStream;
+
+// @brief A binary image of a parsed INIParser, which can be loaded back
+// without parsing the source text again.
+//
+// The image is a header, an array of the section/key/value entries in the
+// order of INIParser::SectionMap, with a section-only entry for every section
+// without any key, an open-addressing hash index of the entries,
+// the input sequence of the keys when INIParser keeps it and a string pool.
+// The image is written as the structs in memory, the numbers are 32-bit in the
+// host byte order, so it is only valid on the same platform. An image of the
+// other byte order is rejected. The image records the MD5 of the source data,
+// so a stale image is rejected.
+//
+// INISnapshot maps an image file into memory and answers the queries from it
+// directly, or restores an INIParser from it:
+//     simcc::INIParser ini;
+//     if (!ini.ParseWithSnapshot("a.ini", "a.ini.snapshot")) {
+//         // ...
+//     }
+//
+//     simcc::INISnapshot snapshot;
+//     if (snapshot.Open("a.ini.snapshot", simcc::MD5::Sumh(source))) {
+//         simcc::Slice v = snapshot.Get("section", "key");
+//     }
+class SIMCC_EXPORT INISnapshot {
+public:
+    INISnapshot();
+    ~INISnapshot();
+
+    // @brief Write the image of the parser into the stream
+    // @param const string & source_md5 - The 32 bytes hex MD5 of the source data
+    static bool Write(const INIParser& ini, const string& source_md5, DataStream& image);
+
+    // @brief Write the image of the parser into a file
+    static bool Save(const INIParser& ini, const string& source_md5, const string& filename);
+
+    // @brief Map an image file into memory
+    // @param const string & source_md5 - If it is not empty, the image must be made from the source data with this MD5
+    // @return bool - false if the file can't be read or it is not a valid image
+    bool Open(const string& filename, const string& source_md5 = "");
+
+    // @brief Use an image in memory, which must outlive this object
+    bool Attach(const void* data, size_t len, const string& source_md5 = "");
+
+    void Close();
+
+    // @brief Get the value of the key. If the parser is not case sensitive,
+    //     the section and key are folded by towlower as INIParser does.
+    // @return the value, or an empty Slice if it is not found.
+    //     The Slice is valid until Close.
+    Slice Get(const Slice& key, bool* found = NULL) const;
+    Slice Get(const Slice& section, const Slice& key, bool* found = NULL) const;
+
+    // @brief Fill the section/key/value map, and the sequence if there is one, into the parser
+    bool Restore(INIParser& ini) const;
+
+    bool is_open() const {
+        return data_ != NULL;
+    }
+
+    // The count of the section/key/value entries, and the section-only ones of the empty sections
+    size_t size() const;
+
+    bool case_sensitive() const;
+
+    // The options of the parser which made the image, see INIParser::set_compatible
+    // and INIParser::set_trim_chars
+    bool compatible() const;
+    string trim_chars() const;
+
+    // Whether the input sequence of the keys is recorded
+    bool has_sequence() const;
+
+    // The hex MD5 of the source data
+    string source_md5() const;
+
+private:
+    struct Entry;
+
+    bool Validate(const string& source_md5);
+    const Entry* entry(size_t index) const;
+    Slice String(simcc::uint32 offset, simcc::uint32 len) const {
+        return Slice(strings_ + offset, len);
+    }
+
+private:
+    const char* data_;
+    size_t len_;
+    void* mapped_; // Not NULL if the image is mapped from a file
+    string copy_;  // The image read from a file where it can't be mapped
+
+    // The parts of the image
+    const char* entries_;
+    const char* buckets_;
+    const char* sequence_;
+    const char* strings_;
+
+    INISnapshot(const INISnapshot&);
+    INISnapshot& operator=(const INISnapshot&);
+};
+
+}
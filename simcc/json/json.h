@@ -9,3 +9,6 @@
 #include "json_array.h"
 #include "json_object.h"
 #include "inherited_conf_json.h"
+#include "json_protobuf_reader.h"
+#include "json_validator.h"
+#include "json_patch.h"
@@ -216,6 +216,29 @@ bool JSONArray::Remove(int index) {
     return true;
 }
 
+bool JSONArray::Insert(int index, const ObjectPtr& value) {
+    if (!value || index < 0 || static_cast<size_t>(index) > list_.size()) {
+        return false;
+    }
+
+    list_.insert(begin(index), value);
+    return true;
+}
+
+bool JSONArray::Set(int index, const ObjectPtr& value) {
+    if (!value) {
+        return false;
+    }
+
+    iterator it = begin(index);
+    if (it == list_.end()) {
+        return false;
+    }
+
+    *it = value;
+    return true;
+}
+
 Object* JSONArray::Get(int index) const {
     const_iterator it = begin(index);
     if (it != list_.end()) {
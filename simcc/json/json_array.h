@@ -121,6 +121,14 @@ public:
     // @return true if remove the element success
     bool Remove(int index);
 
+    // Insert an element before the element at index, or append it if index equals size().
+    // @return false if the index is out of range or value is NULL
+    bool Insert(int index, const ObjectPtr& value);
+
+    // Replace the element at index.
+    // @return false if the index is out of range or value is NULL
+    bool Set(int index, const ObjectPtr& value);
+
     // Returns whether the JSON object is empty, i.e. whether its size is 0.
     bool empty() const {
         return list_.empty();
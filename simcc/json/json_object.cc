@@ -4,7 +4,9 @@
 
 #include "json.h"
 #include "json_tokener.h"
+#include "json_protobuf_tokener.h"
 #include "json_utf8_inl.h"
+#include "json_swar_inl.h"
 
 namespace simcc {
 namespace json {
@@ -285,81 +287,131 @@ Object* JSONObject::ConvertToObject(const char* s, size_t len, JSONParser* parse
     }
 }
 
+namespace {
+// True if any byte of the 8 bytes at p can not be copied as it is by Quote:
+// a control character, '"', '\\' or, when escaping unicode, a non-ASCII byte.
+// A bare slash is legal in JSON, so '/' is not escaped.
+inline bool HasQuoteSpecialByte(const char* p, bool utf8_to_unicode) {
+    simcc::uint64 v = swar::Load(p);
+    simcc::uint64 r = swar::HasByteLessThan(v, ' ')
+                      | swar::HasByte(v, '"')
+                      | swar::HasByte(v, '\\');
+    if (utf8_to_unicode) {
+        r |= swar::HasNonASCIIByte(v);
+    }
+    return r != 0;
+}
+
+// Write a BMP code point as \uXXXX
+inline char* WriteUnicodeEscape(simcc::uint32 codepoint, char* p) {
+    static const char kHex[] = "0123456789abcdef";
+    p[0] = '\\';
+    p[1] = 'u';
+    p[2] = kHex[(codepoint >> 12) & 0xF];
+    p[3] = kHex[(codepoint >> 8) & 0xF];
+    p[4] = kHex[(codepoint >> 4) & 0xF];
+    p[5] = kHex[codepoint & 0xF];
+    return p + 6;
+}
+}
+
 void JSONObject::Quote(const string& source, bool utf8_to_unicode, simcc::DataStream& sb) {
-    sb.Expand(source.size() << 2);
+    // A source byte is written as 3 bytes at most, e.g. a 2 bytes UTF-8
+    // character is escaped to \uXXXX, so we can write to the buffer directly.
+    if (!sb.Expand(static_cast<simcc::uint32>((source.size() << 2) + 2))) {
+        return;
+    }
 
-    sb.Write('"');
+    char* const writebegin = static_cast<char*>(sb.GetCurrentWriteBuffer());
+    char* writep = writebegin;
+    *writep++ = '"';
 
     const char* readp = source.data();
     const char* readend = readp + source.size();
     char c = 0;
     while (readp < readend) {
+        // Copy the plain characters 8 bytes at a time
+        while (readend - readp >= 8 && !HasQuoteSpecialByte(readp, utf8_to_unicode)) {
+            memcpy(writep, readp, 8);
+            writep += 8;
+            readp += 8;
+        }
+
+        if (readp >= readend) {
+            break;
+        }
+
         c = *readp++;
         switch (c) {
         case '\\':
-            sb.Write("\\\\", 2);
+            *writep++ = '\\';
+            *writep++ = '\\';
             break;
         case '"':
-            sb.Write("\\\"", 2);
-            break;
-        case '/':
-            // Even though \/ is considered a legal escape in JSON, a bare
-            // slash is also legal, so I see no reason to escape it.
-            // (I hope I am not misunderstanding something.)
-            // notes: actually escaping \/ may be useful in javascript to avoid </ sequence.
-            // So I add a flag to allow this compatibility mode and prevent this
-            // sequence from occurring.
-#if 1
-            if (readp > source.data() && *(readp - 1) == '<') {
-                sb.Write('\\');
-            }
-            sb.Write(c);
-#else
-            sb.Write("\\/", 2);
-#endif
+            *writep++ = '\\';
+            *writep++ = '"';
             break;
         case '\b':
-            sb.Write("\\b", 2);
+            *writep++ = '\\';
+            *writep++ = 'b';
             break;
         case '\t':
-            sb.Write("\\t", 2);
+            *writep++ = '\\';
+            *writep++ = 't';
             break;
         case '\n':
-            sb.Write("\\n", 2);
+            *writep++ = '\\';
+            *writep++ = 'n';
             break;
         case '\r':
-            sb.Write("\\r", 2);
+            *writep++ = '\\';
+            *writep++ = 'r';
             break;
         case '\f':
-            sb.Write("\\f", 2);
+            *writep++ = '\\';
+            *writep++ = 'f';
             break;
         default:
-            if (utf8_to_unicode) {
+            if (utf8_to_unicode && static_cast<unsigned char>(c) >= 0x80) {
+                // The common 3 bytes sequences (e.g. CJK characters) whose
+                // leading byte can't start an overlong form or a surrogate
+                unsigned char lead = static_cast<unsigned char>(c);
+                if (lead >= 0xE1 && lead != 0xED && lead <= 0xEF && readend - readp >= 2
+                        && (readp[0] & 0xC0) == 0x80 && (readp[1] & 0xC0) == 0x80) {
+                    simcc::uint32 u = ((lead & 0x0F) << 12) | ((readp[0] & 0x3F) << 6) | (readp[1] & 0x3F);
+                    writep = WriteUnicodeEscape(u, writep);
+                    readp += 2;
+                    break;
+                }
+
                 //Reference of jansson-2.0.1 http://www.digip.org/jansson/
                 int32_t codepoint = 0;
                 const char* end = utf8_iterate(readp - 1, &codepoint);
-                if (!end) {
+                if (!end || end > readend) {
                     //This is not a ASCII code and also NOT an UTF8 code,
                     //Maybe it is GBK Chinese code, so we just write it
-                    sb.Write(c);
+                    *writep++ = c;
                     break;
                 }
 
-                if (codepoint <= 0x7F) {
-                    sb.Write(static_cast<char>(codepoint));
+                if (codepoint < 0x10000) {
+                    writep = WriteUnicodeEscape(codepoint, writep);
                 } else {
-                    JSONTokener::EncodeUnicodeNumber(codepoint, sb);
-                    readp = end;
+                    // not in BMP -> construct a UTF-16 surrogate pair
+                    codepoint -= 0x10000;
+                    writep = WriteUnicodeEscape(0xD800 | ((codepoint & 0xffc00) >> 10), writep);
+                    writep = WriteUnicodeEscape(0xDC00 | (codepoint & 0x003ff), writep);
                 }
-                break;
+                readp = end;
             } else {
-                sb.Write(c);
+                *writep++ = c;
             }
             break;
         }
     }
 
-    sb.Write('"');
+    *writep++ = '"';
+    sb.seekp(static_cast<simcc::int32>(writep - writebegin));
 }
 
 Object* JSONObject::Get(const string& key)const {
@@ -728,160 +780,24 @@ simcc::DataStream& operator >> (simcc::DataStream& file, JSONObject& val) {
 
 
 
-#ifdef H_PROVIDE_PROTOBUF_DEBUGSTRING_2_JSON
-namespace {
-bool parseObject(JSONObject* rootjson, JSONTokener* x);
-Object* parseValue(JSONTokener* x);
-string parseKey(JSONTokener* x);
-
-Object* parseValue(JSONTokener* x) {
-    char c = x->NextClean();
-    switch (c) {
-    case '"':
-    case '\'': {
-        JSONString* jstring = new JSONString();
-        if (!x->NextString(c, true, jstring->value())) {
-            delete jstring;
-            jstring = NULL;
-        }
-        return jstring;
-    }
-    default:
-        //Handle unquoted text like: true, false, or null, or it can be a number.
-        break;
-    }
-
-    /*
-    * Handle unquoted text. This could be the values true, false, or
-    * null, or it can be a number. An implementation (such as this one)
-    * is allowed to also accept non-standard forms.
-    *
-    * Accumulate characters until we reach the end of the text or a
-    * formatting character.
-    */
-
-    //the static table of ",:]}/\\\"[{;=#" and space, tab and control characters
-    static char specialchars[256] = {
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        1, 1, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0,
-        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 1, 0, 1, 1,
-        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 1,
-        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1, 1,
-        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1
-    };
-
-    const char* startpos = x->GetCurrent() - 1;
-    while (specialchars[(int)c]) {
-        c = x->Next();
-    }
-
-    x->Back();
-
-    if (x->GetCurrent() <= startpos) {
-        printf("Miss value\n");
-        return NULL;
-    }
-
-    Object* value = JSONObject::ConvertToObject(startpos, x->GetCurrent() - startpos, NULL, x);
-    if (!value) {
-        JSONString* js = new JSONString;
-        value = js;
-        string strv(startpos, x->GetCurrent() - startpos);
-        js->value() = strv;
-    }
-    return value;
-}
-
-string parseKey(JSONTokener* x) {
-    x->SkipSpaces();
-    const char* start = x->GetCurrent();
-    for (;;) {
-        char c = x->Next();
-        if (c == ':' || c == '{') {
-            break;
-        } else if (x->IsEnd()) {
-            return "";
-        }
-    }
-
-    x->Back();
-    string key(start, x->GetCurrent() - start);
-    simcc::StringUtil::Trim(key);
-    return key;
+simcc::uint32 JSONObject::ParseProtobuf(const string& protobuf_debug_string) {
+    return ParseProtobuf(protobuf_debug_string.data(), protobuf_debug_string.size());
 }
 
-void putObject(const string& key, JSONObject* rootjson, Object* value) {
-    JSONArrayPtr original_arr = rootjson->GetJSONArray(key);
-    if (original_arr) {
-        original_arr->Put(value);
-    } else {
-        ObjectPtr original_obj = rootjson->Get(key);
-        if (original_obj) {
-            JSONArrayPtr ja = new JSONArray;
-            ja->Put(original_obj);
-            ja->Put(value);
-            rootjson->Put(key, ja.get());
-        } else {
-            rootjson->Put(key, value);
-        }
+simcc::uint32 JSONObject::ParseProtobuf(const char* source, size_t source_len) {
+    if (!source) {
+        set_error(kParameterWrong);
+        return 0;
     }
-}
 
-bool parseObject(JSONObject* rootjson, JSONTokener* x) {
-    x->SkipSpaces();
-    while (!x->IsEnd()) {
-        char c = x->NextClean();
-        if (c == '}' || c == 0) {
-            return true;
-        }
-        x->Back();
-        string key = parseKey(x);
-        if (key.empty()) {
-            return true;
-        }
-        c = x->NextClean();
-        switch (c) {
-        case ':': {
-            putObject(key, rootjson, parseValue(x));
-        }
-        break;
-        case '{': {
-            JSONObjectPtr value = new JSONObject;
-            if (parseObject(value.get(), x)) {
-                putObject(key, rootjson, value);
-            } else {
-                printf("Invalid object, error location:%u %s", x->GetCurrentPosition(), x->GetCurrent());
-                return false;
-            }
-        }
-        break;
-        default:
-            printf("Invalid char [%c], error location:%u %s", c, x->GetCurrentPosition(), x->GetCurrent());
-            return false;
-            break;
-        }
+    ProtobufTokener x(source, source_len);
+    if (!x.Parse(this)) {
+        set_error(x.error(), x.error_location());
+        return 0;
     }
 
-    return true;
+    return static_cast<simcc::uint32>(x.GetCurrentPosition());
 }
-}//end of namespace
-
-simcc::uint32 JSONObject::ParseProtobuf(const string& protobuf_debug_string) {
-    JSONTokener x(protobuf_debug_string.data(), protobuf_debug_string.size());
-    parseObject(const_cast<JSONObject*>(this), &x);
-    return x.GetCurrentPosition();
-}
-#endif
 
 }
 }
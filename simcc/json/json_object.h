@@ -74,9 +74,14 @@ public:
     // Save, Serialize. save the json object in the data stream
     SIMCC_EXPORT friend simcc::DataStream& operator << (simcc::DataStream& file, const JSONObject& val);
 
-#ifdef H_PROVIDE_PROTOBUF_DEBUGSTRING_2_JSON
+    // Construct a JSONObject from a protobuf text format string, which is
+    // the output of google::protobuf::Message::DebugString() or ShortDebugString().
+    // A repeated field is converted to a JSONArray.
+    // @see ProtobufTokener
+    // @param source_len, the length of the source string.
+    // @return number of characters parsed. Return 0 if failed to parse.
     simcc::uint32 ParseProtobuf(const string& protobuf_debug_string);
-#endif
+    simcc::uint32 ParseProtobuf(const char* source, size_t source_len);
 
 public:
     // Try to convert a string into a number, boolean, or null. If the string
@@ -27,8 +27,8 @@ void JSONParser::set_error(ErrorCode ec, size_t location) {
     error_location_ = location;
 }
 
-const char* JSONParser::strerror() const {
-    H_CASE_STRING_BIGIN(error());
+const char* JSONParser::strerror(ErrorCode ec) {
+    H_CASE_STRING_BIGIN(ec);
     H_CASE_STRING(kNoError);
     H_CASE_STRING(kParameterWrong);
     H_CASE_STRING(kCommentFormatError);
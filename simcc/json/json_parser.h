@@ -42,7 +42,11 @@ public:
         return error_code_;
     }
 
-    const char* strerror() const;
+    const char* strerror() const {
+        return strerror(error());
+    }
+
+    static const char* strerror(ErrorCode ec);
 
     bool ok() const {
         return error() == kNoError;
@@ -0,0 +1,405 @@
+#include "simcc/inner_pre.h"
+
+#include "json.h"
+#include "json_patch.h"
+
+namespace simcc {
+namespace json {
+
+namespace {
+JSONObject* NewOperation(const char* op, const string& path, const Object* value) {
+    JSONObject* jo = new JSONObject;
+    jo->Put("op", op);
+    jo->Put("path", path);
+    if (value) {
+        jo->Put("value", const_cast<Object*>(value));
+    }
+    return jo;
+}
+
+void DiffValue(const Object* from, const Object* to, string& path, JSONArray* patch);
+
+void DiffObject(const JSONObject* from, const JSONObject* to, string& path, JSONArray* patch) {
+    size_t len = path.size();
+    JSONObject::const_iterator fit = from->begin();
+    JSONObject::const_iterator fend = from->end();
+    JSONObject::const_iterator tit = to->begin();
+    JSONObject::const_iterator tend = to->end();
+
+    // Both of the maps are sorted by key, so we walk them side by side
+    while (fit != fend || tit != tend) {
+        int cmp = 0;
+        if (fit == fend) {
+            cmp = 1;
+        } else if (tit == tend) {
+            cmp = -1;
+        } else {
+            cmp = fit->first.compare(tit->first);
+        }
+
+        if (cmp < 0) {
+            JSONPatch::AppendPointerToken(fit->first, path);
+            patch->Put(NewOperation("remove", path, NULL));
+            ++fit;
+        } else if (cmp > 0) {
+            JSONPatch::AppendPointerToken(tit->first, path);
+            patch->Put(NewOperation("add", path, tit->second.get()));
+            ++tit;
+        } else {
+            JSONPatch::AppendPointerToken(fit->first, path);
+            DiffValue(fit->second.get(), tit->second.get(), path, patch);
+            ++fit;
+            ++tit;
+        }
+
+        path.resize(len);
+    }
+}
+
+void DiffArray(const JSONArray* from, const JSONArray* to, string& path, JSONArray* patch) {
+    size_t len = path.size();
+    JSONArray::const_iterator fit = from->begin();
+    JSONArray::const_iterator tit = to->begin();
+    size_t index = 0;
+    for (; fit != from->end() && tit != to->end(); ++fit, ++tit, ++index) {
+        path.append(1, '/');
+        path.append(std::to_string(index));
+        DiffValue(fit->get(), tit->get(), path, patch);
+        path.resize(len);
+    }
+
+    for (; tit != to->end(); ++tit, ++index) {
+        path.append(1, '/');
+        path.append(std::to_string(index));
+        patch->Put(NewOperation("add", path, tit->get()));
+        path.resize(len);
+    }
+
+    // Remove the extra elements from the tail, so the indexes are still valid
+    for (size_t i = from->size(); i > index; --i) {
+        path.append(1, '/');
+        path.append(std::to_string(i - 1));
+        patch->Put(NewOperation("remove", path, NULL));
+        path.resize(len);
+    }
+}
+
+void DiffValue(const Object* from, const Object* to, string& path, JSONArray* patch) {
+    if (from == to) {
+        return;
+    }
+
+    if (from->type() != to->type()) {
+        patch->Put(NewOperation("replace", path, to));
+        return;
+    }
+
+    switch (from->type()) {
+    case kJSONObject:
+        DiffObject(cast<JSONObject>(from), cast<JSONObject>(to), path, patch);
+        break;
+    case kJSONArray:
+        DiffArray(cast<JSONArray>(from), cast<JSONArray>(to), path, patch);
+        break;
+    default:
+        if (!const_cast<Object*>(from)->Equals(*to)) {
+            patch->Put(NewOperation("replace", path, to));
+        }
+        break;
+    }
+}
+
+// An array index is "0" or digits without leading zeros
+bool ParseIndex(const string& token, size_t& index) {
+    if (token.empty() || token.size() > 9 || (token[0] == '0' && token.size() > 1)) {
+        return false;
+    }
+
+    index = 0;
+    for (size_t i = 0; i < token.size(); ++i) {
+        if (token[i] < '0' || token[i] > '9') {
+            return false;
+        }
+        index = index * 10 + (token[i] - '0');
+    }
+
+    return true;
+}
+
+// Resolve the first count tokens of a pointer
+// @return the referenced value, or NULL if it does not exist
+Object* Resolve(Object* root, const std::vector<string>& tokens, size_t count) {
+    Object* o = root;
+    for (size_t i = 0; i < count && o; ++i) {
+        if (JSONObject* jo = cast<JSONObject>(o)) {
+            o = jo->Get(tokens[i]);
+        } else if (JSONArray* ja = cast<JSONArray>(o)) {
+            size_t index = 0;
+            if (!ParseIndex(tokens[i], index) || index >= ja->size()) {
+                return NULL;
+            }
+            o = ja->Get(static_cast<int>(index));
+        } else {
+            return NULL;
+        }
+    }
+
+    return o;
+}
+
+bool AddValue(ObjectPtr& doc, const std::vector<string>& tokens, const ObjectPtr& value) {
+    if (tokens.empty()) {
+        doc = value;
+        return true;
+    }
+
+    Object* parent = Resolve(doc.get(), tokens, tokens.size() - 1);
+    const string& last = tokens.back();
+    if (JSONObject* jo = cast<JSONObject>(parent)) {
+        return jo->Put(last, value);
+    }
+
+    if (JSONArray* ja = cast<JSONArray>(parent)) {
+        if (last == "-") {
+            ja->Put(value);
+            return true;
+        }
+
+        size_t index = 0;
+        return ParseIndex(last, index) && ja->Insert(static_cast<int>(index), value);
+    }
+
+    return false;
+}
+
+bool RemoveValue(ObjectPtr& doc, const std::vector<string>& tokens, ObjectPtr* removed) {
+    if (tokens.empty()) {
+        return false;
+    }
+
+    Object* parent = Resolve(doc.get(), tokens, tokens.size() - 1);
+    const string& last = tokens.back();
+    if (JSONObject* jo = cast<JSONObject>(parent)) {
+        JSONObject::iterator it = jo->GetObjects().find(last);
+        if (it == jo->end()) {
+            return false;
+        }
+
+        if (removed) {
+            *removed = it->second;
+        }
+        jo->erase(it);
+        return true;
+    }
+
+    if (JSONArray* ja = cast<JSONArray>(parent)) {
+        size_t index = 0;
+        if (!ParseIndex(last, index) || index >= ja->size()) {
+            return false;
+        }
+
+        if (removed) {
+            *removed = ja->Get(static_cast<int>(index));
+        }
+        return ja->Remove(static_cast<int>(index));
+    }
+
+    return false;
+}
+
+bool ReplaceValue(ObjectPtr& doc, const std::vector<string>& tokens, const ObjectPtr& value) {
+    if (tokens.empty()) {
+        doc = value;
+        return true;
+    }
+
+    Object* parent = Resolve(doc.get(), tokens, tokens.size() - 1);
+    const string& last = tokens.back();
+    if (JSONObject* jo = cast<JSONObject>(parent)) {
+        if (!jo->Get(last)) {
+            return false;
+        }
+        return jo->Put(last, value);
+    }
+
+    if (JSONArray* ja = cast<JSONArray>(parent)) {
+        size_t index = 0;
+        return ParseIndex(last, index) && ja->Set(static_cast<int>(index), value);
+    }
+
+    return false;
+}
+
+// Whether the pointer a is a proper prefix of b
+bool IsProperPrefix(const std::vector<string>& a, const std::vector<string>& b) {
+    return a.size() < b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+bool ApplyOperation(const JSONObject* op, ObjectPtr& doc) {
+    const string& name = op->GetString("op");
+    std::vector<string> path;
+    JSONString* jpath = op->GetJSONString("path");
+    if (!jpath || !JSONPatch::ParsePointer(jpath->value(), path)) {
+        return false;
+    }
+
+    std::vector<string> from;
+    if (name == "move" || name == "copy") {
+        JSONString* jfrom = op->GetJSONString("from");
+        if (!jfrom || !JSONPatch::ParsePointer(jfrom->value(), from)) {
+            return false;
+        }
+    }
+
+    Object* value = op->Get("value");
+    if (name == "add") {
+        return value && AddValue(doc, path, JSONPatch::Clone(value));
+    } else if (name == "remove") {
+        return RemoveValue(doc, path, NULL);
+    } else if (name == "replace") {
+        return value && ReplaceValue(doc, path, JSONPatch::Clone(value));
+    } else if (name == "move") {
+        if (from == path) {
+            return Resolve(doc.get(), from, from.size()) != NULL;
+        }
+
+        // A value can't be moved into one of its children
+        ObjectPtr moved;
+        if (IsProperPrefix(from, path) || !RemoveValue(doc, from, &moved)) {
+            return false;
+        }
+        return AddValue(doc, path, moved);
+    } else if (name == "copy") {
+        Object* o = Resolve(doc.get(), from, from.size());
+        return o && AddValue(doc, path, JSONPatch::Clone(o));
+    } else if (name == "test") {
+        Object* o = Resolve(doc.get(), path, path.size());
+        return o && value && o->Equals(*value);
+    }
+
+    return false;
+}
+}
+
+JSONArrayPtr JSONPatch::Diff(const Object* from, const Object* to) {
+    JSONArrayPtr patch = new JSONArray;
+    if (!from || !to) {
+        if (to) {
+            patch->Put(NewOperation("add", "", to));
+        }
+        return patch;
+    }
+
+    string path;
+    DiffValue(from, to, path, patch.get());
+    return patch;
+}
+
+bool JSONPatch::Apply(const JSONArray& patch, ObjectPtr& doc, size_t* failed_index) {
+    size_t index = 0;
+    JSONArray::const_iterator it(patch.begin()), ite(patch.end());
+    for (; it != ite; ++it, ++index) {
+        const JSONObject* op = cast<JSONObject>(*it);
+        if (!op || !ApplyOperation(op, doc)) {
+            if (failed_index) {
+                *failed_index = index;
+            }
+            return false;
+        }
+    }
+
+    return true;
+}
+
+ObjectPtr JSONPatch::Clone(const Object* o) {
+    if (!o) {
+        return ObjectPtr();
+    }
+
+    switch (o->type()) {
+    case kJSONObject: {
+        const JSONObject* src = cast<JSONObject>(o);
+        JSONObject* jo = new JSONObject;
+        ObjectPtr result(jo);
+        JSONObject::ObjectPtrMap& m = jo->GetObjects();
+        for (JSONObject::const_iterator it = src->begin(); it != src->end(); ++it) {
+            // The source keys are sorted, so appending with the end hint is constant time
+            m.insert(m.end(), std::make_pair(it->first, Clone(it->second.get())));
+        }
+        return result;
+    }
+    case kJSONArray: {
+        const JSONArray* src = cast<JSONArray>(o);
+        JSONArray* ja = new JSONArray;
+        ObjectPtr result(ja);
+        for (JSONArray::const_iterator it = src->begin(); it != src->end(); ++it) {
+            ja->Put(Clone(it->get()));
+        }
+        return result;
+    }
+    case kJSONString:
+        return new JSONString(cast<JSONString>(o)->value());
+    case kJSONInteger:
+        return new JSONInteger(cast<JSONInteger>(o)->value());
+    case kJSONDouble:
+        return new JSONDouble(cast<JSONDouble>(o)->value());
+    case kJSONBoolean:
+        return new JSONBoolean(cast<JSONBoolean>(o)->value());
+    case kJSONNull:
+        return new JSONNull;
+    default:
+        return ObjectPtr();
+    }
+}
+
+bool JSONPatch::ParsePointer(const string& pointer, std::vector<string>& tokens) {
+    tokens.clear();
+    if (pointer.empty()) {
+        return true;
+    }
+
+    if (pointer[0] != '/') {
+        return false;
+    }
+
+    string token;
+    for (size_t i = 1; i <= pointer.size(); ++i) {
+        if (i == pointer.size() || pointer[i] == '/') {
+            tokens.push_back(token);
+            token.clear();
+            continue;
+        }
+
+        char c = pointer[i];
+        if (c == '~') {
+            char e = (i + 1 < pointer.size() ? pointer[++i] : 0);
+            if (e == '0') {
+                c = '~';
+            } else if (e == '1') {
+                c = '/';
+            } else {
+                return false;
+            }
+        }
+        token.append(1, c);
+    }
+
+    return true;
+}
+
+void JSONPatch::AppendPointerToken(const string& token, string& pointer) {
+    pointer.append(1, '/');
+    for (size_t i = 0; i < token.size(); ++i) {
+        char c = token[i];
+        if (c == '~') {
+            pointer.append("~0", 2);
+        } else if (c == '/') {
+            pointer.append("~1", 2);
+        } else {
+            pointer.append(1, c);
+        }
+    }
+}
+
+}
+}
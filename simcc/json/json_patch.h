@@ -0,0 +1,56 @@
+#pragma once
+
+#include "simcc/inner_pre.h"
+#include "json_common.h"
+#include "json_array.h"
+
+namespace simcc {
+namespace json {
+
+// JSON Patch (RFC 6902) support: compute the difference of two JSON documents
+// and apply it to another copy of the first one.
+//
+// Usage:
+//     json::JSONArrayPtr patch = json::JSONPatch::Diff(old_conf, new_conf);
+//     string s = patch->ToString(); // ship the patch instead of the document
+//
+//     // on the other side
+//     json::JSONArray patch;
+//     patch.Parse(s);
+//     json::ObjectPtr conf = ...;
+//     if (!json::JSONPatch::Apply(patch, conf)) {
+//         // ...
+//     }
+class SIMCC_EXPORT JSONPatch {
+public:
+    // Make a patch which transforms <code>from</code> into <code>to</code>.
+    // The members of two JSONObjects are compared in the sorted key order and
+    // the elements of two JSONArrays are compared by index, so it runs in
+    // linear time of the size of the documents. Only "add", "remove" and
+    // "replace" operations are generated.
+    // @note The values of the patch share the sub-objects of <code>to</code>.
+    // @return the patch, which is an empty JSONArray if the two documents are equal
+    static JSONArrayPtr Diff(const Object* from, const Object* to);
+
+    // Apply a patch to the document in place. All the six operations
+    // "add", "remove", "replace", "move", "copy" and "test" are supported.
+    // The values are copied into the document, so the patch can be reused.
+    // @param doc - The document, which is replaced if the root path "" is the target of an operation
+    // @param failed_index - [out] The index of the failed operation in the patch
+    // @return true if all the operations are applied successfully.
+    //     If an operation fails, the ones before it have been applied and
+    //     the rest are not, so keep a copy if you need to roll back.
+    static bool Apply(const JSONArray& patch, ObjectPtr& doc, size_t* failed_index = NULL);
+
+    // Deep copy a JSON value
+    static ObjectPtr Clone(const Object* o);
+
+    // Convert between a JSON Pointer (RFC 6901) and its reference tokens.
+    //   e.g. "/a~1b/0" <==> ["a/b", "0"]
+    // @return false if the pointer is not empty and does not start with '/'
+    static bool ParsePointer(const string& pointer, std::vector<string>& tokens);
+    static void AppendPointerToken(const string& token, string& pointer);
+};
+
+}
+}
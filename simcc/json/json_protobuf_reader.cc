@@ -0,0 +1,179 @@
+#include "simcc/inner_pre.h"
+
+#include "json.h"
+#include "json_protobuf_reader.h"
+
+namespace simcc {
+namespace json {
+
+namespace {
+inline bool IsBlankLine(const char* line, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        if (line[i] != ' ' && line[i] != '\t') {
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+ProtobufDebugStringReader::ProtobufDebugStringReader(RecordSeparator sep)
+    : sep_(sep)
+    , fp_(NULL)
+    , pos_(0)
+    , eof_(false)
+    , record_count_(0) {
+}
+
+ProtobufDebugStringReader::~ProtobufDebugStringReader() {
+    Close();
+}
+
+bool ProtobufDebugStringReader::Open(const string& filename) {
+    Close();
+
+#ifdef H_OS_WINDOWS
+    const char* mode = "rb";
+#else
+    const char* mode = "r";
+#endif
+
+    fp_ = fopen(filename.c_str(), mode);
+    if (!fp_) {
+        set_error(kParameterWrong);
+        return false;
+    }
+
+    set_error(kNoError);
+    return true;
+}
+
+void ProtobufDebugStringReader::Close() {
+    if (fp_) {
+        fclose(fp_);
+        fp_ = NULL;
+    }
+
+    buf_.clear();
+    pos_ = 0;
+    eof_ = false;
+    record_count_ = 0;
+}
+
+bool ProtobufDebugStringReader::Next(JSONObjectPtr& record) {
+    if (!fp_) {
+        set_error(kParameterWrong);
+        return false;
+    }
+
+    set_error(kNoError);
+    record_.clear();
+
+    const char* line = NULL;
+    size_t len = 0;
+    const char* data = NULL;
+    size_t data_len = 0;
+    while (NextLine(line, len)) {
+        bool blank = IsBlankLine(line, len);
+        if (sep_ == kNewLine) {
+            if (blank) {
+                continue;
+            }
+
+            // The line is valid until the next call of NextLine, so we parse it without copying
+            data = line;
+            data_len = len;
+            break;
+        }
+
+        if (blank) {
+            if (record_.empty()) {
+                continue;
+            }
+            break;
+        }
+
+        record_.append(line, len);
+        record_.push_back('\n');
+    }
+
+    if (!data) {
+        data = record_.data();
+        data_len = record_.size();
+    }
+
+    if (data_len == 0) {
+        // arrived end of file
+        return false;
+    }
+
+    ++record_count_;
+    JSONObjectPtr jo = new JSONObject;
+    jo->ParseProtobuf(data, data_len);
+    if (!jo->ok()) {
+        set_error(jo->error(), jo->error_location());
+        return false;
+    }
+
+    record = jo;
+    return true;
+}
+
+bool ProtobufDebugStringReader::NextLine(const char*& line, size_t& len) {
+    for (;;) {
+        const char* begin = buf_.data() + pos_;
+        size_t readable = buf_.size() - pos_;
+        const char* eol = static_cast<const char*>(memchr(begin, '\n', readable));
+        if (eol) {
+            line = begin;
+            len = eol - begin;
+            pos_ += len + 1;
+            break;
+        }
+
+        if (!Fill()) {
+            // The last line which has no '\n' ending
+            if (pos_ == buf_.size()) {
+                return false;
+            }
+
+            line = buf_.data() + pos_;
+            len = buf_.size() - pos_;
+            pos_ = buf_.size();
+            break;
+        }
+    }
+
+    // Windows line ending char is 0x0D0A
+    if (len > 0 && line[len - 1] == '\r') {
+        --len;
+    }
+
+    return true;
+}
+
+bool ProtobufDebugStringReader::Fill() {
+    if (eof_) {
+        return false;
+    }
+
+    // drop the consumed data
+    if (pos_ > 0) {
+        buf_.erase(0, pos_);
+        pos_ = 0;
+    }
+
+    size_t old_size = buf_.size();
+    buf_.resize(old_size + kReadBufferSize);
+    size_t n = fread(&buf_[old_size], 1, kReadBufferSize, fp_);
+    buf_.resize(old_size + n);
+    if (n == 0) {
+        eof_ = true;
+        return false;
+    }
+
+    return true;
+}
+
+}
+}
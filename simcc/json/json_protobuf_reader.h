@@ -0,0 +1,78 @@
+#pragma once
+
+#include "simcc/inner_pre.h"
+#include "json_common.h"
+#include "json_parser.h"
+#include "json_object.h"
+
+#include <stdio.h>
+
+namespace simcc {
+namespace json {
+
+// Read a file of protobuf text format dumps record by record and convert
+// every record to a JSONObject. Only one read buffer is kept in memory, so
+// a dump file of any size can be processed.
+//
+// Usage:
+//     json::ProtobufDebugStringReader reader;
+//     if (reader.Open("dump.txt")) {
+//         json::JSONObjectPtr record;
+//         while (reader.Next(record)) {
+//             // ...
+//         }
+//         if (!reader.ok()) {
+//             // reader.strerror(), reader.record_count()
+//         }
+//     }
+class SIMCC_EXPORT ProtobufDebugStringReader : public JSONParser {
+public:
+    enum RecordSeparator {
+        kBlankLine = 0, // The records are the output of DebugString() and separated by blank lines
+        kNewLine,       // Every line is a record which is the output of ShortDebugString()
+    };
+
+    ProtobufDebugStringReader(RecordSeparator sep = kBlankLine);
+    ~ProtobufDebugStringReader();
+
+    bool Open(const string& filename);
+    void Close();
+
+    // Read and parse the next record
+    // @param[out] record - the parsed record
+    // @return true if a record is read successfully,
+    //     or false if it arrives at the end of the file or an error happened,
+    //     which you can use ok() or error() to distinguish. The error_location()
+    //     is the offset in the failed record.
+    bool Next(JSONObjectPtr& record);
+
+    // The count of records which have been read, including the failed one
+    size_t record_count() const {
+        return record_count_;
+    }
+
+private:
+    // Get the next line without the line ending characters
+    // @return false if arrived end of file.
+    bool NextLine(const char*& line, size_t& len);
+
+    // Read more data from the file to the buffer
+    bool Fill();
+
+private:
+    enum { kReadBufferSize = 64 * 1024 };
+    RecordSeparator sep_;
+    FILE* fp_;
+    string buf_;   // The read buffer
+    size_t pos_;   // The read position of buf_
+    bool eof_;
+    string record_;
+    size_t record_count_;
+
+private:
+    ProtobufDebugStringReader(const ProtobufDebugStringReader&);
+    ProtobufDebugStringReader& operator=(const ProtobufDebugStringReader&);
+};
+
+}
+}
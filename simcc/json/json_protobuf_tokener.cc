@@ -0,0 +1,440 @@
+#include "simcc/inner_pre.h"
+
+#include "json.h"
+#include "json_tokener.h"
+#include "json_protobuf_tokener.h"
+#include "json_utf8_inl.h"
+
+#include <errno.h>
+
+namespace simcc {
+namespace json {
+
+namespace {
+// The static table of the characters which can be a part of a field name or
+// an unquoted scalar value : [A-Za-z0-9_.+-]
+static const char kTokenChars[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 1, 0,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1,
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+inline bool IsTokenChar(char c) {
+    return kTokenChars[(unsigned char)c] != 0;
+}
+
+// Append value to the field <code>key</code> of jo.
+// The first value is stored directly, the following values of the same key
+// turn the field into a JSONArray (a repeated field).
+void PutField(JSONObject* jo, const string& key, Object* value) {
+    ObjectPtr& slot = jo->GetObjects()[key];
+    if (!slot) {
+        slot = value;
+        return;
+    }
+
+    if (slot->IsTypeOf(kJSONArray)) {
+        static_cast<JSONArray*>(slot.get())->Put(value);
+        return;
+    }
+
+    JSONArray* ja = new JSONArray;
+    ja->Put(slot);
+    ja->Put(value);
+    slot = ja;
+}
+
+// Append all the elements of a list syntax value to the field <code>key</code> of jo.
+void PutList(JSONObject* jo, const string& key, const JSONArrayPtr& list) {
+    ObjectPtr& slot = jo->GetObjects()[key];
+    if (!slot) {
+        slot = list.get();
+        return;
+    }
+
+    for (auto it = list->begin(); it != list->end(); ++it) {
+        PutField(jo, key, it->get());
+    }
+}
+}
+
+ProtobufTokener::ProtobufTokener(const char* ps, size_t ps_len)
+    : data_(ps)
+    , current_(ps)
+    , end_(ps + ps_len)
+    , error_code_(JSONParser::kNoError)
+    , error_location_(0) {
+}
+
+bool ProtobufTokener::Parse(JSONObject* jo) {
+    return ParseFields(jo, 0);
+}
+
+bool ProtobufTokener::SetError(JSONParser::ErrorCode ec) {
+    error_code_ = ec;
+    error_location_ = GetCurrentPosition();
+    return false;
+}
+
+void ProtobufTokener::SkipSpaces() {
+    while (current_ < end_) {
+        char c = *current_;
+        if (c == '#') {
+            // a comment line
+            const char* eol = static_cast<const char*>(memchr(current_, '\n', end_ - current_));
+            current_ = eol ? eol + 1 : end_;
+        } else if (c > ' ' || c < 0) {
+            return;
+        } else {
+            ++current_;
+        }
+    }
+}
+
+bool ProtobufTokener::ParseFields(JSONObject* jo, char close) {
+    string key;
+    for (;;) {
+        SkipSpaces();
+        if (current_ >= end_ || *current_ == '\0') {
+            if (close) {
+                return SetError(JSONParser::kJSONObjectNotEndWithBraces);
+            }
+            return true;
+        }
+
+        char c = *current_;
+        if (c == close) {
+            ++current_;
+            return true;
+        }
+
+        if (c == ',' || c == ';') {
+            // an optional field separator
+            ++current_;
+            continue;
+        }
+
+        if (!NextKey(key)) {
+            return false;
+        }
+
+        SkipSpaces();
+        bool has_colon = false;
+        if (current_ < end_ && *current_ == ':') {
+            has_colon = true;
+            ++current_;
+            SkipSpaces();
+        }
+
+        if (current_ >= end_) {
+            return SetError(JSONParser::kBlankValue);
+        }
+
+        c = *current_;
+        if (c == '[') {
+            if (!has_colon) {
+                return SetError(JSONParser::kKeyValueSeperatorError);
+            }
+
+            ++current_;
+            JSONArrayPtr ja = new JSONArray;
+            if (!ParseList(ja.get())) {
+                return false;
+            }
+            PutList(jo, key, ja);
+            continue;
+        }
+
+        if (!has_colon && c != '{' && c != '<') {
+            // The colon is optional only for a message field
+            return SetError(JSONParser::kKeyValueSeperatorError);
+        }
+
+        Object* value = NextValue();
+        if (!value) {
+            return false;
+        }
+        PutField(jo, key, value);
+    }
+}
+
+bool ProtobufTokener::ParseList(JSONArray* ja) {
+    SkipSpaces();
+    if (current_ < end_ && *current_ == ']') {
+        ++current_;
+        return true;
+    }
+
+    for (;;) {
+        SkipSpaces();
+        if (current_ >= end_) {
+            return SetError(JSONParser::kBlankValue);
+        }
+
+        Object* value = NextValue();
+        if (!value) {
+            return false;
+        }
+        ja->Put(value);
+
+        SkipSpaces();
+        if (current_ >= end_) {
+            return SetError(JSONParser::kJSONArrayNotEndWithBrackets);
+        }
+
+        char c = *current_++;
+        if (c == ']') {
+            return true;
+        }
+
+        if (c != ',') {
+            --current_;
+            return SetError(JSONParser::kJSONArrayNotEndWithBrackets);
+        }
+    }
+}
+
+bool ProtobufTokener::NextKey(string& key) {
+    const char* start = current_;
+    if (*current_ == '[') {
+        // extension or Any type url, e.g. [foo.bar.ext] or [type.googleapis.com/foo.Bar]
+        const char* close = static_cast<const char*>(memchr(current_, ']', end_ - current_));
+        if (!close) {
+            return SetError(JSONParser::kJSONObjectKeyNotString);
+        }
+        current_ = close + 1;
+    } else {
+        while (current_ < end_ && IsTokenChar(*current_)) {
+            ++current_;
+        }
+    }
+
+    if (current_ == start) {
+        return SetError(JSONParser::kJSONObjectKeyIsEmpty);
+    }
+
+    key.assign(start, current_ - start);
+    return true;
+}
+
+Object* ProtobufTokener::NextValue() {
+    char c = *current_;
+    switch (c) {
+    case '{':
+    case '<': {
+        ++current_;
+        JSONObject* jo = new JSONObject;
+        if (!ParseFields(jo, c == '{' ? '}' : '>')) {
+            delete jo;
+            return NULL;
+        }
+        return jo;
+    }
+    case '"':
+    case '\'': {
+        JSONString* js = new JSONString;
+        if (!NextString(js->value())) {
+            delete js;
+            return NULL;
+        }
+        return js;
+    }
+    default:
+        return NextScalar();
+    }
+}
+
+bool ProtobufTokener::NextString(string& rs) {
+    rs.clear();
+    while (current_ < end_ && (*current_ == '"' || *current_ == '\'')) {
+        const char quote = *current_++;
+        for (;;) {
+            // copy the run of plain characters at one time
+            const char* p = current_;
+            while (p < end_ && *p != quote && *p != '\\' && *p != '\n') {
+                ++p;
+            }
+            rs.append(current_, p - current_);
+            current_ = p;
+
+            if (p >= end_ || *p == '\n') {
+                SetError(JSONParser::kJSONStringNotQuoted);
+                return false;
+            }
+
+            ++current_;
+            if (*p == quote) {
+                break;
+            }
+
+            // Escape character
+            if (current_ >= end_) {
+                SetError(JSONParser::kJSONStringNotQuoted);
+                return false;
+            }
+
+            char c = *current_++;
+            switch (c) {
+            case 'n': rs.push_back('\n'); break;
+            case 't': rs.push_back('\t'); break;
+            case 'r': rs.push_back('\r'); break;
+            case 'a': rs.push_back('\a'); break;
+            case 'b': rs.push_back('\b'); break;
+            case 'f': rs.push_back('\f'); break;
+            case 'v': rs.push_back('\v'); break;
+            case '\\':
+            case '\'':
+            case '"':
+            case '?':
+                rs.push_back(c);
+                break;
+            case 'x': {
+                // e.g. \xe6 is a byte
+                int value = 0;
+                int digits = 0;
+                for (; digits < 2 && current_ < end_; ++digits) {
+                    int h = JSONTokener::DehexChar(*current_);
+                    if (h < 0) {
+                        break;
+                    }
+                    value = (value << 4) + h;
+                    ++current_;
+                }
+                if (digits == 0) {
+                    SetError(JSONParser::kInvalidHexadecimalCharacter);
+                    return false;
+                }
+                rs.push_back(static_cast<char>(value));
+                break;
+            }
+            case 'u': {
+                // e.g. \u1524 is a unicode character
+                if (end_ - current_ < 4) {
+                    SetError(JSONParser::kInvalidHexadecimalCharacter);
+                    return false;
+                }
+                int32_t unicode = 0;
+                for (int i = 0; i < 4; ++i) {
+                    int h = JSONTokener::DehexChar(*current_++);
+                    if (h < 0) {
+                        SetError(JSONParser::kInvalidHexadecimalCharacter);
+                        return false;
+                    }
+                    unicode = (unicode << 4) + h;
+                }
+                char utf8[4];
+                int size = 0;
+                if (utf8_encode(unicode, utf8, &size) != 0) {
+                    SetError(JSONParser::kInvalidHexadecimalCharacter);
+                    return false;
+                }
+                rs.append(utf8, size);
+                break;
+            }
+            default:
+                if (c >= '0' && c <= '7') {
+                    // e.g. "\346\226\260" is an octal escaped UTF-8 string
+                    int value = c - '0';
+                    for (int digits = 1; digits < 3 && current_ < end_ && *current_ >= '0' && *current_ <= '7'; ++digits) {
+                        value = (value << 3) + (*current_++ - '0');
+                    }
+                    rs.push_back(static_cast<char>(value));
+                    break;
+                }
+
+                --current_;
+                SetError(JSONParser::kInvalidOctalCharacter);
+                return false;
+            }
+        }
+
+        // Adjacent string literals are concatenated
+        SkipSpaces();
+    }
+
+    return true;
+}
+
+Object* ProtobufTokener::NextScalar() {
+    const char* start = current_;
+    while (current_ < end_ && IsTokenChar(*current_)) {
+        ++current_;
+    }
+
+    size_t len = current_ - start;
+    if (len == 0) {
+        SetError(JSONParser::kInvalidCharacter);
+        return NULL;
+    }
+
+    char b = start[0];
+    if (b != '-' && b != '+' && b != '.' && (b < '0' || b > '9')) {
+        if ((len == 4 && (strncmp(start, "true", 4) == 0 || strncmp(start, "True", 4) == 0))) {
+            return new JSONBoolean(true);
+        }
+
+        if ((len == 5 && (strncmp(start, "false", 5) == 0 || strncmp(start, "False", 5) == 0))) {
+            return new JSONBoolean(false);
+        }
+
+        // inf, nan
+        if ((len == 3 && (strncmp(start, "inf", 3) == 0 || strncmp(start, "nan", 3) == 0))) {
+            return new JSONDouble(std::atof(string(start, len).c_str()));
+        }
+
+        // An enum value identifier
+        return new JSONString(string(start, len));
+    }
+
+    // The token is not NUL-terminated in the source string
+    enum { kMaxNumberLen = 64 };
+    if (len >= kMaxNumberLen) {
+        SetError(JSONParser::kInvalidIntegerOrDoubleString);
+        return NULL;
+    }
+
+    char number[kMaxNumberLen];
+    memcpy(number, start, len);
+    number[len] = '\0';
+
+    char* endptr = NULL;
+    errno = 0;
+    simcc::int64 i = strtoll(number, &endptr, 0);
+    if (endptr == number + len) {
+        if (errno == ERANGE) {
+            // Keep the literal of an uint64 which is out of the range of int64
+            return new JSONString(string(number, len));
+        }
+        return new JSONInteger(i);
+    }
+
+    // A float value may be written with a 'f' suffix, e.g. 1.5f
+    if (number[len - 1] == 'f' || number[len - 1] == 'F') {
+        number[--len] = '\0';
+    }
+
+    simcc::float64 d = strtod(number, &endptr);
+    if (len > 0 && endptr == number + len) {
+        return new JSONDouble(d);
+    }
+
+    current_ = start;
+    SetError(JSONParser::kInvalidIntegerOrDoubleString);
+    return NULL;
+}
+
+}
+}
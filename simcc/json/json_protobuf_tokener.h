@@ -0,0 +1,80 @@
+#pragma once
+#include "simcc/inner_pre.h"
+#include "json.h"
+
+namespace simcc {
+namespace json {
+
+// A ProtobufTokener takes a protobuf text format string, which is the output of
+// google::protobuf::Message::DebugString() or ShortDebugString(), and converts
+// it into JSON objects.
+//
+// Unlike JSONTokener, it works on raw pointers and scans string and token runs
+// in bulk, so there is no per-character end-of-buffer check or flag branch.
+//
+// The mapping rules:
+//   1. A message field (<code>name { ... }</code> or <code>name < ... ></code>) is a JSONObject
+//   2. A repeated field, written either as several <code>name: value</code> lines
+//      or as the list syntax <code>name: [v1, v2]</code>, is a JSONArray
+//   3. Integers, floating numbers and true/false are JSONInteger, JSONDouble, JSONBoolean
+//   4. Quoted strings (with C-style and octal escapes decoded) and enum identifiers are JSONString
+class ProtobufTokener {
+public:
+    // @param ps     A protobuf text format string.
+    // @param ps_len The length of the source string
+    ProtobufTokener(const char* ps, size_t ps_len);
+
+    // Parse all the fields of a message into jo until the end of the source string.
+    // @return true, if no error happened
+    bool Parse(JSONObject* jo);
+
+    JSONParser::ErrorCode error() const {
+        return error_code_;
+    }
+
+    // The offset of the source string where the error happened
+    size_t error_location() const {
+        return error_location_;
+    }
+
+    // Gets current read position in the buffer. It also serve as length of buffer parsed.
+    size_t GetCurrentPosition() const {
+        return current_ - data_;
+    }
+
+private:
+    // Parse fields until <code>close</code> character, or the end of the source string if close is 0
+    bool ParseFields(JSONObject* jo, char close);
+
+    // Parse the list syntax of a repeated field : [v1, v2, ...]
+    bool ParseList(JSONArray* ja);
+
+    // Get the next field name. An extension field name is written as [package.name]
+    bool NextKey(string& key);
+
+    // Get the next value which can be a message, a quoted string or a scalar token
+    Object* NextValue();
+
+    // Get the characters up to the next close quote character.
+    // Adjacent quoted strings are concatenated, e.g. "ab" 'cd' --> "abcd"
+    bool NextString(string& rs);
+
+    // Convert an unquoted token to a number, a boolean or an enum identifier
+    Object* NextScalar();
+
+    // Skip all whitespace and '#' comments
+    void SkipSpaces();
+
+    bool SetError(JSONParser::ErrorCode ec);
+
+private:
+    const char* data_;    // the source text string to be parsed
+    const char* current_; // the current read position
+    const char* end_;     // Not include the byte which is pointed by end_
+
+    JSONParser::ErrorCode error_code_;
+    size_t error_location_;
+};
+
+}
+}
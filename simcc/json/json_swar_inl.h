@@ -0,0 +1,42 @@
+#pragma once
+
+// Helpers to test the 8 bytes of a word at a time (SIMD within a register).
+// They are used to skip the runs of plain characters when scanning or
+// quoting strings. Each function returns non-zero if any byte of v matches.
+
+namespace simcc {
+namespace json {
+namespace swar {
+
+const simcc::uint64 kOnes = 0x0101010101010101ULL;
+const simcc::uint64 kHighs = 0x8080808080808080ULL;
+
+inline simcc::uint64 Load(const char* p) {
+    simcc::uint64 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Any byte is zero
+inline simcc::uint64 HasZeroByte(simcc::uint64 v) {
+    return (v - kOnes) & ~v & kHighs;
+}
+
+// Any byte equals to c
+inline simcc::uint64 HasByte(simcc::uint64 v, char c) {
+    return HasZeroByte(v ^ (kOnes * static_cast<unsigned char>(c)));
+}
+
+// Any byte is less than n, which must be not greater than 128
+inline simcc::uint64 HasByteLessThan(simcc::uint64 v, unsigned char n) {
+    return (v - kOnes * n) & ~v & kHighs;
+}
+
+// Any byte is a non-ASCII byte
+inline simcc::uint64 HasNonASCIIByte(simcc::uint64 v) {
+    return v & kHighs;
+}
+
+}
+}
+}
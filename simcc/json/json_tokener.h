@@ -40,8 +40,6 @@ public:
     //   false, if Unterminated string.
     bool NextString(char quote, string& rs);
 
-    bool NextString(char quote, bool parse_protobuf, string& rs);
-
     // Get the next value. The value can be a Boolean, Double, Integer,
     // JSONArray, JSONObject, Long, or string, or the JSONObject.NULL object.
     // @return An object. or NULL if something wrong
@@ -94,7 +92,7 @@ inline JSONTokener::JSONTokener(const char* ps, const simcc::int32 len)
 inline JSONTokener::~JSONTokener() {
 }
 
-inline bool JSONTokener::NextString(char quote, bool parse_protobuf, string& rs) {
+inline bool JSONTokener::NextString(char quote, string& rs) {
     buf_.Reset();
 
 #define Z16 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0
@@ -132,14 +130,8 @@ inline bool JSONTokener::NextString(char quote, bool parse_protobuf, string& rs)
                     return false;
                 }
             } else {
-                if (parse_protobuf) {
-                    //TODO convert "\346\226\260\346\265\252\347\275\221" to a utf8 string
-                    buf_.Write('\\');
-                    buf_.Write(c);
-                } else {
-                    //fprintf( stderr, "Illegal escape.[%c]\n", c );
-                    return false;
-                }
+                //fprintf( stderr, "Illegal escape.[%c]\n", c );
+                return false;
             }
 #else
             switch (c) {
@@ -202,10 +194,6 @@ inline bool JSONTokener::NextString(char quote, bool parse_protobuf, string& rs)
     } // end of for ( ;; )
 }
 
-inline bool JSONTokener::NextString(char quote, string& rs) {
-    return NextString(quote, false, rs);
-}
-
 inline Object* JSONTokener::NextValue(JSONParser* parser) {
     if (!SkipComment()) {
         //printf("wrong format of comment");
@@ -0,0 +1,419 @@
+#include "simcc/inner_pre.h"
+
+#include "json.h"
+#include "json_validator.h"
+#include "json_utf8_inl.h"
+#include "json_swar_inl.h"
+#include "simcc/tokener.h"
+
+namespace simcc {
+namespace json {
+
+namespace {
+// The same table as JSONTokener::NextValue uses to accumulate an unquoted value.
+// All the characters except ",:]}/\\\"[{;=#", tab and control characters.
+static const char kTokenChars[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 1, 0, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1
+};
+
+// The escape characters accepted by JSONTokener::NextString, except 'u'
+inline bool IsSimpleEscape(char c) {
+    switch (c) {
+    case '"':
+    case '/':
+    case '\\':
+    case 'b':
+    case 'f':
+    case 'n':
+    case 'r':
+    case 't':
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Whitespace skipped by Tokener::NextClean : all the bytes in [1, 32]
+inline bool IsSpace(char c) {
+    return static_cast<unsigned char>(c - 1) < ' ';
+}
+
+// True if any byte of the 8 bytes at p needs a closer look in a string:
+// the close quote, a backslash, a '\0' and, when checking UTF-8, a non-ASCII byte.
+inline bool HasSpecialByte(const char* p, char quote, bool check_utf8) {
+    simcc::uint64 v = swar::Load(p);
+    simcc::uint64 r = swar::HasZeroByte(v) | swar::HasByte(v, quote) | swar::HasByte(v, '\\');
+    if (check_utf8) {
+        r |= swar::HasNonASCIIByte(v);
+    }
+    return r != 0;
+}
+
+inline bool IsHex4(const char* p) {
+    for (int i = 0; i < 4; ++i) {
+        if (Tokener::DehexChar(p[i]) == -1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline simcc::uint32 Hex4(const char* p) {
+    simcc::uint32 u = 0;
+    for (int i = 0; i < 4; ++i) {
+        u = (u << 4) + Tokener::DehexChar(p[i]);
+    }
+    return u;
+}
+}
+
+JSONValidator::JSONValidator(bool check_utf8)
+    : data_(NULL)
+    , current_(NULL)
+    , end_(NULL)
+    , check_utf8_(check_utf8)
+    , error_code_(JSONParser::kNoError)
+    , error_location_(0) {
+}
+
+bool JSONValidator::Validate(const char* source, size_t source_len) {
+    data_ = source;
+    current_ = source;
+    end_ = source + source_len;
+    error_code_ = JSONParser::kNoError;
+    error_location_ = 0;
+
+    if (!source || source_len == 0) {
+        return SetError(JSONParser::kParameterWrong, source);
+    }
+
+    char c = 0;
+    if (!NextClean(c)) {
+        return false;
+    }
+
+    if (c == '{') {
+        if (!ValidateObject()) {
+            return false;
+        }
+    } else if (c == '[' || c == '(') {
+        if (!ValidateArray()) {
+            return false;
+        }
+    } else {
+        return SetError(JSONParser::kJSONObjectNotBeginWithBraces, current_);
+    }
+
+    // Nothing but whitespace and comments is allowed after the top level value
+    if (!NextClean(c)) {
+        return false;
+    }
+
+    if (c != 0) {
+        return SetError(JSONParser::kInvalidCharacter, current_);
+    }
+
+    return true;
+}
+
+const char* JSONValidator::strerror() const {
+    return JSONParser::strerror(error_code_);
+}
+
+bool JSONValidator::ValidateObject() {
+    assert(*current_ == '{');
+    ++current_;
+
+    char c = 0;
+    for (;;) {
+        if (!NextClean(c)) {
+            return false;
+        }
+
+        switch (c) {
+        case 0:
+            return SetError(JSONParser::kJSONObjectNotEndWithBraces, current_);
+        case '}':
+            ++current_;
+            return true;
+        case '"': // a key must be a string
+            ++current_;
+            if (!SkipString('"', JSONParser::kJSONObjectKeyNotString)) {
+                return false;
+            }
+            break;
+        default:
+            return SetError(JSONParser::kInvalidCharacter, current_);
+        }
+
+        // The key is followed by ':'
+        if (!NextClean(c)) {
+            return false;
+        }
+
+        if (c != ':') {
+            return SetError(JSONParser::kKeyValueSeperatorError, current_);
+        }
+
+        ++current_;
+        if (!ValidateValue()) {
+            return false;
+        }
+
+        if (!NextClean(c)) {
+            return false;
+        }
+
+        // pairs are separated by ',' and a trailing ',' is allowed
+        switch (c) {
+        case ',':
+            ++current_;
+            break;
+        case '}':
+            ++current_;
+            return true;
+        default:
+            return SetError(JSONParser::kInvalidCharacter, current_);
+        }
+    }
+}
+
+bool JSONValidator::ValidateArray() {
+    char q = (*current_ == '[' ? ']' : ')');
+    ++current_;
+
+    char c = 0;
+    if (!NextClean(c)) {
+        return false;
+    }
+
+    if (c == q) {
+        ++current_;
+        return true;
+    }
+
+    for (;;) {
+        if (!NextClean(c)) {
+            return false;
+        }
+
+        // An empty element before ',' is a null value
+        if (c != ',' && !ValidateValue()) {
+            return false;
+        }
+
+        if (!NextClean(c)) {
+            return false;
+        }
+
+        if (c == ',' || c == ';') {
+            ++current_;
+            if (!NextClean(c)) {
+                return false;
+            }
+
+            if (c == q) {
+                ++current_;
+                return true;
+            }
+        } else if (c == q) {
+            ++current_;
+            return true;
+        } else {
+            return SetError(JSONParser::kJSONArrayNotEndWithBrackets, current_);
+        }
+    }
+}
+
+bool JSONValidator::ValidateValue() {
+    char c = 0;
+    if (!NextClean(c)) {
+        return false;
+    }
+
+    switch (c) {
+    case '"':
+    case '\'':
+        ++current_;
+        return SkipString(c, JSONParser::kJSONStringNotQuoted);
+    case '{':
+        return ValidateObject();
+    case '[':
+    case '(':
+        return ValidateArray();
+    default:
+        return SkipToken();
+    }
+}
+
+bool JSONValidator::SkipString(char quote, JSONParser::ErrorCode ec) {
+    const char* p = current_;
+    for (;;) {
+        // Skip 8 plain bytes at a time
+        while (end_ - p >= 8 && !HasSpecialByte(p, quote, check_utf8_)) {
+            p += 8;
+        }
+
+        if (p >= end_ || *p == '\0') {
+            // Unterminated string
+            return SetError(ec, p);
+        }
+
+        char c = *p;
+        if (c == quote) {
+            current_ = p + 1;
+            return true;
+        }
+
+        if (c == '\\') {
+            const char* escape = p++;
+            if (p < end_ && IsSimpleEscape(*p)) {
+                ++p;
+                continue;
+            }
+
+            // e.g. \u1524 is a unicode character
+            if (p >= end_ || *p != 'u' || end_ - p < 5 || !IsHex4(p + 1)) {
+                return SetError(ec, escape);
+            }
+
+            simcc::uint32 unicode = Hex4(p + 1);
+            p += 5;
+            if (unicode >= 0xD800 && unicode <= 0xDBFF) {
+                // surrogate pairs
+                if (end_ - p < 6 || p[0] != '\\' || p[1] != 'u' || !IsHex4(p + 2)) {
+                    return SetError(ec, escape);
+                }
+                p += 6;
+            }
+            continue;
+        }
+
+        if (check_utf8_ && static_cast<unsigned char>(c) >= 0x80) {
+            int count = utf8_check_first(c);
+            if (count == 0 || end_ - p < count || !utf8_check_full(p, count, NULL)) {
+                return SetError(JSONParser::kInvalidCharacter, p);
+            }
+            p += count;
+            continue;
+        }
+
+        ++p;
+    }
+}
+
+bool JSONValidator::SkipToken() {
+    const char* s = current_;
+    while (current_ < end_ && kTokenChars[static_cast<unsigned char>(*current_)]) {
+        ++current_;
+    }
+
+    size_t len = current_ - s;
+    if (len == 0) {
+        return SetError(JSONParser::kBlankValue, s);
+    }
+
+    // The same rules as JSONObject::ConvertToObject
+    if (len >= 4 && (memcmp(s, "null", 4) == 0 || memcmp(s, "true", 4) == 0)) {
+        return true;
+    }
+
+    if (len >= 5 && memcmp(s, "false", 5) == 0) {
+        return true;
+    }
+
+    char b = s[0];
+    if (b != '.' && b != '-' && b != '+' && (b < '0' || b > '9')) {
+        return SetError(JSONParser::kInvalidIntegerOrDoubleString, s);
+    }
+
+    if (b != '0') {
+        return true;
+    }
+
+    size_t i = 1;
+    if (len > 2 && (s[1] == 'x' || s[1] == 'X')) {
+        i = 2; // hexadecimal number
+    } else if (memchr(s, '.', len) || memchr(s, 'e', len) || memchr(s, 'E', len)) {
+        return true;
+    }
+
+    for (; i < len; ++i) {
+        if (Tokener::DehexChar(s[i]) == -1) {
+            return SetError(JSONParser::kInvalidHexadecimalCharacter, s + i);
+        }
+    }
+
+    return true;
+}
+
+bool JSONValidator::SkipSpaces() {
+    for (;;) {
+        while (current_ < end_ && IsSpace(*current_)) {
+            ++current_;
+        }
+
+        if (current_ >= end_ || *current_ != '/') {
+            return true;
+        }
+
+        const char* comment = current_;
+        const char* p = current_ + 1;
+        if (p < end_ && *p == '*') {
+            // c-style comment
+            for (++p;; ++p) {
+                p = static_cast<const char*>(memchr(p, '*', end_ - p));
+                if (!p || p + 1 >= end_) {
+                    return SetError(JSONParser::kCommentFormatError, comment);
+                }
+
+                if (p[1] == '/') {
+                    break;
+                }
+            }
+            current_ = p + 2;
+        } else if (p < end_ && *p == '/') {
+            // cpp-style comment must end with a new line
+            p = static_cast<const char*>(memchr(p, '\n', end_ - p));
+            if (!p) {
+                return SetError(JSONParser::kCommentFormatError, comment);
+            }
+            current_ = p + 1;
+        } else {
+            return SetError(JSONParser::kCommentFormatError, comment);
+        }
+    }
+}
+
+bool JSONValidator::NextClean(char& c) {
+    if (!SkipSpaces()) {
+        return false;
+    }
+
+    c = (current_ < end_ ? *current_ : 0);
+    return true;
+}
+
+bool JSONValidator::SetError(JSONParser::ErrorCode ec, const char* location) {
+    error_code_ = ec;
+    error_location_ = (location ? location - data_ : 0);
+    return false;
+}
+
+}
+}
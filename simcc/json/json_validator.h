@@ -0,0 +1,86 @@
+#pragma once
+#include "simcc/inner_pre.h"
+#include "json_parser.h"
+
+namespace simcc {
+namespace json {
+
+// A JSONValidator checks whether a JSON text can be parsed by
+// JSONObject::Parse / JSONArray::Parse without building any JSON object.
+// It accepts the same syntax as the parser (comments, single quoted strings,
+// ';' array separators, hex/octal numbers, ...) and reports the same
+// JSONParser::ErrorCode. It holds no buffer and never allocates memory.
+//
+// Besides the syntax, it also checks that the strings are well-formed UTF-8,
+// which the parser does not do. Turn it off if the texts may contain
+// other encodings, e.g. GBK.
+//
+// Usage:
+//     json::JSONValidator v;
+//     if (!v.Validate(body.data(), body.size())) {
+//         // v.strerror(), v.error_location()
+//     }
+class SIMCC_EXPORT JSONValidator {
+public:
+    JSONValidator(bool check_utf8 = true);
+
+    // Validate a JSON text which is a JSONObject or a JSONArray.
+    // Only whitespace and comments are allowed after the top level value.
+    // @return true, if the text is valid
+    bool Validate(const char* source, size_t source_len);
+    bool Validate(const string& source) {
+        return Validate(source.data(), source.size());
+    }
+
+    JSONParser::ErrorCode error() const {
+        return error_code_;
+    }
+
+    const char* strerror() const;
+
+    bool ok() const {
+        return error_code_ == JSONParser::kNoError;
+    }
+
+    // The offset of the character which caused the error, or source_len if
+    // the text ended too early. It is not always the same as
+    // JSONParser::error_location(), which is where the tokener stopped, often
+    // after the whole token being read, e.g. for {"a":tru} the validator
+    // reports 5, the start of tru, and the parser 7.
+    size_t error_location() const {
+        return error_location_;
+    }
+
+private:
+    bool ValidateObject();
+    bool ValidateArray();
+    bool ValidateValue();
+
+    // Skip the string body, the current_ is at the first character after the open quote
+    // @param ec The error code if the string is unterminated or has an illegal escape
+    bool SkipString(char quote, JSONParser::ErrorCode ec);
+
+    // Skip an unquoted token, e.g. true, false, null or a number
+    bool SkipToken();
+
+    // Skip all whitespace and c-style or cpp-style comments
+    bool SkipSpaces();
+
+    // Skip whitespace and comments and then peek the next character without
+    // consuming it. c is 0 if arrived the end.
+    bool NextClean(char& c);
+
+    bool SetError(JSONParser::ErrorCode ec, const char* location);
+
+private:
+    const char* data_;    // the source text string to be validated
+    const char* current_; // the current read position
+    const char* end_;     // Not include the byte which is pointed by end_
+    bool check_utf8_;
+
+    JSONParser::ErrorCode error_code_;
+    size_t error_location_;
+};
+
+}
+}
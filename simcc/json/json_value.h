@@ -9,6 +9,86 @@
 namespace simcc {
 namespace json {
 
+// A per-thread cache of the freed memory blocks of one size.
+//
+// Scalar values are the majority of the nodes of a parsed JSON document and
+// every one of them is a small heap object. Recycling the blocks saves a
+// malloc/free pair per value when documents are parsed and released
+// over and over. A block freed by another thread goes to that thread's cache.
+// After the cache of a thread is destroyed at the thread exit or the program
+// exit, e.g. before a global JSONObjectPtr is released, the blocks go to the
+// global operators.
+template<size_t kBlockSize>
+class ValueFreeList {
+public:
+    static void* Allocate() {
+        if (destroyed()) {
+            return ::operator new(kBlockSize);
+        }
+        List& l = local();
+        if (l.head) {
+            Node* n = l.head;
+            l.head = n->next;
+            --l.count;
+            return n;
+        }
+        return ::operator new(kBlockSize);
+    }
+
+    static void Deallocate(void* p) {
+        if (destroyed()) {
+            ::operator delete(p);
+            return;
+        }
+        List& l = local();
+        if (l.count >= kMaxFreeBlocks) {
+            ::operator delete(p);
+            return;
+        }
+        Node* n = static_cast<Node*>(p);
+        n->next = l.head;
+        l.head = n;
+        ++l.count;
+    }
+
+    // The count of the cached blocks of the current thread
+    static size_t size() {
+        return destroyed() ? 0 : local().count;
+    }
+
+private:
+    enum { kMaxFreeBlocks = 4096 };
+
+    struct Node {
+        Node* next;
+    };
+
+    struct List {
+        Node* head;
+        size_t count;
+        List() : head(NULL), count(0) {}
+        ~List() {
+            destroyed() = true;
+            while (head) {
+                Node* n = head;
+                head = n->next;
+                ::operator delete(n);
+            }
+        }
+    };
+
+    static List& local() {
+        static thread_local List l;
+        return l;
+    }
+
+    // It has no destructor, so it is still valid after the List is destroyed
+    static bool& destroyed() {
+        static thread_local bool d = false;
+        return d;
+    }
+};
+
 template<class ValueType>
 class JSONValue : public Object {
 public:
@@ -38,6 +118,26 @@ public:
         return value_;
     }
 
+#ifndef H_OS_WINDOWS
+    // __declspec(thread) of MSVC does not support an object with a destructor,
+    // so the free list is only used on the other platforms.
+    // A subclass with extra members is bigger than the block and falls back to the global operators.
+    static void* operator new(size_t n) {
+        if (n == sizeof(JSONValue)) {
+            return ValueFreeList<sizeof(JSONValue)>::Allocate();
+        }
+        return ::operator new(n);
+    }
+
+    static void operator delete(void* p, size_t n) {
+        if (n == sizeof(JSONValue)) {
+            ValueFreeList<sizeof(JSONValue)>::Deallocate(p);
+            return;
+        }
+        ::operator delete(p);
+    }
+#endif
+
 protected:
     ValueType value_;
 };
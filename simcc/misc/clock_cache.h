@@ -0,0 +1,396 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "lru.h"
+
+namespace simcc {
+
+// @brief A cache with the CLOCK (second chance) eviction policy, whose reads
+// take no lock.
+//
+// A hit of LRUCacheH4 moves the item to the MRU end, so every reader needs the
+// exclusive lock. A hit of ClockCache only sets the reference bit of the item.
+// When the cache is full, the clock hand sweeps the items, clears the bits
+// it meets and evicts the first item which has not been referenced since the
+// last sweep.
+//
+// Find is lock-free: the items live in an open-addressing table of atomic
+// pointers and are immutable once inserted. Insert and Erase take a mutex.
+// A removed or replaced item is retired and only deleted when all the
+// readers which may have seen it are gone. A reader racing with a writer may
+// miss the key which is being moved, which is just a cache miss.
+//
+//     simcc::ClockCache<std::string, int> cache(10000, 0);
+//     cache.Insert("key", 1);
+//     int v = 0;
+//     if (cache.Find("key", &v)) {
+//         // ...
+//     }
+template<
+    class K,
+    class V,
+    class S = SizeofFunctor<V>,
+    class D = NonFunctor<V>,
+    class H = std::hash<K>>
+class ClockCache {
+public:
+    // @param size_t max_memery_size_bytes - 0 means no limit
+    ClockCache(size_t max_item_count, size_t max_memery_size_bytes,
+               S s = S(), D d = D(), H h = H());
+    ~ClockCache();
+
+    // @brief Copy the value of the key out and mark it referenced. It is lock-free.
+    // @return false if it is not found
+    bool Find(const K& key, V* value);
+
+    // @brief Insert or replace the value of the key. Some unreferenced items
+    //     are evicted if the cache is full.
+    void Insert(const K& key, const V& value);
+
+    // @return false if it is not found
+    bool Erase(const K& key);
+
+    // @brief Call f(const K&, const V&) for all the items in the slot order,
+    //     with the writers locked out
+    template<class F>
+    void ForEach(F f) const {
+        std::lock_guard<std::mutex> guard(mutex_);
+        for (size_t i = 0; i < slots_.size(); ++i) {
+            const Entry* e = slots_[i].load(std::memory_order_relaxed);
+            if (e) {
+                f(e->key, e->value);
+            }
+        }
+    }
+
+public:
+    size_t size() const {
+        std::lock_guard<std::mutex> guard(mutex_);
+        return size_;
+    }
+    size_t memory_size() const {
+        std::lock_guard<std::mutex> guard(mutex_);
+        return memory_size_;
+    }
+    size_t max_size() const {
+        return max_size_;
+    }
+    size_t max_memory_size() const {
+        return max_memory_size_;
+    }
+
+private:
+    struct Entry {
+        Entry(const K& k, const V& v, size_t h)
+            : key(k), value(v), hash(h), referenced(false), memory_size(0) {}
+
+        const K key;
+        V value;
+        const size_t hash;
+        std::atomic<bool> referenced; // set by the readers, cleared by the clock hand
+        size_t memory_size;
+    };
+
+    typedef std::atomic<Entry*> Slot;
+
+    // The readers count themselves in the counter of the current epoch parity.
+    // The counters are striped by the thread to keep the readers of different
+    // threads off the same cache line.
+    struct ReaderStripe {
+        ReaderStripe() {
+            count[0] = 0;
+            count[1] = 0;
+        }
+        std::atomic<long> count[2];
+        char padding[64];
+    };
+
+    enum {
+        kReaderStripeCount = 16,
+        kRetireBatchSize = 64,
+    };
+
+    class ReadGuard {
+    public:
+        ReadGuard(ClockCache* cache);
+        ~ReadGuard() {
+            counter_->fetch_sub(1, std::memory_order_release);
+        }
+    private:
+        std::atomic<long>* counter_;
+    };
+
+private:
+    size_t Hash(const K& key) const {
+        // std::hash of the integers is the identity, so mix the bits up
+        uint64_t h = hash_(key);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return size_t(h);
+    }
+
+    size_t ValueSize(const V& value) {
+        return sizeof_(value) + sizeof(Entry) - sizeof(value);
+    }
+
+    // The slot of the key, or the empty slot where it should be inserted
+    size_t Probe(const K& key, size_t hash) const;
+    void EvictOne();
+    void RemoveAt(size_t index);
+    void Retire(Entry* e);
+
+    // Wait until all the readers which may see the retired items are gone, and delete them
+    void Synchronize();
+
+private:
+    std::vector<Slot> slots_; // the number of the slots is a power of 2 and twice max_size_ at least
+    size_t mask_;
+    size_t hand_; // the clock hand
+
+    size_t max_size_;
+    size_t max_memory_size_;
+    size_t size_;
+    size_t memory_size_;
+
+    std::atomic<unsigned> epoch_;
+    ReaderStripe stripes_[kReaderStripeCount];
+    std::vector<Entry*> retired_;
+
+    mutable std::mutex mutex_; // the lock of the writers
+
+    S sizeof_;
+    D deleter_;
+    H hash_;
+
+private:
+    ClockCache(const ClockCache& rhs);
+    ClockCache& operator=(const ClockCache& rhs);
+};
+
+template<class K, class V, class S, class D, class H>
+ClockCache<K, V, S, D, H>::ReadGuard::ReadGuard(ClockCache* cache) {
+    size_t stripe = std::hash<std::thread::id>()(std::this_thread::get_id()) % kReaderStripeCount;
+    for (;;) {
+        unsigned epoch = cache->epoch_.load();
+        counter_ = &cache->stripes_[stripe].count[epoch & 1];
+        counter_->fetch_add(1);
+
+        // If the epoch is flipped meanwhile, the writer may not have seen us
+        if (cache->epoch_.load() == epoch) {
+            return;
+        }
+
+        counter_->fetch_sub(1, std::memory_order_release);
+    }
+}
+
+template<class K, class V, class S, class D, class H>
+ClockCache<K, V, S, D, H>::ClockCache(size_t maxsize, size_t maxmemsize, S s, D d, H h)
+    : mask_(0)
+    , hand_(0)
+    , max_size_(maxsize)
+    , max_memory_size_(maxmemsize)
+    , size_(0)
+    , memory_size_(0)
+    , epoch_(0)
+    , sizeof_(s)
+    , deleter_(d)
+    , hash_(h) {
+    if (max_size_ == 0) {
+        max_size_ = 1;
+    }
+
+    if (max_memory_size_ == 0) {
+        max_memory_size_ = size_t(-1);
+    }
+
+    size_t n = 2;
+    while (n < max_size_ * 2) {
+        n <<= 1;
+    }
+
+    std::vector<Slot> slots(n);
+    slots_.swap(slots);
+    for (size_t i = 0; i < n; ++i) {
+        slots_[i].store(NULL, std::memory_order_relaxed);
+    }
+    mask_ = n - 1;
+}
+
+template<class K, class V, class S, class D, class H>
+ClockCache<K, V, S, D, H>::~ClockCache() {
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        Entry* e = slots_[i].load(std::memory_order_relaxed);
+        if (e) {
+            deleter_(e->value);
+            delete e;
+        }
+    }
+
+    for (size_t i = 0; i < retired_.size(); ++i) {
+        deleter_(retired_[i]->value);
+        delete retired_[i];
+    }
+}
+
+template<class K, class V, class S, class D, class H>
+bool ClockCache<K, V, S, D, H>::Find(const K& key, V* value) {
+    size_t hash = Hash(key);
+    ReadGuard guard(this);
+    for (size_t i = 0, index = hash & mask_; i < slots_.size(); ++i, index = (index + 1) & mask_) {
+        Entry* e = slots_[index].load(std::memory_order_acquire);
+        if (!e) {
+            return false;
+        }
+
+        if (e->hash == hash && e->key == key) {
+            // Do not write the shared cache line again if it is set already
+            if (!e->referenced.load(std::memory_order_relaxed)) {
+                e->referenced.store(true, std::memory_order_relaxed);
+            }
+            *value = e->value;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+template<class K, class V, class S, class D, class H>
+void ClockCache<K, V, S, D, H>::Insert(const K& key, const V& value) {
+    size_t hash = Hash(key);
+    Entry* e = new Entry(key, value, hash);
+    e->memory_size = ValueSize(value);
+
+    std::lock_guard<std::mutex> guard(mutex_);
+    size_t index = Probe(key, hash);
+    Entry* old = slots_[index].load(std::memory_order_relaxed);
+    if (old) {
+        // Replace it. The readers see either the old or the new one.
+        memory_size_ = memory_size_ - old->memory_size + e->memory_size;
+        slots_[index].store(e, std::memory_order_release);
+        Retire(old);
+        return;
+    }
+
+    while (size_ > 0 && (size_ >= max_size_ || memory_size_ >= max_memory_size_)) {
+        EvictOne();
+    }
+
+    // The eviction may have moved the slots
+    index = Probe(key, hash);
+    slots_[index].store(e, std::memory_order_release);
+    ++size_;
+    memory_size_ += e->memory_size;
+}
+
+template<class K, class V, class S, class D, class H>
+bool ClockCache<K, V, S, D, H>::Erase(const K& key) {
+    size_t hash = Hash(key);
+    std::lock_guard<std::mutex> guard(mutex_);
+    size_t index = Probe(key, hash);
+    if (!slots_[index].load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    RemoveAt(index);
+    return true;
+}
+
+template<class K, class V, class S, class D, class H>
+size_t ClockCache<K, V, S, D, H>::Probe(const K& key, size_t hash) const {
+    size_t index = hash & mask_;
+    for (;;) {
+        const Entry* e = slots_[index].load(std::memory_order_relaxed);
+        if (!e || (e->hash == hash && e->key == key)) {
+            return index;
+        }
+        index = (index + 1) & mask_;
+    }
+}
+
+template<class K, class V, class S, class D, class H>
+void ClockCache<K, V, S, D, H>::EvictOne() {
+    // It ends within two rounds, since the first round clears all the reference bits
+    for (;;) {
+        Entry* e = slots_[hand_].load(std::memory_order_relaxed);
+        if (e) {
+            if (!e->referenced.load(std::memory_order_relaxed)) {
+                // The slot may be filled by the next one, so the hand stays here
+                RemoveAt(hand_);
+                return;
+            }
+            e->referenced.store(false, std::memory_order_relaxed);
+        }
+        hand_ = (hand_ + 1) & mask_;
+    }
+}
+
+template<class K, class V, class S, class D, class H>
+void ClockCache<K, V, S, D, H>::RemoveAt(size_t index) {
+    Entry* removed = slots_[index].load(std::memory_order_relaxed);
+    assert(removed);
+    --size_;
+    memory_size_ -= removed->memory_size;
+
+    // Shift the following items of the probe sequence back, so there is no
+    // tombstone. A moved item is stored to its new slot before the old slot is
+    // cleared, so the readers may see it twice but never a freed item.
+    size_t hole = index;
+    for (size_t next = (hole + 1) & mask_;; next = (next + 1) & mask_) {
+        Entry* e = slots_[next].load(std::memory_order_relaxed);
+        if (!e) {
+            break;
+        }
+
+        // It stays if its home slot is in (hole, next]
+        size_t home = e->hash & mask_;
+        bool stay = (hole <= next) ? (hole < home && home <= next) : (hole < home || home <= next);
+        if (!stay) {
+            slots_[hole].store(e, std::memory_order_release);
+            hole = next;
+        }
+    }
+
+    slots_[hole].store(NULL, std::memory_order_release);
+    Retire(removed);
+}
+
+template<class K, class V, class S, class D, class H>
+void ClockCache<K, V, S, D, H>::Retire(Entry* e) {
+    retired_.push_back(e);
+    if (retired_.size() >= kRetireBatchSize) {
+        Synchronize();
+    }
+}
+
+template<class K, class V, class S, class D, class H>
+void ClockCache<K, V, S, D, H>::Synchronize() {
+    // The readers coming after the flip can't see the retired items, so only
+    // the ones of the old epoch are waited for
+    //
+    // The counters are loaded seq_cst like the store of epoch_: it is a
+    // store-load handshake with the readers, which count themselves and then
+    // load epoch_, and only seq_cst keeps the store before the loads.
+    unsigned epoch = epoch_.load(std::memory_order_relaxed);
+    epoch_.store(epoch + 1);
+    for (size_t i = 0; i < kReaderStripeCount; ++i) {
+        while (stripes_[i].count[epoch & 1].load() != 0) {
+            std::this_thread::yield();
+        }
+    }
+
+    for (size_t i = 0; i < retired_.size(); ++i) {
+        deleter_(retired_[i]->value);
+        delete retired_[i];
+    }
+    retired_.clear();
+}
+}
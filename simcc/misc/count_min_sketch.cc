@@ -0,0 +1,125 @@
+#include "count_min_sketch.h"
+
+namespace simcc {
+
+namespace {
+size_t RoundUpWidth(size_t width) {
+    size_t n = 1;
+    while (n < width) {
+        n <<= 1;
+    }
+    return n;
+}
+}
+
+SlidingCountMinSketch::SlidingCountMinSketch(size_t width, size_t depth, int64_t window)
+    : width_(RoundUpWidth(width))
+    , depth_(depth > 0 ? depth : 1)
+    , window_(window > 0 ? window : 1)
+    , window_start_(0)
+    , initialized_(false)
+    , sliding_(false) {
+    for (int i = 0; i < 2; ++i) {
+        std::vector<std::atomic<uint32_t>> counters(depth_ * width_);
+        counters_[i].swap(counters);
+        Clear(counters_[i]);
+    }
+}
+
+void SlidingCountMinSketch::Add(uint64_t hash, int64_t now, uint32_t count) {
+    Slide(now);
+    std::vector<std::atomic<uint32_t>>& counters = counters_[Generation(window_start_.load(std::memory_order_acquire))];
+    for (size_t row = 0; row < depth_; ++row) {
+        counters[Index(hash, row)].fetch_add(count, std::memory_order_relaxed);
+    }
+}
+
+double SlidingCountMinSketch::Estimate(uint64_t hash, int64_t now) {
+    Slide(now);
+    int64_t start = window_start_.load(std::memory_order_acquire);
+    int current = Generation(start);
+    const std::vector<std::atomic<uint32_t>>& counters = counters_[current];
+    const std::vector<std::atomic<uint32_t>>& previous = counters_[1 - current];
+
+    // The part of the previous window which is still in the sliding window.
+    // While the other thread is moving the window, the start is the older one
+    // and the previous generation being cleared is weighted by it.
+    int64_t elapsed = now - start;
+    double weight = elapsed >= window_ ? 0.0 : double(window_ - elapsed) / double(window_);
+
+    double estimate = 0;
+    for (size_t row = 0; row < depth_; ++row) {
+        size_t index = Index(hash, row);
+        double count = double(counters[index].load(std::memory_order_relaxed))
+                       + weight * double(previous[index].load(std::memory_order_relaxed));
+        if (row == 0 || count < estimate) {
+            estimate = count;
+        }
+    }
+    return estimate;
+}
+
+void SlidingCountMinSketch::Slide(int64_t now) {
+    if (initialized_.load(std::memory_order_acquire)
+            && now < window_start_.load(std::memory_order_acquire) + window_) {
+        return;
+    }
+
+    if (sliding_.exchange(true, std::memory_order_acquire)) {
+        return; // The other thread is moving it
+    }
+
+    int64_t start = window_start_.load(std::memory_order_relaxed);
+    int64_t new_start = now - now % window_;
+    if (!initialized_.load(std::memory_order_relaxed)) {
+        // The first window, they are empty
+        window_start_.store(new_start, std::memory_order_release);
+        initialized_.store(true, std::memory_order_release);
+    } else if (now >= start + window_) {
+        // The previous generation becomes the current one. If more than a
+        // window is passed, the current one is out of the window too. The
+        // readers keep using the old start until the new one is published.
+        Clear(counters_[Generation(new_start)]);
+        if (new_start >= start + 2 * window_) {
+            Clear(counters_[1 - Generation(new_start)]);
+        }
+        window_start_.store(new_start, std::memory_order_release);
+    }
+    sliding_.store(false, std::memory_order_release);
+}
+
+void SlidingCountMinSketch::Clear(std::vector<std::atomic<uint32_t>>& counters) {
+    for (size_t i = 0; i < counters.size(); ++i) {
+        counters[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+DeadlineSketch::DeadlineSketch(size_t width, size_t depth)
+    : width_(RoundUpWidth(width))
+    , depth_(depth > 0 ? depth : 1)
+    , deadlines_(depth_ * width_) {
+    for (size_t i = 0; i < deadlines_.size(); ++i) {
+        deadlines_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void DeadlineSketch::Set(uint64_t hash, uint32_t deadline) {
+    for (size_t row = 0; row < depth_; ++row) {
+        std::atomic<uint32_t>& d = deadlines_[Index(hash, row)];
+        uint32_t old = d.load(std::memory_order_relaxed);
+        while (old < deadline && !d.compare_exchange_weak(old, deadline, std::memory_order_relaxed)) {
+        }
+    }
+}
+
+uint32_t DeadlineSketch::Get(uint64_t hash) const {
+    uint32_t deadline = 0;
+    for (size_t row = 0; row < depth_; ++row) {
+        uint32_t d = deadlines_[Index(hash, row)].load(std::memory_order_relaxed);
+        if (row == 0 || d < deadline) {
+            deadline = d;
+        }
+    }
+    return deadline;
+}
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "simcc/inner_pre.h"
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+namespace simcc {
+
+// @brief A count-min sketch of the counts of the keys in a sliding window,
+// with a fixed memory of 2 * depth * width counters. It is thread safe and
+// lock-free, adding a key is depth fetch_adds.
+//
+// The counts are kept in two generations, the current window and the previous
+// one. The count in the sliding window is estimated as the current count plus
+// the part of the previous count which is still in the window, assuming the
+// previous one is spread evenly. Like every count-min sketch, the estimate is
+// never less than the real count, and it is more only when the key collides
+// with the other keys in all the rows.
+//
+// The time is in any unit, e.g. the seconds of time(NULL), and the window is
+// in the same unit. The thread which moves the window clears the older
+// generation, which costs depth * width stores once a window. The generation
+// of a window is the parity of its start / window, so the start published
+// after the clear moves both the generation and the weight at once.
+//     simcc::SlidingCountMinSketch sketch(1 << 20, 4, 60);
+//     uint64_t h = simcc::XXHash64::Sum(data, len);
+//     if (sketch.Estimate(h, time(NULL)) < max_count) {
+//         sketch.Add(h, time(NULL));
+//     }
+class SIMCC_EXPORT SlidingCountMinSketch {
+public:
+    // @param size_t width - The counters of every row, rounded up to a power of 2
+    // @param size_t depth - The rows, every row uses a different index of the hash
+    // @param int64_t window - The length of the window
+    SlidingCountMinSketch(size_t width, size_t depth, int64_t window);
+
+    // @param uint64_t hash - The hash value of the key, which should be well mixed
+    void Add(uint64_t hash, int64_t now, uint32_t count = 1);
+
+    // @brief The estimated count of the key in the window (now - window, now]
+    double Estimate(uint64_t hash, int64_t now);
+
+    size_t width() const {
+        return width_;
+    }
+    size_t depth() const {
+        return depth_;
+    }
+    size_t memory_size() const {
+        return 2 * depth_ * width_ * sizeof(uint32_t);
+    }
+
+private:
+    size_t Index(uint64_t hash, size_t row) const {
+        // Double hashing, the rows get independent enough indexes from one hash
+        uint64_t h1 = hash & 0xffffffff;
+        uint64_t h2 = (hash >> 32) | 1;
+        return row * width_ + size_t((h1 + row * h2) & (width_ - 1));
+    }
+
+    // Move to the window of now if it is passed
+    void Slide(int64_t now);
+
+    int Generation(int64_t start) const {
+        return int((start / window_) & 1);
+    }
+
+    static void Clear(std::vector<std::atomic<uint32_t>>& counters);
+
+private:
+    size_t width_;
+    size_t depth_;
+    int64_t window_;
+
+    std::vector<std::atomic<uint32_t>> counters_[2];
+    std::atomic<int64_t> window_start_; // The start time of the current window
+    std::atomic<bool> initialized_; // window_start_ is set by the first Slide
+    std::atomic<bool> sliding_; // A thread is moving the window
+};
+
+// @brief A sketch of the deadlines of the keys with the same layout as
+// SlidingCountMinSketch. Every counter keeps the latest deadline set to it,
+// and the deadline of a key is the earliest of its counters, so it is never
+// earlier than the real one. The deadlines are 32 bits, e.g. the seconds of
+// time(NULL).
+class SIMCC_EXPORT DeadlineSketch {
+public:
+    DeadlineSketch(size_t width, size_t depth);
+
+    // @brief Set the deadline of the key if it is later than the current one
+    void Set(uint64_t hash, uint32_t deadline);
+
+    // @return the deadline of the key, 0 if it has never been set
+    uint32_t Get(uint64_t hash) const;
+
+    size_t memory_size() const {
+        return depth_ * width_ * sizeof(uint32_t);
+    }
+
+private:
+    size_t Index(uint64_t hash, size_t row) const {
+        uint64_t h1 = hash & 0xffffffff;
+        uint64_t h2 = (hash >> 32) | 1;
+        return row * width_ + size_t((h1 + row * h2) & (width_ - 1));
+    }
+
+private:
+    size_t width_;
+    size_t depth_;
+    std::vector<std::atomic<uint32_t>> deadlines_;
+};
+}
@@ -1,103 +1,168 @@
 #pragma once
 
+#include <string.h>
+
+#include <atomic>
 #include <thread>
-#include <mutex>
 #include <memory>
+#include <vector>
 
-#include "lru.h"
+#include "sharded_lru.h"
+#include "count_min_sketch.h"
 #include "md5.h"
+#include "xxhash64.h"
 #include "simcc/ini_parser.h"
 
 namespace simcc {
 
+// @brief The fingerprints of the packets, which are the keys of DgramFilter.
+// A fingerprint is a functor with the key type as its value_type:
+//     value_type operator()(const void* data, size_t len, const string& ip, bool debug) const;
+// The packets with the same fingerprint are counted together.
+
+// The default one, the 64-bit xxHash of the data and the IP. It is stored in
+// the LRU inline. Any two of a million keys collide with a chance of about 3e-8.
+struct DgramXXHash64Fingerprint {
+    typedef uint64_t value_type;
+
+    uint64_t operator()(const void* data, size_t len, const string& ip, bool /*debug*/) const {
+        uint64_t h = simcc::XXHash64::Sum(data, len);
+        if (!ip.empty()) {
+            h = simcc::XXHash64::Sum(ip.data(), ip.size(), h);
+        }
+        return h;
+    }
+};
+
+// The MD5 of the data and the IP, as a 16-byte binary string, or a 32-byte
+// hex string if debug
+struct DgramMD5Fingerprint {
+    typedef string value_type;
+
+    string operator()(const void* data, size_t len, const string& ip, bool debug) const {
+        simcc::MD5 md5;
+        md5.Update(data, len);
+
+        if (!ip.empty()) {
+            md5.Update(ip.data(), ip.size());
+        }
+
+        if (debug) {
+            return md5.Finalizeh();
+        } else {
+            return md5.Finalize();
+        }
+    }
+};
+
 // kIntervalSeconds ʱڣͬһIPͬһݰֻ max_threshold ᱻ˶
 //
 // ײʵ̰߳ȫģLRUݰdgram
 //
 //  lru_max_item_count  lru_max_memery_size_mb LRUصĲLRUռõڴʹ.
 
-template<int kIntervalSeconds = 60>
+template<int kIntervalSeconds = 60, class Fingerprint = DgramXXHash64Fingerprint>
 class DgramFilter {
+    typedef typename Fingerprint::value_type Key;
+
+    // The packets of a key in the last kIntervalSeconds seconds, counted
+    // without any lock. Every bucket of the ring is the low 16 bits of the
+    // second it belongs to and the packets of that second packed into one
+    // atomic word, so a bucket of an older round is found stale and cleared
+    // by a CAS, and the counting is a fetch_add. Whoever clears a bucket
+    // takes its packets off the total. The total is incremented before the bucket, to reserve the
+    // packet against max_threshold, so the threads counting the same key
+    // together can't let more than max_threshold packets pass.
     struct Stat {
-        std::mutex mutex; // the lock for Stat member fields
-
-        time_t   update_time; // µĸ Stat ״̬ʱ䣬
-        uint32_t total; // ܵ
-        uint16_t count[kIntervalSeconds]; // 洢ÿһ
+        std::atomic<int64_t>  update_time; // µĸ Stat ״̬ʱ䣬
+        std::atomic<int64_t>  total; // ܵ
+        std::atomic<uint32_t> count[kIntervalSeconds]; // 洢ÿһ: second << 16 | count
 
         Stat() : update_time(time(NULL)), total(0) {
-            memset(count, 0, sizeof(count));
+            for (int i = 0; i < kIntervalSeconds; ++i) {
+                count[i] = 0;
+            }
         }
 
-        void Update(time_t now) {
-            if (now >= this->update_time + kIntervalSeconds) {
-                // one more round trip, clear the expired data
-                this->Reset();
-                std::lock_guard<std::mutex> guard(mutex);
-                this->Inc();
-                return;
+        // @brief Slide the window to now and reserve a packet in it
+        // @return false if there are max_threshold packets in the window already
+        bool Update(time_t now, uint32_t max_threshold) {
+            int64_t last = this->update_time.load(std::memory_order_relaxed);
+            while (last < now) {
+                if (this->update_time.compare_exchange_weak(last, now, std::memory_order_relaxed)) {
+                    // This thread moves the window, clear the seconds passed meanwhile
+                    int64_t first = last + 1;
+                    if (first <= now - kIntervalSeconds) {
+                        first = now - kIntervalSeconds + 1;
+                    }
+                    for (int64_t second = first; second < now; ++second) {
+                        this->ClearOneBucket(second);
+                    }
+                    break;
+                }
             }
 
-            if (now == this->update_time) {
-                std::lock_guard<std::mutex> guard(mutex);
-                this->Inc();
-                return;
+            if (this->total.fetch_add(1, std::memory_order_relaxed) >= int64_t(max_threshold)) {
+                this->total.fetch_sub(1, std::memory_order_relaxed);
+                return false;
             }
 
-            int last_index = this->update_time % kIntervalSeconds + kIntervalSeconds;
-            int current_index = now % kIntervalSeconds + kIntervalSeconds;
-            assert(last_index != current_index);
-
-            std::lock_guard<std::mutex> guard(mutex);
-            for (int i = last_index + 1; i <= current_index; ++i) {
-                this->ClearOneBucket(i);
-            }
-
-            this->update_time = now;
-            this->Inc();
+            this->ClearOneBucket(now);
+            this->count[now % kIntervalSeconds].fetch_add(1, std::memory_order_relaxed);
+            return true;
         }
 
-        void Reset() {
-            std::lock_guard<std::mutex> guard(mutex);
-            update_time = time(NULL);
-            total = 0;
-            memset(count, 0, sizeof(count));
+        void Reset(time_t now) {
+            for (int i = 0; i < kIntervalSeconds; ++i) {
+                this->total.fetch_sub(Count(this->count[i].exchange(0, std::memory_order_relaxed)), std::memory_order_relaxed);
+            }
+            this->update_time.store(now, std::memory_order_relaxed);
         }
     private:
-        void ClearOneBucket(int index) {
-            index = index % kIntervalSeconds;
-            assert(this->total >= this->count[index]);
-
-            if (this->total < this->count[index]) {
-                fprintf(stderr, "%s Logic ERROR : total < this->count[%d]", __FUNCTION__, index);
-                return;
-            }
-
-            this->total -= this->count[index];
-            this->count[index] = 0;
+        static uint32_t Second(int64_t second) {
+            return uint32_t(second & 0xffff) << 16;
         }
-
-        void Inc() {
-            this->count[this->update_time % kIntervalSeconds]++;
-            this->total++;
+        static int64_t Count(uint32_t bucket) {
+            return int64_t(bucket & 0xffff);
         }
-    };
 
-    struct Deletor : std::unary_function<Stat*, void> {
-        void operator()(Stat*& v) const {
-            delete v;
-            v = NULL;
+        // Clear the bucket of the second if it is of an older round
+        void ClearOneBucket(int64_t second) {
+            std::atomic<uint32_t>& bucket = this->count[second % kIntervalSeconds];
+            uint32_t b = bucket.load(std::memory_order_relaxed);
+            while ((b & 0xffff0000) != Second(second)) {
+                if (bucket.compare_exchange_weak(b, Second(second), std::memory_order_relaxed)) {
+                    this->total.fetch_sub(Count(b), std::memory_order_relaxed);
+                    return;
+                }
+            }
         }
     };
 
-    struct Sizeof : std::unary_function<Stat*, size_t> {
-        size_t operator()(const Stat* v) const {
-            return sizeof(string) + simcc::MD5::kBinDigestLength + sizeof(v) + sizeof(*v);
+    typedef std::shared_ptr<Stat> StatPtr;
+
+    struct Sizeof {
+        size_t operator()(const StatPtr& v) const {
+            // the key, the value and the control block of shared_ptr
+            return sizeof(Key) + sizeof(v) + sizeof(*v) + 2 * sizeof(void*);
         }
     };
 
-    typedef LRUCacheH4< string, Stat*, Sizeof, Deletor > LRUCache;
+    typedef ShardedLRUCacheH4< Key, StatPtr, Sizeof > LRUCache;
     typedef std::shared_ptr<LRUCache> LRUCachePtr;
+    typedef std::shared_ptr<SlidingCountMinSketch> SketchPtr;
+    typedef std::shared_ptr<DeadlineSketch> DeadlineSketchPtr;
+
+public:
+    // The largest max_threshold of the LRU mode, the most packets a bucket of Stat can count
+    enum { kMaxThreshold = 0xffff };
+
+    // A packet of a batch, see IsNeedFilter(const Packet*, size_t, uint64_t*)
+    struct Packet {
+        const void* data;
+        size_t len;
+        const string* ip; // NULL is the same as an empty IP
+    };
 
 public:
     DgramFilter()
@@ -106,27 +171,67 @@ public:
         , block_second_(60 * 10)
         , lru_max_item_count_(50000)
         , lru_max_memery_size_bytes_(100 * 1024 * 1024)
+        , lru_shard_count_(16)
         , debug_(false) {
     }
 
     ~DgramFilter() {
     }
 
+    // @param max_threshold - At most kMaxThreshold, since the packets of a second
+    //     are counted in 16 bits. A larger one is clamped.
+    // @param lru_shard_count - The LRU is split into this many shards with their own locks,
+    //     so the threads checking different packets seldom wait for each other
     bool Initialize(bool enable,
                     uint32_t max_threshold,
                     size_t lru_max_item_count,
                     size_t lru_max_memery_size_mb,
-                    uint32_t block_second) {
+                    uint32_t block_second,
+                    size_t lru_shard_count = 16) {
         enable_ = enable;
-        max_threshold_ = max_threshold;
+        max_threshold_ = max_threshold < kMaxThreshold ? max_threshold : uint32_t(kMaxThreshold);
         block_second_ = block_second;
         lru_max_item_count_ = lru_max_item_count;
         lru_max_memery_size_bytes_ = lru_max_memery_size_mb * 1024 * 1024;
+        lru_shard_count_ = lru_shard_count;
 
+        sketch_.reset();
+        deadlines_.reset();
         if (enable_) {
             lru_.reset(new LRUCache(lru_max_item_count_,
                                     lru_max_memery_size_bytes_,
-                                    Sizeof(), Deletor()));
+                                    lru_shard_count_,
+                                    Sizeof()));
+        }
+
+        return true;
+    }
+
+    // @brief The approximate mode for the floods of too many different packets
+    //     to be kept in the LRU. The packets are counted in a count-min sketch
+    //     of the sliding window, so the memory is fixed and a packet costs a
+    //     few hashed increments. A packet may be filtered by mistake if it
+    //     collides with the flooding ones in all the rows.
+    //
+    //     A key which reaches max_threshold is blocked for block_second, and
+    //     it is blocked again while its count stays over max_threshold in the
+    //     window, since the sketch can't reset the count of one key.
+    // @param sketch_width - The counters of every row, the memory is about
+    //     3 * sketch_width * sketch_depth * 4 bytes
+    // @param sketch_depth - The rows
+    bool InitializeSketch(bool enable,
+                          uint32_t max_threshold,
+                          uint32_t block_second,
+                          size_t sketch_width,
+                          size_t sketch_depth) {
+        enable_ = enable;
+        max_threshold_ = max_threshold;
+        block_second_ = block_second;
+
+        lru_.reset();
+        if (enable_) {
+            sketch_.reset(new SlidingCountMinSketch(sketch_width, sketch_depth, kIntervalSeconds));
+            deadlines_.reset(new DeadlineSketch(sketch_width, sketch_depth));
         }
 
         return true;
@@ -147,49 +252,99 @@ public:
             return false;
         }
 
-        Stat* stat = NULL;
-        string md5 = CheckSum(data, len, ip);
-        assert(!md5.empty());
+        Key key = fingerprint_(data, len, ip, debug_);
         time_t now  = time(NULL);
+        if (sketch_) {
+            return IsNeedFilterApproximately(Hash(key), now);
+        }
 
-        mutex_.lock();
-        auto it = lru_->Find(md5);
-        mutex_.unlock();
-        if (it == lru_->end()) {
-            stat = new Stat();
-            std::lock_guard<std::mutex> mutex_guard(mutex_);
-            lru_->insert(md5, stat);
-        } else {
-            stat = const_cast<Stat*>(it.value());
+        // The shard is only locked to find the Stat. It is counted without
+        // any lock, the reference keeps it alive if it is evicted meanwhile.
+        StatPtr stat;
+        lru_->FindOrInsert(key, []() {
+            return std::make_shared<Stat>();
+        }, [&stat](StatPtr& v) {
+            stat = v;
+        });
+        return IsNeedFilter(stat.get(), now);
+    }
+
+    // @brief Check a batch of packets, e.g. the ones received by a recvmmsg.
+    //     All the packets are fingerprinted first, then every shard of the
+    //     LRU is locked once for its packets, and the clock is read once.
+    //     It is the same as checking the packets one by one in the order.
+    // @param[in] packets -
+    // @param[in] count -
+    // @param[out] bitmap - The bit i is set if packets[i] needs to be filtered,
+    //     it has (count + 63) / 64 words at least
+    // @return the count of the packets which need to be filtered
+    size_t IsNeedFilter(const Packet* packets, size_t count, uint64_t* bitmap) {
+        memset(bitmap, 0, (count + 63) / 64 * sizeof(uint64_t));
+        if (!enable_ || count == 0) {
+            return 0;
         }
 
-        if (stat->total >= max_threshold_) {
-            if (stat->update_time + block_second_ >= now) {
-                return true;
-            } else {
-                stat->Reset();
+        time_t now = time(NULL);
+        const string no_ip;
+        std::vector<Key> keys;
+        std::vector<size_t> indexes; // The indexes of the packets of keys
+        keys.reserve(count);
+        indexes.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            const Packet& p = packets[i];
+            if (p.len > 0) {
+                keys.push_back(fingerprint_(p.data, p.len, p.ip ? *p.ip : no_ip, debug_));
+                indexes.push_back(i);
             }
         }
 
-        stat->Update(now);
-        return false;
+        size_t filtered = 0;
+        if (sketch_) {
+            for (size_t k = 0; k < keys.size(); ++k) {
+                if (IsNeedFilterApproximately(Hash(keys[k]), now)) {
+                    bitmap[indexes[k] / 64] |= uint64_t(1) << (indexes[k] % 64);
+                    ++filtered;
+                }
+            }
+            return filtered;
+        }
+
+        std::vector<StatPtr> stats(keys.size());
+        lru_->FindOrInsertBatch(keys.data(), keys.size(), []() {
+            return std::make_shared<Stat>();
+        }, [&stats](size_t k, StatPtr& v) {
+            stats[k] = v;
+        });
+
+        for (size_t k = 0; k < keys.size(); ++k) {
+            if (IsNeedFilter(stats[k].get(), now)) {
+                bitmap[indexes[k] / 64] |= uint64_t(1) << (indexes[k] % 64);
+                ++filtered;
+            }
+        }
+        return filtered;
     }
 
 public:
     // Debug interface
     string Dump() const {
         std::ostringstream os;
-        std::lock_guard<std::mutex> mutex_guard(mutex_);
+        if (sketch_) {
+            os << "tid=" << std::this_thread::get_id()
+               << " SlidingCountMinSketch(" << sketch_->width() << "x" << sketch_->depth() << ")"
+               << " memory:" << sketch_->memory_size() + deadlines_->memory_size() << std::endl;
+            return os.str();
+        }
+
         os << "tid=" << std::this_thread::get_id()
            << " LRUCacheH4(" << lru_->size() << "/" << lru_->max_size() << ")"
            << " memory:(" << lru_->memory_size() << "/" << lru_->max_memory_size() <<  "):"
+           << " shards:" << lru_->shard_count()
            << " LRU --> MRU: " << std::endl;
 
-        for (auto it = lru_->lru_begin(); it != lru_->end(); ++it) {
-            Stat* stat = it.value();
-            string key = it.key();
+        lru_->ForEach([&os](const Key & key, const StatPtr & stat) {
             os <<  "key=" << key << " update_time=" << stat->update_time << " total=" << stat->total << std::endl;
-        }
+        });
 
         return os.str();
     }
@@ -199,40 +354,79 @@ public:
     }
 
 public:
+    // dgram_filter_mode is "lru" (the default) or "sketch", see InitializeSketch
     static bool Initialize(const simcc::INIParser& ini, DgramFilter* filter) {
         bool dgram_filter_enable = ini.GetBool("dgram_filter_enable", false);
         int64_t dgram_filter_max_threshold = ini.GetInteger("dgram_filter_max_threshold", 100);
+        const string& dgram_filter_mode = ini.Get("dgram_filter_mode");
+        if (dgram_filter_mode == "sketch") {
+            return filter->InitializeSketch(
+                       dgram_filter_enable,
+                       dgram_filter_max_threshold,
+                       ini.GetInteger("dgram_filter_block_second", 180),
+                       ini.GetInteger("dgram_filter_sketch_width", 256 * 1024),
+                       ini.GetInteger("dgram_filter_sketch_depth", 4));
+        } else if (!dgram_filter_mode.empty() && dgram_filter_mode != "lru") {
+            return false;
+        }
+
         int64_t dgram_filter_lru_max_item_count = ini.GetInteger("dgram_filter_lru_max_item_count", 1024 * 1024);
         int64_t dgram_filter_lru_max_memery_size_mb = ini.GetInteger("dgram_filter_lru_max_memery_size_mb", 128 * 1024 * 1024);
         int64_t dgram_filter_block_second = ini.GetInteger("dgram_filter_block_second", 180);
+        int64_t dgram_filter_lru_shard_count = ini.GetInteger("dgram_filter_lru_shard_count", 16);
 
         return filter->Initialize(
                    dgram_filter_enable,
                    dgram_filter_max_threshold,
                    dgram_filter_lru_max_item_count,
                    dgram_filter_lru_max_memery_size_mb,
-                   dgram_filter_block_second);
+                   dgram_filter_block_second,
+                   dgram_filter_lru_shard_count);
     }
 
 private:
-    string CheckSum(const void* data, size_t len, const string& ip) const {
-        simcc::MD5 md5;
-        md5.Update(data, len);
+    bool IsNeedFilter(Stat* stat, time_t now) {
+        if (stat->total.load(std::memory_order_relaxed) >= int64_t(max_threshold_)) {
+            int64_t last = stat->update_time.load(std::memory_order_relaxed);
+            if (last + block_second_ >= now) {
+                return true;
+            } else if (stat->update_time.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+                // Only one of the threads resets it
+                stat->Reset(now);
+            }
+        }
 
-        if (!ip.empty()) {
-            md5.Update(ip.data(), ip.size());
+        return !stat->Update(now, max_threshold_);
+    }
+
+    bool IsNeedFilterApproximately(uint64_t hash, time_t now) {
+        if (deadlines_->Get(hash) >= now) {
+            return true;
         }
 
-        if (debug_) {
-            return md5.Finalizeh();
-        } else {
-            return md5.Finalize();
+        if (sketch_->Estimate(hash, now) >= max_threshold_) {
+            deadlines_->Set(hash, uint32_t(now + block_second_));
+            return true;
         }
+
+        sketch_->Add(hash, now);
+        return false;
+    }
+
+    static uint64_t Hash(const Key& key) {
+        // std::hash of the integers is the identity, so mix the bits up
+        uint64_t h = std::hash<Key>()(key);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
     }
 
 private:
-    std::mutex mutex_; // the lock for lru_
     LRUCachePtr lru_;
+    SketchPtr sketch_; // Only in the approximate mode
+    DeadlineSketchPtr deadlines_; // The blocked keys of the approximate mode
+    Fingerprint fingerprint_;
 
     bool enable_;
     uint32_t max_threshold_;
@@ -240,6 +434,7 @@ private:
 
     size_t lru_max_item_count_;
     size_t lru_max_memery_size_bytes_;
+    size_t lru_shard_count_;
 
     bool debug_;
 };
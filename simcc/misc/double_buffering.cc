@@ -1,40 +1,240 @@
 #include "double_buffering.h"
+#include "simcc/file_util.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
 
 namespace simcc {
 
+namespace {
+size_t ReaderStripeIndex(size_t stripe_count) {
+    static thread_local size_t stripe = std::hash<std::thread::id>()(std::this_thread::get_id());
+    return stripe % stripe_count;
+}
+
+std::chrono::nanoseconds ToChrono(Duration d) {
+    return std::chrono::nanoseconds(d.Nanoseconds() > 0 ? d.Nanoseconds() : 0);
+}
+}
+
+DoubleBuffering::Target::~Target() {
+    if (versions_.get()) {
+        std::lock_guard<std::mutex> g(versions_->mutex);
+        versions_->records.erase(id_);
+        versions_->drained.notify_all();
+    }
+}
+
 DoubleBuffering::DoubleBuffering(TargetCreator f)
-    : creator_(f), reload_time_(0) {}
+    : current_(0), creator_(f), reload_time_(0), version_(0), versions_(new Versions) {}
 
 bool DoubleBuffering::Reload(const string& conf) {
-    auto t = creator_();
-    if (!t->Initialize(conf)) {
+    TargetPtr t = Create(conf);
+    if (t.IsNull()) {
         return false;
     }
-    std::lock_guard<std::mutex> g(mutex_);
-    current_ = t;
-    reload_time_ = Timestamp::Now();
+
+    Publish(t);
     return true;
 }
 
-DoubleBuffering::TargetPtr DoubleBuffering::Get() const {
-    std::lock_guard<std::mutex> g(mutex_);
-    auto t = current_;
+DoubleBuffering::TargetPtr DoubleBuffering::Create(const string& conf, bool* throttled) const {
+    if (throttled) {
+        *throttled = false;
+    }
+
+    TargetPtr t = creator_();
+    {
+        std::unique_lock<std::mutex> lock(versions_->mutex);
+        Versions& v = *versions_;
+        if (v.max_count > 0 && v.records.size() >= v.max_count) {
+            // The new one is not counted yet, so it is dropped quietly
+            if (!v.drained.wait_for(lock, ToChrono(v.drain_timeout), [&v]() {
+                return v.records.size() < v.max_count;
+            })) {
+                if (throttled) {
+                    *throttled = true;
+                }
+                return TargetPtr();
+            }
+        }
+        AddVersion(t.get());
+    }
+
+    if (!t->Initialize(conf)) {
+        return TargetPtr();
+    }
+
+    std::lock_guard<std::mutex> g(versions_->mutex);
+    versions_->records[t->id_].memory_size = t->MemorySize();
     return t;
 }
 
+void DoubleBuffering::Publish(const TargetPtr& t) {
+    std::lock_guard<std::mutex> g(mutex_);
+    {
+        std::lock_guard<std::mutex> vg(versions_->mutex);
+        if (t->versions_.get() == NULL) {
+            AddVersion(t.get()); // Not created by Create
+            versions_->records[t->id_].memory_size = t->MemorySize();
+        }
+        if (t->versions_ == versions_) {
+            versions_->records[t->id_].published = true;
+        }
+    }
+
+    int old = current_.load(std::memory_order_relaxed);
+    int slot = 1 - old;
+
+    // The late readers which have seen the slot before the last switch
+    WaitForReaders(slot);
+    targets_[slot] = t;
+    current_.store(slot);
+
+    // The readers coming from now on take the new one
+    WaitForReaders(old);
+    targets_[old].reset();
+
+    reload_time_.store(Timestamp::Now().UnixNano(), std::memory_order_relaxed);
+    version_.fetch_add(1, std::memory_order_release);
+}
+
+DoubleBuffering::TargetPtr DoubleBuffering::Get() const {
+    ReaderStripe& stripe = stripes_[ReaderStripeIndex(kReaderStripeCount)];
+    for (;;) {
+        int slot = current_.load();
+        stripe.count[slot].fetch_add(1);
+
+        // If the slots are switched meanwhile, Reload may not have seen us
+        if (current_.load() == slot) {
+            TargetPtr t = targets_[slot];
+            stripe.count[slot].fetch_sub(1, std::memory_order_release);
+            return t;
+        }
+
+        stripe.count[slot].fetch_sub(1, std::memory_order_release);
+    }
+}
+
+void DoubleBuffering::WaitForReaders(int slot) const {
+    // Loaded seq_cst like the store of current_ before it: the readers count
+    // themselves and then load current_, and only seq_cst on both sides keeps
+    // each store before the following load.
+    for (size_t i = 0; i < kReaderStripeCount; ++i) {
+        while (stripes_[i].count[slot].load() != 0) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void DoubleBuffering::AddVersion(Target* t) const {
+    Versions::Record r;
+    r.target = t;
+    r.memory_size = 0;
+    r.create_time = Timestamp::Now();
+    r.published = false;
+    t->versions_ = versions_;
+    t->id_ = ++versions_->next_id;
+    versions_->records[t->id_] = r;
+}
+
+void DoubleBuffering::set_max_versions(size_t n, Duration drain_timeout) {
+    std::lock_guard<std::mutex> g(versions_->mutex);
+    versions_->max_count = (n == 1 ? 2 : n);
+    versions_->drain_timeout = drain_timeout;
+    versions_->drained.notify_all();
+}
+
+std::vector<DoubleBuffering::VersionStats> DoubleBuffering::versions() const {
+    std::vector<VersionStats> result;
+    std::lock_guard<std::mutex> g(mutex_); // The current one is not replaced meanwhile
+    const Target* current = targets_[current_.load()].get();
+    std::lock_guard<std::mutex> vg(versions_->mutex);
+    for (auto it = versions_->records.begin(); it != versions_->records.end(); ++it) {
+        const Versions::Record& r = it->second;
+        VersionStats s;
+        s.id = it->first;
+        s.memory_size = r.memory_size;
+        s.create_time = r.create_time;
+
+        // A Target being destroyed is still here until its destructor gets
+        // the lock, its count is 0 then. RefCount is virtual, the vptr is
+        // being changed by the destructors, so it is called directly.
+        s.references = r.target->RefObject::RefCount();
+        if (r.target == current) {
+            s.state = kCurrent;
+            s.references--; // The one of the slot
+        } else {
+            s.state = (r.published ? kRetired : kBuilding);
+        }
+        result.push_back(s);
+    }
+    return result;
+}
+
+size_t DoubleBuffering::memory_size() const {
+    std::lock_guard<std::mutex> g(versions_->mutex);
+    size_t n = 0;
+    for (auto it = versions_->records.begin(); it != versions_->records.end(); ++it) {
+        n += it->second.memory_size;
+    }
+    return n;
+}
+
 string DoubleBuffering::MD5() const {
     auto t = Get();
     return t->MD5();
 }
 
 
-DoubleBufferingManager::DoubleBufferingManager() {}
+namespace {
+// How long the watcher waits for inotify before checking if it is stopped
+const int kInotifyWaitMilliseconds = 100;
+
+// The first interval of retrying a reload throttled by the live versions,
+// which is doubled by every retry up to the max
+const double kThrottledRetrySeconds = 0.1;
+const double kMaxThrottledRetrySeconds = 10.0;
+
+// The modification time in nanoseconds and the size of the file, or false if
+// it doesn't exist
+bool StatFile(const string& path, int64_t* mtime, int64_t* size) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+#ifdef __linux__
+    *mtime = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#else
+    *mtime = int64_t(st.st_mtime) * 1000000000;
+#endif
+    *size = int64_t(st.st_size);
+    return true;
+}
+}
+
+DoubleBufferingManager::DoubleBufferingManager()
+    : running_(false)
+    , max_throttled_retries_(10) {}
+
+DoubleBufferingManager::~DoubleBufferingManager() {
+    Stop();
+}
 
 DoubleBuffering* DoubleBufferingManager::Get(const string& name) const {
     std::lock_guard<std::mutex> g(mutex_);
     auto it = dbufs_.find(name);
     if (it != dbufs_.end()) {
-        return it->second.get();
+        return it->second.db.get();
     }
 
     assert(false && "cannot find this kind of DoubleBuffering");
@@ -44,18 +244,303 @@ DoubleBuffering* DoubleBufferingManager::Get(const string& name) const {
 bool DoubleBufferingManager::Add(const string& name,
                                  const string& conf,
                                  DoubleBuffering::TargetCreator f) {
-    std::lock_guard<std::mutex> g(mutex_);
-    DoubleBufferingPtr& db = dbufs_[name];
+    DoubleBufferingPtr db;
+    {
+        std::lock_guard<std::mutex> g(mutex_);
+        auto it = dbufs_.find(name);
+        if (it != dbufs_.end()) {
+            db = it->second.db;
+        }
+    }
+
     if (db.get() == NULL) {
-        db.reset(new DoubleBuffering(f));
+        // Load it without the lock and then add it, so the others are not
+        // blocked and nobody gets it before it is loaded
+        DoubleBufferingPtr n(new DoubleBuffering(f));
+        bool ok = n->Reload(conf);
+        std::lock_guard<std::mutex> g(mutex_);
+        Entry& e = dbufs_[name];
+        if (e.db.get() == NULL) {
+            e.db = n;
+            return ok;
+        }
+        db = e.db; // Added by the other thread meanwhile
     }
+
     return db->Reload(conf);
 }
 
 bool DoubleBufferingManager::Reload(const string& name, const string& conf) {
-    DoubleBufferingPtr& db = dbufs_[name];
-    assert(db.get());
+    DoubleBufferingPtr db;
+    {
+        std::lock_guard<std::mutex> g(mutex_);
+        auto it = dbufs_.find(name);
+        if (it == dbufs_.end()) {
+            assert(false && "cannot find this kind of DoubleBuffering");
+            return false;
+        }
+        db = it->second.db;
+    }
     return db->Reload(conf);
 }
 
+bool DoubleBufferingManager::Start(size_t worker_count, Duration min_reload_interval, Duration poll_interval) {
+    std::lock_guard<std::mutex> g(mutex_);
+    if (running_ || worker_count == 0) {
+        return false;
+    }
+
+    running_ = true;
+    min_reload_interval_ = min_reload_interval;
+    poll_interval_ = poll_interval;
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers_.push_back(std::thread(&DoubleBufferingManager::RunWorker, this));
+    }
+    watcher_ = std::thread(&DoubleBufferingManager::RunWatcher, this);
+    return true;
+}
+
+void DoubleBufferingManager::Stop() {
+    {
+        std::lock_guard<std::mutex> g(mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+        for (auto it = queue_.begin(); it != queue_.end(); ++it) {
+            dbufs_[*it].queued = false;
+        }
+        queue_.clear();
+        cond_.notify_all();
+    }
+
+    for (auto it = workers_.begin(); it != workers_.end(); ++it) {
+        it->join();
+    }
+    workers_.clear();
+    watcher_.join();
+}
+
+bool DoubleBufferingManager::AsyncReload(const string& name, const string& conf) {
+    std::lock_guard<std::mutex> g(mutex_);
+    auto it = dbufs_.find(name);
+    if (it == dbufs_.end() || !running_) {
+        return false;
+    }
+
+    Schedule(name, it->second, conf);
+    return true;
+}
+
+bool DoubleBufferingManager::Watch(const string& name, const string& path) {
+    std::lock_guard<std::mutex> g(mutex_);
+    auto it = dbufs_.find(name);
+    if (it == dbufs_.end()) {
+        return false;
+    }
+
+    // The file as it is now is taken as loaded
+    Entry& e = it->second;
+    e.file = path;
+    if (!StatFile(path, &e.file_mtime, &e.file_size)) {
+        e.file_mtime = 0;
+        e.file_size = -1;
+    }
+    cond_.notify_all(); // The watcher watches its directory
+    return true;
+}
+
+void DoubleBufferingManager::Schedule(const string& name, Entry& e, const string& conf) {
+    e.pending_conf = conf;
+    e.pending = true;
+    e.throttled_count = 0;
+    if (!e.queued && !e.running) {
+        e.queued = true;
+        queue_.push_back(name);
+        cond_.notify_all();
+    }
+}
+
+void DoubleBufferingManager::RunWorker() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        // The first one which is not limited by min_reload_interval
+        Timestamp now = Timestamp::Now();
+        Timestamp earliest;
+        auto ready = queue_.end();
+        for (auto it = queue_.begin(); it != queue_.end(); ++it) {
+            const Entry& e = dbufs_[*it];
+            if (!(now < e.due)) {
+                ready = it;
+                break;
+            }
+            if (earliest.IsEpoch() || e.due < earliest) {
+                earliest = e.due;
+            }
+        }
+
+        if (ready == queue_.end()) {
+            if (queue_.empty()) {
+                cond_.wait(lock);
+            } else {
+                cond_.wait_for(lock, ToChrono(earliest - now));
+            }
+            continue;
+        }
+
+        string name = *ready;
+        queue_.erase(ready);
+        Entry& e = dbufs_[name];
+        e.queued = false;
+        e.pending = false;
+        e.running = true;
+        string conf;
+        conf.swap(e.pending_conf);
+        DoubleBufferingPtr db = e.db;
+        lock.unlock();
+
+        ReloadResult result = kFailed;
+        {
+            bool throttled = false;
+            DoubleBuffering::TargetPtr t = db->Create(conf, &throttled);
+            if (throttled) {
+                result = kThrottled;
+            } else if (!t.IsNull()) {
+                DoubleBuffering::TargetPtr current = db->Get();
+                string md5 = t->MD5();
+                if (!md5.empty() && !current.IsNull() && current->MD5() == md5) {
+                    result = kUnchanged;
+                } else {
+                    db->Publish(t);
+                    result = kReloaded;
+                }
+            }
+        }
+
+        lock.lock();
+        e.running = false;
+        e.due = Timestamp::Now() + min_reload_interval_;
+        if (result == kThrottled && !e.pending && e.throttled_count >= max_throttled_retries_) {
+            // The old versions are not drained for long, e.g. kept by the idle readers
+            e.throttled_count = 0;
+            result = kDropped;
+        } else if (result == kThrottled) {
+            // Retry it later unless a newer one is requested, the interval is
+            // doubled by every retry in a row
+            if (!e.pending) {
+                e.pending = true;
+                e.pending_conf = conf;
+            }
+            double retry = std::min(kThrottledRetrySeconds * double(1 << std::min(e.throttled_count, 16)),
+                                    kMaxThrottledRetrySeconds);
+            if (min_reload_interval_.Seconds() < retry) {
+                e.due = Timestamp::Now() + Duration(retry);
+            }
+            e.throttled_count++;
+        } else {
+            e.throttled_count = 0;
+        }
+        if (e.pending && running_) {
+            // Requested again while it was running
+            e.queued = true;
+            queue_.push_back(name);
+            cond_.notify_all();
+        }
+
+        if (listener_) {
+            lock.unlock();
+            listener_(name, result);
+            lock.lock();
+        }
+    }
+}
+
+void DoubleBufferingManager::RunWatcher() {
+    int fd = -1;
+#ifdef __linux__
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    std::map<string/*dir*/, int/*watch descriptor*/> dirs;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    Timestamp next_check = Timestamp::Now() + poll_interval_;
+    while (running_) {
+        bool changed = false;
+        if (fd >= 0) {
+#ifdef __linux__
+            for (auto it = dbufs_.begin(); it != dbufs_.end(); ++it) {
+                const string& file = it->second.file;
+                if (file.empty()) {
+                    continue;
+                }
+
+                string dir = FileUtil::GetFileDirName(file);
+                if (dir.empty()) {
+                    dir = (file[0] == '/' ? "/" : ".");
+                }
+
+                if (dirs.find(dir) == dirs.end()) {
+                    // The files are often replaced by renaming, so the
+                    // directory is watched instead of the file. If it fails,
+                    // the file is still checked every poll_interval.
+                    dirs[dir] = inotify_add_watch(fd, dir.c_str(),
+                                                  IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_ATTRIB);
+                }
+            }
+
+            lock.unlock();
+            struct pollfd p;
+            p.fd = fd;
+            p.events = POLLIN;
+            p.revents = 0;
+            if (poll(&p, 1, kInotifyWaitMilliseconds) > 0) {
+                char buf[4096];
+                while (read(fd, buf, sizeof(buf)) > 0) {
+                }
+                changed = true;
+            }
+            lock.lock();
+#endif
+        } else {
+            Timestamp now = Timestamp::Now();
+            if (now < next_check) {
+                cond_.wait_for(lock, ToChrono(next_check - now));
+            }
+        }
+
+        Timestamp now = Timestamp::Now();
+        if (running_ && (changed || !(now < next_check))) {
+            CheckFiles();
+            next_check = now + poll_interval_;
+        }
+    }
+
+#ifdef __linux__
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+}
+
+void DoubleBufferingManager::CheckFiles() {
+    for (auto it = dbufs_.begin(); it != dbufs_.end(); ++it) {
+        Entry& e = it->second;
+        if (e.file.empty()) {
+            continue;
+        }
+
+        int64_t mtime = 0;
+        int64_t size = -1;
+        if (!StatFile(e.file, &mtime, &size)) {
+            continue; // Keep the loaded one until the file comes back
+        }
+
+        if (mtime != e.file_mtime || size != e.file_size) {
+            e.file_mtime = mtime;
+            e.file_size = size;
+            Schedule(it->first, e, e.file);
+        }
+    }
+}
+
 }
@@ -4,47 +4,244 @@
 #include "simcc/ref_object.h"
 #include "simcc/timestamp.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <map>
+#include <thread>
+#include <vector>
 
 namespace simcc {
 
+// @brief Keep the current version of a Target, which is replaced by Reload
+// while the readers are using it.
+//
+// Get takes no lock, it is RCU style: the current Target is one of two slots.
+// A reader counts itself in the reader counter of the slot, takes a reference
+// and leaves. Reload puts the new Target into the other slot, switches the
+// slots, waits for the readers counted in the old slot to leave and then drops
+// the reference of the slot. The readers never wait for Reload, only Reload
+// waits for the readers which are taking a reference. The counters are striped
+// by the thread to keep the readers of different threads off the same cache line.
+//
+// An old Target lives on until its last reader drops it, so a few Reloads in
+// a row may keep several versions alive at the same time. Every Target created
+// by the DoubleBuffering is counted until it is destroyed, and versions()
+// reports them with their references and memory. set_max_versions limits them:
+// Create waits for the old ones to drain before building a new one, and fails
+// if they don't drain in time.
 class SIMCC_EXPORT DoubleBuffering {
+private:
+    struct Versions;
 public:
     class SIMCC_EXPORT Target : public RefObject {
     public:
+        Target() : id_(0) {}
         virtual bool Initialize(const string& conf) = 0;
         virtual string MD5() const { return ""; }
-        virtual ~Target() {}
+
+        // @brief The memory used by the Target after Initialize, which is
+        // reported by DoubleBuffering::versions()
+        virtual size_t MemorySize() const { return 0; }
+
+        virtual ~Target();
+    private:
+        friend class DoubleBuffering;
+        std::shared_ptr<Versions> versions_; // Where it is counted
+        uint64_t id_;
     };
     typedef RefPtr<Target> TargetPtr;
     typedef std::function<TargetPtr ()> TargetCreator;
 
+    // The state of a live Target
+    enum VersionState {
+        kBuilding = 0, // Created and not published yet
+        kCurrent = 1,
+        kRetired = 2, // Replaced and still used by its readers
+    };
+
+    struct VersionStats {
+        uint64_t id; // The sequence of the Targets created by the DoubleBuffering
+        VersionState state;
+        int references; // Held by the readers, or the reloader when it is building
+        size_t memory_size;
+        Timestamp create_time;
+    };
+
+    // @brief A copy of the current Target kept by a reader thread. Get only
+    // reads the version of the DoubleBuffering if it is not reloaded, and it
+    // doesn't touch the reference count of the Target. The copy keeps the old
+    // Target alive until the next Get after a Reload.
+    //
+    // A thread which stops calling Get keeps its old Target alive however
+    // long it idles, and it is counted by set_max_versions. With a limit, the
+    // Reloads fail, or are retried and dropped by the DoubleBufferingManager,
+    // until the idle thread calls Get again.
+    //     thread_local simcc::DoubleBuffering::LocalSnapshot snapshot(&db);
+    //     const simcc::DoubleBuffering::TargetPtr& t = snapshot.Get();
+    class SIMCC_EXPORT LocalSnapshot {
+    public:
+        explicit LocalSnapshot(const DoubleBuffering* db)
+            : db_(db), version_(0) {}
+
+        const TargetPtr& Get() {
+            uint64_t v = db_->version();
+            if (v != version_ || target_.IsNull()) {
+                target_ = db_->Get();
+                version_ = v;
+            }
+            return target_;
+        }
+
+    private:
+        const DoubleBuffering* db_;
+        uint64_t version_;
+        TargetPtr target_;
+    };
+
+public:
     DoubleBuffering(TargetCreator f);
 
+    // @brief Create a new Target with conf and publish it, the same as
+    // Publish(Create(conf))
     bool Reload(const string& conf);
 
+    // @brief Create and initialize a new Target without publishing it. It takes
+    // no lock, so the slow initializations of different confs can run in parallel.
+    // If max_versions Targets are alive, it waits for one of them to be
+    // destroyed, at most the drain_timeout given to set_max_versions.
+    // @param bool * throttled - Set to true if it failed for the live versions
+    // @return the new Target, or NULL if it failed to initialize
+    TargetPtr Create(const string& conf, bool* throttled = NULL) const;
+
+    // @brief Replace the current Target with t atomically
+    void Publish(const TargetPtr& t);
+
     string MD5() const;
 
     Timestamp reload_time() const {
-        return reload_time_;
+        return Timestamp(reload_time_.load(std::memory_order_relaxed));
+    }
+
+    // The count of the successful Reloads
+    uint64_t version() const {
+        return version_.load(std::memory_order_acquire);
     }
 
     TargetPtr Get() const;
 
+    // @brief Limit the Targets alive at the same time, including the current
+    // one and the one being built. It is at least 2 so that a new one can be
+    // built, 0 means no limit, which is the default.
+    // The Targets kept by the idle LocalSnapshots are alive too, see LocalSnapshot.
+    // @param Duration drain_timeout - How long Create waits for an old one to be destroyed
+    void set_max_versions(size_t n, Duration drain_timeout);
+
+    // @brief The Targets which are alive, ordered by id
+    std::vector<VersionStats> versions() const;
+
+    // @brief The memory of the Targets which are alive
+    size_t memory_size() const;
+
 private:
-    mutable std::mutex mutex_;
-    TargetPtr current_;
+    struct ReaderStripe {
+        ReaderStripe() {
+            count[0] = 0;
+            count[1] = 0;
+        }
+        std::atomic<long> count[2]; // The readers of the slots
+        char padding[64];
+    };
+
+    enum { kReaderStripeCount = 16 };
+
+    // The live Targets, shared with them so that they can leave when they
+    // are destroyed after the DoubleBuffering
+    struct Versions {
+        struct Record {
+            const Target* target;
+            size_t memory_size;
+            Timestamp create_time;
+            bool published;
+        };
+
+        Versions() : next_id(0), max_count(0) {}
+        std::mutex mutex;
+        std::condition_variable drained; // Notified when a Target is destroyed
+        std::map<uint64_t/*id*/, Record> records;
+        uint64_t next_id;
+        size_t max_count; // The max size of records, 0 means no limit
+        Duration drain_timeout;
+    };
+
+    // Wait for the readers counted in the slot to leave
+    void WaitForReaders(int slot) const;
+
+    // Count the Target in versions_. The lock of versions_ is held.
+    void AddVersion(Target* t) const;
+
+private:
+    mutable std::mutex mutex_; // The lock of Reload
+    TargetPtr targets_[2];
+    std::atomic<int> current_; // The slot of the current Target
+    mutable ReaderStripe stripes_[kReaderStripeCount];
+
     TargetCreator creator_;
-    Timestamp reload_time_;
+    std::atomic<int64_t> reload_time_;
+    std::atomic<uint64_t> version_;
+    std::shared_ptr<Versions> versions_;
+
+    DoubleBuffering(const DoubleBuffering&);
+    DoubleBuffering& operator=(const DoubleBuffering&);
 };
 
 typedef std::shared_ptr<DoubleBuffering> DoubleBufferingPtr;
 
+// @brief The DoubleBuffering objects by name, which can be reloaded
+// synchronously by Reload or in the background by AsyncReload and Watch.
+//
+// The background reloads run on a pool of worker threads started by Start.
+// Every DoubleBuffering is reloaded by one worker at a time, the requests
+// coming while it is queued or running are merged into one reload of the
+// latest conf, which starts no sooner than min_reload_interval after the
+// previous one. The new Target is built without any lock and then published
+// atomically, unless its MD5() is the same as the current one's, in which
+// case it is dropped and the DoubleBuffering is left untouched. If the
+// DoubleBuffering has too many versions alive (see set_max_versions), the
+// worker waits for them to drain and then retries the reload later, doubling
+// the interval every time. After max_throttled_retries retries in a row it is
+// dropped, since the old versions may be kept by the idle readers forever.
+//
+// Watch reloads a DoubleBuffering with the file path as its conf whenever the
+// modification time or the size of the file changes. On Linux the watcher is
+// woken up by inotify, elsewhere or if inotify fails the files are checked
+// every poll_interval. The files should be replaced atomically, e.g. written
+// to a temporary file and renamed, or a half written file may be loaded.
+//     simcc::DoubleBufferingManager m;
+//     m.Add("dict", "/data/dict.txt", &CreateDict);
+//     m.Start(2, simcc::Duration(1.0), simcc::Duration(5.0));
+//     m.Watch("dict", "/data/dict.txt");
 class SIMCC_EXPORT DoubleBufferingManager {
+public:
+    // The result of a background reload
+    enum ReloadResult {
+        kReloaded = 0,
+        kUnchanged = 1, // The new Target has the same MD5, it is dropped
+        kFailed = 2,
+        kThrottled = 3, // Too many versions are alive, it is retried later
+        kDropped = 4, // Throttled after max_throttled_retries retries, it is dropped
+    };
+    typedef std::function<void (const string& name, ReloadResult result)> ReloadListener;
+
 public:
     DoubleBufferingManager();
+    ~DoubleBufferingManager();
 
+    // @brief Add a DoubleBuffering and load it with conf synchronously. If the
+    // name is added, it is reloaded with conf.
     bool Add(const string& name,
              const string& conf,
              DoubleBuffering::TargetCreator f);
@@ -52,9 +249,72 @@ public:
     DoubleBuffering* Get(const string& name) const;
     bool Reload(const string& name, const string& conf);
 
+    // @brief Start the worker threads of the background reloads and the watcher
+    // @param size_t worker_count - The max count of the reloads running at the same time
+    // @param Duration min_reload_interval - The min interval of the reloads of a DoubleBuffering
+    // @param Duration poll_interval - The interval of checking the watched files
+    bool Start(size_t worker_count, Duration min_reload_interval, Duration poll_interval);
+
+    // @brief Stop the threads after the running reloads finish. The queued
+    // reloads are dropped. It is called by the destructor.
+    void Stop();
+
+    // @brief Queue a reload of the DoubleBuffering in the background
+    // @return false if the name is not added or the manager is not started
+    bool AsyncReload(const string& name, const string& conf);
+
+    // @brief Reload the DoubleBuffering in the background whenever the file
+    // changes. A DoubleBuffering watches one file at most.
+    bool Watch(const string& name, const string& path);
+
+    // @brief Set the listener called by the worker threads after every
+    // background reload. Set it before Start.
+    void set_listener(const ReloadListener& f) {
+        listener_ = f;
+    }
+
+    // @brief Set the max retries of a throttled reload, 10 by default. Set it before Start.
+    void set_max_throttled_retries(int n) {
+        max_throttled_retries_ = n;
+    }
+
+private:
+    struct Entry {
+        Entry() : pending(false), queued(false), running(false), throttled_count(0), file_mtime(0), file_size(-1) {}
+        DoubleBufferingPtr db;
+
+        // The background reload
+        string pending_conf; // The conf of the next reload
+        bool pending; // The next reload is requested
+        bool queued;  // It is in queue_ waiting for a worker
+        bool running; // A worker is reloading it
+        Timestamp due; // The next reload does not start before it
+        int throttled_count; // The reload of pending_conf is throttled in a row
+
+        // The watched file
+        string file;
+        int64_t file_mtime;
+        int64_t file_size;
+    };
+
+    void Schedule(const string& name, Entry& e, const string& conf);
+    void RunWorker();
+    void RunWatcher();
+    void CheckFiles();
+
 private:
-    std::map<string/*name*/, DoubleBufferingPtr> dbufs_;
+    std::map<string/*name*/, Entry> dbufs_;
     mutable std::mutex mutex_;
+
+    std::condition_variable cond_; // Notifies the workers and the watcher
+    std::deque<string> queue_; // The names waiting for a worker
+    std::vector<std::thread> workers_;
+    std::thread watcher_;
+    bool running_;
+    Duration min_reload_interval_;
+    Duration poll_interval_;
+    int max_throttled_retries_;
+    ReloadListener listener_;
 };
 
 }
@@ -14,39 +14,84 @@
  *  3. Add value deleter(optional)
  *  4. Change LRUCacheH4Value::Value : use a pointer to optimize the memory use
  *  5. MS-VC compatible compile pass
+ *  6. Add per-item TTL
+ *  7. Add the statistics and the ghost list
+ *  8. Make the per-item TTL optional
  */
 
+#pragma once
+
+#include <stdint.h>
+
 #include <sstream>
 #include <cassert>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <type_traits>
+#include <vector>
 #include <unordered_map>
 #include <functional>
 
 namespace simcc {
 
 // Bucket
-template<class K, class V>
+// The items of the caches with TTL (kTTL is true) have 3 more fields for the
+// expire time and the timer wheel, which are counted in the memory size.
+template<class K, class V, bool kTTL = false>
 struct LRUCacheH4Value {
-    typedef LRUCacheH4Value<K, V> Value;
+    typedef LRUCacheH4Value<K, V, kTTL> Value;
 
     LRUCacheH4Value()
-        : older(NULL), newer(NULL) {}
+        : key(NULL), older(NULL), newer(NULL) {}
 
     LRUCacheH4Value(const V& v, Value* o, Value* n)
-        : value(v), older(o), newer(n) {}
+        : value(v), key(NULL), older(o), newer(n) {}
 
     V value;
     const K* key;
-    LRUCacheH4Value<K, V>* older; // The older element. It is the same as a previous node for a link list.
-    LRUCacheH4Value<K, V>* newer; // The newer element. It is the same as a next node for a link list.
+    Value* older; // The older element. It is the same as a previous node for a link list.
+    Value* newer; // The newer element. It is the same as a next node for a link list.
 };
 
+template<class K, class V>
+struct LRUCacheH4Value<K, V, true> {
+    typedef LRUCacheH4Value<K, V, true> Value;
+
+    LRUCacheH4Value()
+        : key(NULL), older(NULL), newer(NULL), expire_ms(0), wheel_prev(NULL), wheel_next(NULL) {}
+
+    LRUCacheH4Value(const V& v, Value* o, Value* n)
+        : value(v), key(NULL), older(o), newer(n), expire_ms(0), wheel_prev(NULL), wheel_next(NULL) {}
+
+    V value;
+    const K* key;
+    Value* older;
+    Value* newer;
+
+    int64_t expire_ms; // 0 means it never expires
+    Value* wheel_prev; // The link list of the timer wheel slot
+    Value* wheel_next;
+};
+
+// The expire time of an item, 0 means it never expires
+template<class K, class V>
+inline int64_t LRUCacheH4ExpireMs(const LRUCacheH4Value<K, V, false>&) {
+    return 0;
+}
 
-// Const Iterator
 template<class K, class V>
+inline int64_t LRUCacheH4ExpireMs(const LRUCacheH4Value<K, V, true>& v) {
+    return v.expire_ms;
+}
+
+
+// Const Iterator
+template<class K, class V, bool kTTL = false>
 class LRUCacheH4ConstIterator { //
 public:
-    typedef LRUCacheH4Value<K, V> Value;
-    typedef LRUCacheH4ConstIterator<K, V> const_iterator;
+    typedef LRUCacheH4Value<K, V, kTTL> Value;
+    typedef LRUCacheH4ConstIterator<K, V, kTTL> const_iterator;
     typedef Value& reference;
     typedef Value* pointer;
 
@@ -67,6 +112,7 @@ public:
 
     const K& key() const;
     const V& value() const;
+    int64_t expire_ms() const; // 0 means it never expires
 
 private:
     const Value* ptr_;
@@ -74,49 +120,55 @@ private:
 };
 
 
-template<class K, class V>
-LRUCacheH4ConstIterator<K, V>::LRUCacheH4ConstIterator(
-    const typename LRUCacheH4ConstIterator<K, V>::Value* ptr,
-    typename LRUCacheH4ConstIterator<K, V>::Direction dir)
+template<class K, class V, bool T>
+LRUCacheH4ConstIterator<K, V, T>::LRUCacheH4ConstIterator(
+    const typename LRUCacheH4ConstIterator<K, V, T>::Value* ptr,
+    typename LRUCacheH4ConstIterator<K, V, T>::Direction dir)
     : ptr_(ptr), dir_(dir) {
 }
 
-template<class K, class V>
-LRUCacheH4ConstIterator<K, V>& LRUCacheH4ConstIterator<K, V>::operator++() {
+template<class K, class V, bool T>
+LRUCacheH4ConstIterator<K, V, T>& LRUCacheH4ConstIterator<K, V, T>::operator++() {
     assert(ptr_);
-    ptr_ = (dir_ == LRUCacheH4ConstIterator<K, V>::kMRU2LRU ? ptr_->older : ptr_->newer);
+    ptr_ = (dir_ == LRUCacheH4ConstIterator<K, V, T>::kMRU2LRU ? ptr_->older : ptr_->newer);
     return *this;
 }
 
-template<class K, class V>
-LRUCacheH4ConstIterator<K, V> LRUCacheH4ConstIterator<K, V>::operator++(int) {
+template<class K, class V, bool T>
+LRUCacheH4ConstIterator<K, V, T> LRUCacheH4ConstIterator<K, V, T>::operator++(int) {
     const_iterator ret = *this;
     ++*this;
     return ret;
 }
 
-template<class K, class V>
-bool LRUCacheH4ConstIterator<K, V>::operator==(const const_iterator& other) {
+template<class K, class V, bool T>
+bool LRUCacheH4ConstIterator<K, V, T>::operator==(const const_iterator& other) {
     return ptr_ == other.ptr_;
 }
 
-template<class K, class V>
-bool LRUCacheH4ConstIterator<K, V>::operator!=(const const_iterator& other) {
+template<class K, class V, bool T>
+bool LRUCacheH4ConstIterator<K, V, T>::operator!=(const const_iterator& other) {
     return ptr_ != other.ptr_;
 }
 
-template<class K, class V>
-const K& LRUCacheH4ConstIterator<K, V>::key() const {
+template<class K, class V, bool T>
+const K& LRUCacheH4ConstIterator<K, V, T>::key() const {
     assert(ptr_);
     return *(ptr_->key);
 }
 
-template<class K, class V>
-const V& LRUCacheH4ConstIterator<K, V>::value() const {
+template<class K, class V, bool T>
+const V& LRUCacheH4ConstIterator<K, V, T>::value() const {
     assert(ptr_);
     return ptr_->value;
 }
 
+template<class K, class V, bool T>
+int64_t LRUCacheH4ConstIterator<K, V, T>::expire_ms() const {
+    assert(ptr_);
+    return LRUCacheH4ExpireMs(*ptr_);
+}
+
 
 //-------------------------------------------------------------
 // default functor
@@ -135,17 +187,69 @@ struct NonFunctor : public std::unary_function<V, void>
     void operator()(V&) const {}
 };
 
+// @brief The counters of an LRU cache, see LRUCacheH4::stats().
+// Use ToJSON of lru_stats.h to dump it.
+struct LRUCacheStats {
+    enum { kGhostBucketCount = 16 };
+
+    LRUCacheStats()
+        : hits(0), misses(0), inserts(0), updates(0)
+        , evictions_by_count(0), evictions_by_memory(0), expirations(0), erases(0), evicted_bytes(0)
+        , size(0), memory_size(0), max_size(0), max_memory_size(0), ghost_size(0)
+        , ghost_hits(kGhostBucketCount, 0) {}
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t inserts; // the new keys
+    uint64_t updates; // the existing keys inserted again
+    uint64_t evictions_by_count; // evicted because of max_size
+    uint64_t evictions_by_memory; // evicted because of max_memory_size
+    uint64_t expirations;
+    uint64_t erases;
+    uint64_t evicted_bytes; // the memory size of the evicted items
+
+    size_t size;
+    size_t memory_size;
+    size_t max_size;
+    size_t max_memory_size;
+
+    // The misses whose keys are in the ghost list of the last ghost_size
+    // evicted keys. ghost_hits[i] would be hits if the cache could hold
+    // (i + 1) * ghost_size / kGhostBucketCount more items.
+    size_t ghost_size;
+    std::vector<uint64_t> ghost_hits;
+
+    double hit_ratio() const {
+        return hits + misses == 0 ? 0.0 : double(hits) / double(hits + misses);
+    }
+
+    // @brief The estimated hit ratio if the cache could hold extra_items more items
+    // @param size_t extra_items - Counted in the buckets of the ghost list, no more than ghost_size
+    double EstimatedHitRatio(size_t extra_items) const {
+        uint64_t h = hits;
+        for (size_t i = 0; i < ghost_hits.size() && ghost_size > 0; ++i) {
+            if ((i + 1) * ghost_size / kGhostBucketCount <= extra_items) {
+                h += ghost_hits[i];
+            }
+        }
+        return hits + misses == 0 ? 0.0 : double(h) / double(hits + misses);
+    }
+};
+
 // LRU Cache
 template<
     class K,
     class V,
     class S = SizeofFunctor<V>,
-    class D = NonFunctor<V>>
+    class D = NonFunctor<V>,
+    bool kTTL = false>
 class LRUCacheH4 {
 public:
-    typedef LRUCacheH4ConstIterator<K, V> const_iterator;
-    typedef LRUCacheH4ConstIterator<K, V> iterator;
-    typedef typename LRUCacheH4ConstIterator<K, V>::Direction Direction;
+    typedef LRUCacheH4ConstIterator<K, V, kTTL> const_iterator;
+    typedef LRUCacheH4ConstIterator<K, V, kTTL> iterator;
+    typedef typename LRUCacheH4ConstIterator<K, V, kTTL>::Direction Direction;
+    typedef K key_type;
+    typedef V mapped_type;
 
 public:
     LRUCacheH4(size_t max_item_count, size_t max_memery_size_bytes,
@@ -157,6 +261,12 @@ public:
     void Insert(const K& key, const V& value) {
         insert(key, value);
     }
+    void Insert(const K& key, const V& value, int64_t ttl_ms) {
+        insert(key, value, ttl_ms);
+    }
+    bool Erase(const K& key) {
+        return erase(key);
+    }
     const_iterator Find(const K& key) {
         return find(key);
     }
@@ -176,9 +286,11 @@ public:
 
 public:
     // compatible for STL interface
-    void insert(const K& key, const V& value);
-    const_iterator find(const K& key); // updates the MRU
-    const_iterator find(const K& key) const; // does not update the MRU
+    void insert(const K& key, const V& value); // expires after default_ttl_ms
+    void insert(const K& key, const V& value, int64_t ttl_ms); // 0 means it never expires
+    bool erase(const K& key);
+    const_iterator find(const K& key); // updates the MRU, the expired item is removed and missed
+    const_iterator find(const K& key) const; // does not update the MRU, the expired item is missed
     const_iterator mru_begin() const; // from MRU to LRU, from latest to oldest
     const_iterator lru_begin() const; // from LRU to MRU, from oldest to latest
     const_iterator end() const;
@@ -189,6 +301,40 @@ public:
     // WARNING : Only for debug
     void Dump(std::ostream& os, typename const_iterator::Direction dir) const;
 
+public:
+    // The TTLs work only if kTTL is true, which adds 24 bytes to every item
+    // on 64-bit platforms. Without it the TTLs are ignored and never expire.
+    // The expired items are removed by a timer wheel of kWheelSlotCount slots
+    // of ttl_resolution_ms. insert and find turn the wheel, and it can also be
+    // turned by RemoveExpired from a timer. An item with a TTL longer than the
+    // round of the wheel is checked once a round until it expires.
+    // The iterators may still meet the expired items which are not removed yet.
+    enum { kWheelSlotCount = 512 };
+
+    // @brief The milliseconds from any fixed point, std::chrono::steady_clock by default
+    typedef int64_t (*Clock)();
+
+    // @brief Remove all the expired items
+    // @return the count of the removed items
+    size_t RemoveExpired();
+
+public:
+    // The counters are relaxed atomics, so the const find can be called by
+    // the readers concurrently. stats() reads the size, the memory size and
+    // the limits too, which the writers change, so it must be called under
+    // the lock of the cache like the other members.
+    // The ghost list keeps the last ghost_size keys evicted because of the
+    // limits (not the expired or erased ones). A miss of a key in it would be
+    // a hit of a larger cache, so the hit ratio of the larger sizes can be
+    // estimated from the data. It is disabled by default.
+    LRUCacheStats stats() const;
+    void ResetStats();
+
+    size_t ghost_size() const {
+        return ghost_size_;
+    }
+    void set_ghost_size(size_t n);
+
 public:
     size_t size() const {
         return map_.size();
@@ -211,10 +357,32 @@ public:
     void set_max_memory_size(size_t v) {
         max_memory_size_ = v;
     }
+    int64_t default_ttl_ms() const {
+        return default_ttl_ms_;
+    }
+    void set_default_ttl_ms(int64_t v) {
+        default_ttl_ms_ = v;
+    }
+    int64_t ttl_resolution_ms() const {
+        return ttl_resolution_ms_;
+    }
+    // It can only be changed before any item with a TTL is inserted
+    void set_ttl_resolution_ms(int64_t v) {
+        assert(ttl_count_ == 0);
+        ttl_resolution_ms_ = v > 0 ? v : 1;
+    }
+    void set_clock(Clock c) {
+        clock_ = c;
+    }
+    // The time of the clock, to compare with the expire_ms of the items
+    int64_t now_ms() const {
+        return clock_();
+    }
 
 private:
-    typedef LRUCacheH4Value<K, V> Value;
+    typedef LRUCacheH4Value<K, V, kTTL> Value;
     typedef std::unordered_map<K, Value> map;
+    typedef std::atomic<uint64_t> Counter;
 
 private:
     Value* UpdateOrInsert(const K& key);
@@ -223,10 +391,44 @@ private:
 
 private:
     void TryRemoveLRU();
+    void Remove(Value* v);
+
+    // The TTL functions do nothing without kTTL, the items never expire
+    typedef std::integral_constant<bool, kTTL> HasTTL;
+    void SetExpire(Value* v, int64_t ttl_ms, int64_t now) {
+        SetExpire(v, ttl_ms, now, HasTTL());
+    }
+    void SetExpire(Value* v, int64_t ttl_ms, int64_t now, std::true_type);
+    void SetExpire(Value*, int64_t, int64_t, std::false_type) {}
+
+    void UnlinkWheel(Value* v) {
+        UnlinkWheel(v, HasTTL());
+    }
+    void UnlinkWheel(Value* v, std::true_type);
+    void UnlinkWheel(Value*, std::false_type) {}
+
+    // Remove the expired items of the slots which are passed
+    size_t TurnWheel(int64_t now) {
+        return TurnWheel(now, HasTTL());
+    }
+    size_t TurnWheel(int64_t now, std::true_type);
+    size_t TurnWheel(int64_t, std::false_type) {
+        return 0;
+    }
+
+    static void Count(Counter& c, uint64_t n = 1) {
+        c.fetch_add(n, std::memory_order_relaxed);
+    }
+    void CountMiss(const K& key) const;
+    void AddGhost(const K& key);
+
+    static int64_t SteadyClock() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
     size_t ValueSize(const V& value) {
         // The size of K and V is will be calculated by sizeof_
         auto user_size = sizeof_(value);
-        auto local_size = sizeof(LRUCacheH4Value<K, V>);
+        auto local_size = sizeof(Value);
         return user_size + local_size - sizeof(value);
     }
 
@@ -238,6 +440,29 @@ private:
     size_t max_memory_size_;// The max memory size
     size_t memory_size_;// The current memory size
 
+    std::vector<Value*> wheel_; // The timer wheel, allocated with the first item with a TTL
+    int64_t wheel_tick_; // The last tick whose slot is done
+    int64_t ttl_resolution_ms_;
+    int64_t default_ttl_ms_;
+    size_t ttl_count_; // The count of the items in the wheel
+    Clock clock_;
+
+    mutable Counter hits_;
+    mutable Counter misses_;
+    Counter inserts_;
+    Counter updates_;
+    Counter evictions_by_count_;
+    Counter evictions_by_memory_;
+    Counter expirations_;
+    Counter erases_;
+    Counter evicted_bytes_;
+
+    size_t ghost_size_;
+    uint64_t ghost_seq_; // The count of the keys added to the ghost list
+    std::unordered_map<K, uint64_t> ghost_; // key -> its ghost_seq_
+    std::deque<std::pair<uint64_t, K>> ghost_fifo_; // Oldest first, with the stale ones of the keys inserted again
+    mutable Counter ghost_hits_[LRUCacheStats::kGhostBucketCount];
+
     S sizeof_;
     D deleter_;
 
@@ -248,15 +473,35 @@ private:
 
 
 // Reserve enough space to avoid resizing later on and thus invalidate iterators
-template<class K, class V, class S, class D>
-LRUCacheH4<K, V, S, D>::LRUCacheH4(size_t maxsize, size_t maxmemsize, S f, D d)
+template<class K, class V, class S, class D, bool T>
+LRUCacheH4<K, V, S, D, T>::LRUCacheH4(size_t maxsize, size_t maxmemsize, S f, D d)
     : mru_(NULL)
     , lru_(NULL)
     , max_size_(maxsize)
     , max_memory_size_(maxmemsize)
     , memory_size_(0)
+    , wheel_tick_(0)
+    , ttl_resolution_ms_(100)
+    , default_ttl_ms_(0)
+    , ttl_count_(0)
+    , clock_(&SteadyClock)
+    , hits_(0)
+    , misses_(0)
+    , inserts_(0)
+    , updates_(0)
+    , evictions_by_count_(0)
+    , evictions_by_memory_(0)
+    , expirations_(0)
+    , erases_(0)
+    , evicted_bytes_(0)
+    , ghost_size_(0)
+    , ghost_seq_(0)
     , sizeof_(f)
     , deleter_(d) {
+    for (size_t i = 0; i < LRUCacheStats::kGhostBucketCount; ++i) {
+        ghost_hits_[i] = 0;
+    }
+
     if (max_size_ == 0) {
         max_size_ = 1;
     }
@@ -266,48 +511,185 @@ LRUCacheH4<K, V, S, D>::LRUCacheH4(size_t maxsize, size_t maxmemsize, S f, D d)
     }
 }
 
-template<class K, class V, class S, class D>
-LRUCacheH4<K, V, S, D>::~LRUCacheH4() {
+template<class K, class V, class S, class D, bool T>
+LRUCacheH4<K, V, S, D, T>::~LRUCacheH4() {
     for (const_iterator it = lru_begin(); it != end(); ++it) {
         deleter_(const_cast<V&>(it.value()));
     }
 }
 
-template<class K, class V, class S, class D>
-V& LRUCacheH4<K, V, S, D>::operator[](const K& key) {
+template<class K, class V, class S, class D, bool T>
+V& LRUCacheH4<K, V, S, D, T>::operator[](const K& key) {
     return UpdateOrInsert(key)->value;
 }
 
-template<class K, class V, class S, class D>
-void LRUCacheH4<K, V, S, D>::insert(const K& key, const V& value) {
-    UpdateOrInsert(key)->value = value;
+template<class K, class V, class S, class D, bool T>
+void LRUCacheH4<K, V, S, D, T>::insert(const K& key, const V& value) {
+    insert(key, value, default_ttl_ms_);
+}
+
+template<class K, class V, class S, class D, bool T>
+void LRUCacheH4<K, V, S, D, T>::insert(const K& key, const V& value, int64_t ttl_ms) {
+    int64_t now = 0;
+    if (T && (ttl_ms > 0 || ttl_count_ > 0)) {
+        now = clock_();
+        TurnWheel(now);
+    }
+
+    Value* v = UpdateOrInsert(key);
+    v->value = value;
     memory_size_ += ValueSize(value);
+    SetExpire(v, ttl_ms, now);
+}
+
+template<class K, class V, class S, class D, bool T>
+bool LRUCacheH4<K, V, S, D, T>::erase(const K& key) {
+    typename map::iterator it = map_.find(key);
+    if (it == map_.end()) {
+        return false;
+    }
+
+    Remove(&it->second);
+    Count(erases_);
+    return true;
 }
 
 // updates MRU
-template<class K, class V, class S, class D>
-typename LRUCacheH4<K, V, S, D>::const_iterator LRUCacheH4<K, V, S, D>::find(const K& key) {
+template<class K, class V, class S, class D, bool T>
+typename LRUCacheH4<K, V, S, D, T>::const_iterator LRUCacheH4<K, V, S, D, T>::find(const K& key) {
+    int64_t now = 0;
+    if (ttl_count_ > 0) {
+        now = clock_();
+        TurnWheel(now);
+    }
+
     typename map::iterator it = map_.find(key);
     if (it != map_.end()) {
+        int64_t expire_ms = LRUCacheH4ExpireMs(it->second);
+        if (expire_ms != 0 && expire_ms <= now) {
+            Remove(&it->second);
+            Count(expirations_);
+            CountMiss(key);
+            return end();
+        }
+        Count(hits_);
         return const_iterator(Update(it), const_iterator::kMRU2LRU);
     } else {
+        CountMiss(key);
         return end();
     }
 }
 
 // does not update MRU
-template<class K, class V, class S, class D>
-typename LRUCacheH4<K, V, S, D>::const_iterator LRUCacheH4<K, V, S, D>::find(const K& key) const {
-    typename map::iterator it = map_.find(key);
+template<class K, class V, class S, class D, bool T>
+typename LRUCacheH4<K, V, S, D, T>::const_iterator LRUCacheH4<K, V, S, D, T>::find(const K& key) const {
+    typename map::const_iterator it = map_.find(key);
     if (it != map_.end()) {
-        return const_iterator(&*it, const_iterator::kMRU2LRU);
+        int64_t expire_ms = LRUCacheH4ExpireMs(it->second);
+        if (expire_ms != 0 && expire_ms <= clock_()) {
+            CountMiss(key);
+            return end();
+        }
+        Count(hits_);
+        return const_iterator(&it->second, const_iterator::kMRU2LRU);
     } else {
+        CountMiss(key);
         return end();
     }
 }
 
-template<class K, class V, class S, class D>
-void LRUCacheH4<K, V, S, D>::Dump(std::ostream& os, typename const_iterator::Direction dir) const {
+template<class K, class V, class S, class D, bool T>
+size_t LRUCacheH4<K, V, S, D, T>::RemoveExpired() {
+    if (ttl_count_ == 0) {
+        return 0;
+    }
+    return TurnWheel(clock_());
+}
+
+template<class K, class V, class S, class D, bool T>
+LRUCacheStats LRUCacheH4<K, V, S, D, T>::stats() const {
+    LRUCacheStats s;
+    s.hits = hits_.load(std::memory_order_relaxed);
+    s.misses = misses_.load(std::memory_order_relaxed);
+    s.inserts = inserts_.load(std::memory_order_relaxed);
+    s.updates = updates_.load(std::memory_order_relaxed);
+    s.evictions_by_count = evictions_by_count_.load(std::memory_order_relaxed);
+    s.evictions_by_memory = evictions_by_memory_.load(std::memory_order_relaxed);
+    s.expirations = expirations_.load(std::memory_order_relaxed);
+    s.erases = erases_.load(std::memory_order_relaxed);
+    s.evicted_bytes = evicted_bytes_.load(std::memory_order_relaxed);
+    s.size = size();
+    s.memory_size = memory_size_;
+    s.max_size = max_size_;
+    s.max_memory_size = max_memory_size_;
+    s.ghost_size = ghost_size_;
+    for (size_t i = 0; i < LRUCacheStats::kGhostBucketCount; ++i) {
+        s.ghost_hits[i] = ghost_hits_[i].load(std::memory_order_relaxed);
+    }
+    return s;
+}
+
+template<class K, class V, class S, class D, bool T>
+void LRUCacheH4<K, V, S, D, T>::ResetStats() {
+    hits_ = 0;
+    misses_ = 0;
+    inserts_ = 0;
+    updates_ = 0;
+    evictions_by_count_ = 0;
+    evictions_by_memory_ = 0;
+    expirations_ = 0;
+    erases_ = 0;
+    evicted_bytes_ = 0;
+    for (size_t i = 0; i < LRUCacheStats::kGhostBucketCount; ++i) {
+        ghost_hits_[i] = 0;
+    }
+}
+
+template<class K, class V, class S, class D, bool T>
+void LRUCacheH4<K, V, S, D, T>::set_ghost_size(size_t n) {
+    ghost_size_ = n;
+    while (ghost_fifo_.size() > ghost_size_) {
+        typename std::unordered_map<K, uint64_t>::iterator it = ghost_.find(ghost_fifo_.front().second);
+        if (it != ghost_.end() && it->second == ghost_fifo_.front().first) {
+            ghost_.erase(it);
+        }
+        ghost_fifo_.pop_front();
+    }
+}
+
+template<class K, class V, class S, class D, bool T>
+void LRUCacheH4<K, V, S, D, T>::CountMiss(const K& key) const {
+    Count(misses_);
+    if (ghost_.empty()) {
+        return;
+    }
+
+    typename std::unordered_map<K, uint64_t>::const_iterator it = ghost_.find(key);
+    if (it != ghost_.end()) {
+        // The count of the keys evicted after it, which is about how much larger the cache should be
+        uint64_t distance = ghost_seq_ - it->second - 1;
+        size_t bucket = size_t(distance * LRUCacheStats::kGhostBucketCount / ghost_size_);
+        if (bucket >= LRUCacheStats::kGhostBucketCount) {
+            bucket = LRUCacheStats::kGhostBucketCount - 1;
+        }
+        Count(ghost_hits_[bucket]);
+    }
+}
+
+template<class K, class V, class S, class D, bool T>
+void LRUCacheH4<K, V, S, D, T>::AddGhost(const K& key) {
+    if (ghost_size_ == 0) {
+        return;
+    }
+
+    ghost_[key] = ghost_seq_;
+    ghost_fifo_.push_back(std::make_pair(ghost_seq_, key));
+    ++ghost_seq_;
+    set_ghost_size(ghost_size_); // drop the oldest ones
+}
+
+template<class K, class V, class S, class D, bool T>
+void LRUCacheH4<K, V, S, D, T>::Dump(std::ostream& os, typename const_iterator::Direction dir) const {
     os << __FUNCTION__ << " LRUCacheH4(" << size() << "/" << max_size() << ") memory:(" << memory_size_ << "/" << max_memory_size_ << "): MRU --> LRU: " << std::endl;
     const_iterator it = mru_begin();
     if (dir == const_iterator::kLRU2MRU) {
@@ -318,26 +700,27 @@ void LRUCacheH4<K, V, S, D>::Dump(std::ostream& os, typename const_iterator::Dir
     }
 }
 
-template<class K, class V, class S, class D>
-typename LRUCacheH4<K, V, S, D>::const_iterator LRUCacheH4<K, V, S, D>::mru_begin() const {
+template<class K, class V, class S, class D, bool T>
+typename LRUCacheH4<K, V, S, D, T>::const_iterator LRUCacheH4<K, V, S, D, T>::mru_begin() const {
     return const_iterator(mru_, const_iterator::kMRU2LRU);
 }
 
-template<class K, class V, class S, class D>
-typename LRUCacheH4<K, V, S, D>::const_iterator LRUCacheH4<K, V, S, D>::lru_begin() const {
+template<class K, class V, class S, class D, bool T>
+typename LRUCacheH4<K, V, S, D, T>::const_iterator LRUCacheH4<K, V, S, D, T>::lru_begin() const {
     return const_iterator(lru_, const_iterator::kLRU2MRU);
 }
 
-template<class K, class V, class S, class D>
-typename LRUCacheH4<K, V, S, D>::const_iterator LRUCacheH4<K, V, S, D>::end() const {
+template<class K, class V, class S, class D, bool T>
+typename LRUCacheH4<K, V, S, D, T>::const_iterator LRUCacheH4<K, V, S, D, T>::end() const {
     return const_iterator();
 }
 
-template<class K, class V, class S, class D>
-typename LRUCacheH4<K, V, S, D>::Value* LRUCacheH4<K, V, S, D>::UpdateOrInsert(const K& key) {
+template<class K, class V, class S, class D, bool T>
+typename LRUCacheH4<K, V, S, D, T>::Value* LRUCacheH4<K, V, S, D, T>::UpdateOrInsert(const K& key) {
     typename map::iterator it = map_.find(key);
     if (it != map_.end()) {
-        typename LRUCacheH4<K, V, S, D>::Value* moved = Update(it);
+        typename LRUCacheH4<K, V, S, D, T>::Value* moved = Update(it);
+        Count(updates_);
         assert(memory_size_ >= ValueSize(moved->value));
         memory_size_ -= ValueSize(moved->value);
         deleter_(moved->value);
@@ -347,9 +730,107 @@ typename LRUCacheH4<K, V, S, D>::Value* LRUCacheH4<K, V, S, D>::UpdateOrInsert(c
     }
 }
 
-template<class K, class V, class S, class D>
-typename LRUCacheH4<K, V, S, D>::Value* LRUCacheH4<K, V, S, D>::Update(typename map::iterator it) {
-    LRUCacheH4Value<K, V>& v = it->second;
+template<class K, class V, class S, class D, bool T>
+void LRUCacheH4<K, V, S, D, T>::Remove(Value* v) {
+    if (v->older) {
+        v->older->newer = v->newer;
+    } else {
+        lru_ = v->newer;
+    }
+
+    if (v->newer) {
+        v->newer->older = v->older;
+    } else {
+        mru_ = v->older;
+    }
+
+    UnlinkWheel(v);
+    memory_size_ -= ValueSize(v->value);
+    deleter_(v->value);
+    map_.erase(*(v->key));
+}
+
+template<class K, class V, class S, class D, bool T>
+void LRUCacheH4<K, V, S, D, T>::SetExpire(Value* v, int64_t ttl_ms, int64_t now, std::true_type) {
+    UnlinkWheel(v);
+    if (ttl_ms <= 0) {
+        v->expire_ms = 0;
+        return;
+    }
+
+    if (wheel_.empty()) {
+        wheel_.resize(kWheelSlotCount);
+        wheel_tick_ = now / ttl_resolution_ms_ - 1;
+    }
+
+    v->expire_ms = now + ttl_ms;
+    Value*& head = wheel_[size_t(v->expire_ms / ttl_resolution_ms_ % kWheelSlotCount)];
+    v->wheel_prev = NULL;
+    v->wheel_next = head;
+    if (head) {
+        head->wheel_prev = v;
+    }
+    head = v;
+    ++ttl_count_;
+}
+
+template<class K, class V, class S, class D, bool T>
+void LRUCacheH4<K, V, S, D, T>::UnlinkWheel(Value* v, std::true_type) {
+    if (v->expire_ms == 0) {
+        return;
+    }
+
+    if (v->wheel_prev) {
+        v->wheel_prev->wheel_next = v->wheel_next;
+    } else {
+        wheel_[size_t(v->expire_ms / ttl_resolution_ms_ % kWheelSlotCount)] = v->wheel_next;
+    }
+
+    if (v->wheel_next) {
+        v->wheel_next->wheel_prev = v->wheel_prev;
+    }
+
+    v->wheel_prev = NULL;
+    v->wheel_next = NULL;
+    v->expire_ms = 0;
+    --ttl_count_;
+}
+
+template<class K, class V, class S, class D, bool T>
+size_t LRUCacheH4<K, V, S, D, T>::TurnWheel(int64_t now, std::true_type) {
+    // The slot of the current tick is not passed yet
+    int64_t last_tick = now / ttl_resolution_ms_ - 1;
+    if (wheel_.empty() || last_tick <= wheel_tick_) {
+        return 0;
+    }
+
+    int64_t first_tick = wheel_tick_ + 1;
+    if (last_tick - first_tick >= kWheelSlotCount) {
+        first_tick = last_tick - kWheelSlotCount + 1;
+    }
+
+    size_t removed = 0;
+    for (int64_t tick = first_tick; tick <= last_tick && ttl_count_ > 0; ++tick) {
+        Value* v = wheel_[size_t(tick % kWheelSlotCount)];
+        while (v) {
+            Value* next = v->wheel_next;
+            // The ones of the later rounds stay
+            if (v->expire_ms <= now) {
+                Remove(v);
+                Count(expirations_);
+                ++removed;
+            }
+            v = next;
+        }
+    }
+
+    wheel_tick_ = last_tick;
+    return removed;
+}
+
+template<class K, class V, class S, class D, bool T>
+typename LRUCacheH4<K, V, S, D, T>::Value* LRUCacheH4<K, V, S, D, T>::Update(typename map::iterator it) {
+    Value& v = it->second;
     Value* older = v.older;
     Value* newer = v.newer;
     Value* moved = &(it->second);
@@ -380,9 +861,13 @@ typename LRUCacheH4<K, V, S, D>::Value* LRUCacheH4<K, V, S, D>::Update(typename
 }
 
 
-template<class K, class V, class S, class D>
-typename LRUCacheH4<K, V, S, D>::Value* LRUCacheH4<K, V, S, D>::Insert(const K& key) {
+template<class K, class V, class S, class D, bool T>
+typename LRUCacheH4<K, V, S, D, T>::Value* LRUCacheH4<K, V, S, D, T>::Insert(const K& key) {
     TryRemoveLRU();
+    Count(inserts_);
+    if (!ghost_.empty()) {
+        ghost_.erase(key);
+    }
 
     // insert key to MRU position
     Value val = Value(V(), mru_, NULL);
@@ -407,8 +892,8 @@ typename LRUCacheH4<K, V, S, D>::Value* LRUCacheH4<K, V, S, D>::Insert(const K&
 }
 
 
-template<class K, class V, class S, class D>
-void LRUCacheH4<K, V, S, D>::TryRemoveLRU() {
+template<class K, class V, class S, class D, bool T>
+void LRUCacheH4<K, V, S, D, T>::TryRemoveLRU() {
     // if we have grown too large, remove LRU
     while (map_.size() >= max_size_ || memory_size_ >= max_memory_size_) {
         if (map_.size() <= 1) {
@@ -423,6 +908,11 @@ void LRUCacheH4<K, V, S, D>::TryRemoveLRU() {
         }
 
         //std::cout << __FUNCTION__ << " item_count=" << map_.size() << " memory_size_=" << memory_size_ << "  ValueSize(old_lru->second.value)=" << ValueSize(old_lru->second.value) << " remove old key: " << old_lru->first <<  std::endl;
+        Count(map_.size() >= max_size_ ? evictions_by_count_ : evictions_by_memory_);
+        Count(evicted_bytes_, ValueSize(old_lru->value));
+        AddGhost(*(old_lru->key));
+
+        UnlinkWheel(old_lru);
         memory_size_ -= long(ValueSize(old_lru->value));
         deleter_(old_lru->value);
         map_.erase(*(old_lru->key));
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <time.h>
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "simcc/data_stream.h"
+#include "lru.h"
+
+namespace simcc {
+
+// @brief Save the items of an LRUCacheH4 to a file and load them back, so a
+// restarted process does not start with a cold cache.
+//
+// The snapshot is "SIMCCLRU", the version, the saving time and the items in
+// the MRU to LRU order. Every item is its key, its value and its remaining TTL
+// in milliseconds (0 if it never expires). The keys and values are written by
+// DataStream, so they must be the types DataStream supports.
+//
+// The items are loaded from LRU to MRU, so the recency is kept. If the cache
+// is smaller than the snapshot, only the most recent items are loaded. The
+// time between saving and loading is taken off the TTLs. A cache without TTL
+// (see LRUCacheH4's kTTL) loads the live items and keeps them without TTL.
+//     simcc::LRUCacheSnapshot::Save(cache, "cache.snapshot");
+//     // ... restart
+//     simcc::LRUCacheSnapshot::Load("cache.snapshot", cache);
+class LRUCacheSnapshot {
+public:
+    enum { kVersion = 1 };
+
+    template<class K, class V, class S, class D, bool T>
+    static bool Write(const LRUCacheH4<K, V, S, D, T>& cache, DataStream& ds);
+
+    template<class K, class V, class S, class D, bool T>
+    static bool Save(const LRUCacheH4<K, V, S, D, T>& cache, const string& filename) {
+        DataStream ds;
+        return Write(cache, ds) && ds.WriteFile(filename);
+    }
+
+    // @param bool skip_existing - Keep the items which are in the cache already,
+    //     since they are newer than the ones of the snapshot
+    template<class K, class V, class S, class D, bool T>
+    static bool Read(DataStream& ds, LRUCacheH4<K, V, S, D, T>& cache, bool skip_existing = false);
+
+    template<class K, class V, class S, class D, bool T>
+    static bool Load(const string& filename, LRUCacheH4<K, V, S, D, T>& cache, bool skip_existing = false) {
+        DataStream ds;
+        return ds.ReadFile(filename) && Read(ds, cache, skip_existing);
+    }
+
+public:
+    template<class K, class V>
+    struct Item {
+        K key;
+        V value;
+        int64_t ttl_ms;
+    };
+
+    // @brief Read the live items of a snapshot in the MRU to LRU order, with
+    //     the TTLs counted to now. The expired ones are dropped.
+    template<class K, class V>
+    static bool ReadItems(DataStream& ds, std::vector<Item<K, V>>& items);
+
+    // @brief Insert the items of [begin, end) in the reverse order
+    // @return the count of the inserted items
+    template<class K, class V, class S, class D, bool T>
+    static size_t Insert(const std::vector<Item<K, V>>& items, size_t begin, size_t end,
+                         LRUCacheH4<K, V, S, D, T>& cache, bool skip_existing);
+
+private:
+    static const char* magic() {
+        return "SIMCCLRU";
+    }
+};
+
+// @brief Load a snapshot in a background thread while the cache is serving.
+// The file is read and parsed without any lock, then the items are inserted
+// in small batches with the mutex of the cache locked. The items inserted
+// by the serving threads meanwhile are kept.
+//     std::mutex mutex; // the lock of the cache
+//     simcc::LRUCacheLoader<Cache> loader;
+//     loader.Start("cache.snapshot", &cache, &mutex);
+template<class Cache>
+class LRUCacheLoader {
+public:
+    enum { kBatchSize = 256 };
+
+    LRUCacheLoader() : done_(true), ok_(false), loaded_(0) {}
+    ~LRUCacheLoader() {
+        Wait();
+    }
+
+    // @return false if the last one is still running
+    bool Start(const string& filename, Cache* cache, std::mutex* mutex);
+
+    void Wait() {
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    bool done() const {
+        return done_;
+    }
+    // Whether the snapshot is loaded successfully, valid after done
+    bool ok() const {
+        return ok_;
+    }
+    size_t loaded() const {
+        return loaded_;
+    }
+
+private:
+    void Run(string filename, Cache* cache, std::mutex* mutex);
+
+private:
+    std::thread thread_;
+    std::atomic<bool> done_;
+    std::atomic<bool> ok_;
+    std::atomic<size_t> loaded_;
+
+    LRUCacheLoader(const LRUCacheLoader&);
+    LRUCacheLoader& operator=(const LRUCacheLoader&);
+};
+
+template<class K, class V, class S, class D, bool T>
+bool LRUCacheSnapshot::Write(const LRUCacheH4<K, V, S, D, T>& cache, DataStream& ds) {
+    int64_t now = cache.now_ms();
+    uint32_t count = 0;
+    typedef typename LRUCacheH4<K, V, S, D, T>::const_iterator const_iterator;
+    for (const_iterator it = cache.mru_begin(); it != cache.end(); ++it) {
+        if (it.expire_ms() == 0 || it.expire_ms() > now) {
+            ++count;
+        }
+    }
+
+    ds.write(magic(), strlen(magic()));
+    ds << uint32_t(kVersion) << int64_t(time(NULL)) << count;
+    for (const_iterator it = cache.mru_begin(); it != cache.end(); ++it) {
+        if (it.expire_ms() == 0 || it.expire_ms() > now) {
+            int64_t ttl_ms = (it.expire_ms() == 0 ? 0 : it.expire_ms() - now);
+            ds << it.key() << it.value() << ttl_ms;
+        }
+    }
+
+    return !ds.IsWriteBad();
+}
+
+template<class K, class V>
+bool LRUCacheSnapshot::ReadItems(DataStream& ds, std::vector<Item<K, V>>& items) {
+    char m[8] = {};
+    uint32_t version = 0;
+    int64_t saved_time = 0;
+    uint32_t count = 0;
+    if (!ds.Read(m, sizeof(m)) || memcmp(m, magic(), sizeof(m)) != 0) {
+        return false;
+    }
+
+    ds >> version >> saved_time >> count;
+    if (ds.IsReadBad() || version != kVersion) {
+        return false;
+    }
+
+    int64_t elapsed_ms = (int64_t(time(NULL)) - saved_time) * 1000;
+    if (elapsed_ms < 0) {
+        elapsed_ms = 0;
+    }
+
+    items.clear();
+    items.reserve(count < ds.GetReadableSize() ? count : ds.GetReadableSize());
+    for (uint32_t i = 0; i < count; ++i) {
+        Item<K, V> item;
+        ds >> item.key >> item.value >> item.ttl_ms;
+        if (ds.IsReadBad()) {
+            return false;
+        }
+
+        if (item.ttl_ms != 0) {
+            item.ttl_ms -= elapsed_ms;
+            if (item.ttl_ms <= 0) {
+                continue; // expired, it must not take the place of a live one
+            }
+        }
+        items.push_back(item);
+    }
+
+    return true;
+}
+
+template<class K, class V, class S, class D, bool T>
+size_t LRUCacheSnapshot::Insert(const std::vector<Item<K, V>>& items, size_t begin, size_t end,
+                                LRUCacheH4<K, V, S, D, T>& cache, bool skip_existing) {
+    const LRUCacheH4<K, V, S, D, T>& const_cache = cache;
+    size_t inserted = 0;
+    for (size_t i = end; i > begin; --i) {
+        const Item<K, V>& item = items[i - 1];
+        if (skip_existing && const_cache.find(item.key) != cache.end()) {
+            continue;
+        }
+
+        cache.insert(item.key, item.value, item.ttl_ms);
+        ++inserted;
+    }
+    return inserted;
+}
+
+template<class K, class V, class S, class D, bool T>
+bool LRUCacheSnapshot::Read(DataStream& ds, LRUCacheH4<K, V, S, D, T>& cache, bool skip_existing) {
+    std::vector<Item<K, V>> items;
+    if (!ReadItems(ds, items)) {
+        return false;
+    }
+
+    size_t n = items.size() < cache.max_size() ? items.size() : cache.max_size();
+    Insert(items, 0, n, cache, skip_existing);
+    return true;
+}
+
+template<class Cache>
+bool LRUCacheLoader<Cache>::Start(const string& filename, Cache* cache, std::mutex* mutex) {
+    if (!done_) {
+        return false;
+    }
+
+    Wait();
+    done_ = false;
+    ok_ = false;
+    loaded_ = 0;
+    thread_ = std::thread(&LRUCacheLoader::Run, this, filename, cache, mutex);
+    return true;
+}
+
+template<class Cache>
+void LRUCacheLoader<Cache>::Run(string filename, Cache* cache, std::mutex* mutex) {
+    typedef LRUCacheSnapshot::Item<typename Cache::key_type, typename Cache::mapped_type> Item;
+    DataStream ds;
+    std::vector<Item> items;
+    if (ds.ReadFile(filename) && LRUCacheSnapshot::ReadItems(ds, items)) {
+        size_t n = items.size() < cache->max_size() ? items.size() : cache->max_size();
+
+        // From the LRU end, so the batches are in the right order
+        for (size_t end = n; end > 0;) {
+            size_t begin = end > kBatchSize ? end - kBatchSize : 0;
+            std::lock_guard<std::mutex> guard(*mutex);
+            loaded_ += LRUCacheSnapshot::Insert(items, begin, end, *cache, true);
+            end = begin;
+        }
+        ok_ = true;
+    }
+
+    done_ = true;
+}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "simcc/json/json.h"
+#include "lru.h"
+
+namespace simcc {
+
+// @brief Dump the stats of an LRU cache as a JSON object :
+//     {"hits":..., "misses":..., ..., "hit_ratio":0.8,
+//      "estimated":[{"max_size":..., "max_memory_size":..., "hit_ratio":0.85}, ...]}
+// The "estimated" ones are from the ghost list, one for each bucket of it.
+// Their max_memory_size is counted by the average item size of the cache now,
+// which helps to choose max_memery_size_bytes.
+//     cache.set_ghost_size(cache.max_size());
+//     // ... serving
+//     LOG(INFO) << simcc::ToJSON(cache.stats())->ToString();
+inline json::JSONObjectPtr ToJSON(const LRUCacheStats& stats) {
+    json::JSONObjectPtr jo(new json::JSONObject);
+    jo->Put("hits", int64(stats.hits));
+    jo->Put("misses", int64(stats.misses));
+    jo->Put("inserts", int64(stats.inserts));
+    jo->Put("updates", int64(stats.updates));
+    jo->Put("evictions_by_count", int64(stats.evictions_by_count));
+    jo->Put("evictions_by_memory", int64(stats.evictions_by_memory));
+    jo->Put("expirations", int64(stats.expirations));
+    jo->Put("erases", int64(stats.erases));
+    jo->Put("evicted_bytes", int64(stats.evicted_bytes));
+    jo->Put("size", int64(stats.size));
+    jo->Put("memory_size", int64(stats.memory_size));
+    jo->Put("max_size", int64(stats.max_size));
+    jo->Put("max_memory_size", int64(stats.max_memory_size == size_t(-1) ? 0 : stats.max_memory_size));
+    jo->Put("hit_ratio", float64(stats.hit_ratio()));
+
+    if (stats.ghost_size > 0) {
+        double item_size = stats.size == 0 ? 0.0 : double(stats.memory_size) / double(stats.size);
+        json::JSONArray* estimated = new json::JSONArray;
+        for (size_t i = 0; i < LRUCacheStats::kGhostBucketCount; ++i) {
+            size_t extra = (i + 1) * stats.ghost_size / LRUCacheStats::kGhostBucketCount;
+            if (extra == 0) {
+                continue;
+            }
+
+            json::JSONObject* e = new json::JSONObject;
+            e->Put("max_size", int64(stats.max_size + extra));
+            e->Put("max_memory_size", int64(item_size * double(stats.max_size + extra)));
+            e->Put("hit_ratio", float64(stats.EstimatedHitRatio(extra)));
+            estimated->Put(e);
+        }
+        jo->Put("ghost_size", int64(stats.ghost_size));
+        jo->Put("estimated", estimated);
+    }
+
+    return jo;
+}
+}
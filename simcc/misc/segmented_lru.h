@@ -0,0 +1,393 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <list>
+#include <vector>
+#include <unordered_map>
+
+#include "lru.h"
+
+namespace simcc {
+
+// @brief The admission policy of SegmentedLRUCache which admits every new item,
+// so the cache works as a plain segmented LRU (SLRU).
+struct AlwaysAdmit {
+    void Reserve(size_t /*max_item_count*/) {}
+    void Record(size_t /*hash*/) {}
+    bool Admit(size_t /*candidate_hash*/, size_t /*victim_hash*/) {
+        return true;
+    }
+};
+
+// @brief The TinyLFU admission policy of SegmentedLRUCache. The access
+// frequencies of the keys are estimated by a count-min sketch of 4 rows of
+// counters saturating at 15. All the counters are halved after 10 times
+// max_item_count accesses, so the old popularity fades out.
+//
+// A new item only replaces the victim of the main segments if it is accessed
+// more often, so a burst of one-off keys can't flush the working set.
+class TinyLFUAdmission {
+public:
+    enum {
+        kDepth = 4,
+        kMaxCount = 15,
+    };
+
+    TinyLFUAdmission() : mask_(0), additions_(0), sample_size_(0) {}
+
+    void Reserve(size_t max_item_count) {
+        size_t width = 16;
+        while (width < max_item_count) {
+            width <<= 1;
+        }
+        counters_.assign(width * kDepth, 0);
+        mask_ = width - 1;
+        additions_ = 0;
+        sample_size_ = max_item_count * 10;
+    }
+
+    void Record(size_t hash) {
+        bool added = false;
+        for (size_t i = 0; i < kDepth; ++i) {
+            uint8_t& c = counters_[Index(hash, i)];
+            if (c < kMaxCount) {
+                ++c;
+                added = true;
+            }
+        }
+
+        if (added && ++additions_ >= sample_size_) {
+            Age();
+        }
+    }
+
+    size_t Estimate(size_t hash) const {
+        size_t n = kMaxCount;
+        for (size_t i = 0; i < kDepth; ++i) {
+            size_t c = counters_[Index(hash, i)];
+            if (c < n) {
+                n = c;
+            }
+        }
+        return n;
+    }
+
+    bool Admit(size_t candidate_hash, size_t victim_hash) {
+        return Estimate(candidate_hash) > Estimate(victim_hash);
+    }
+
+private:
+    size_t Index(size_t hash, size_t row) const {
+        // Every row has its own seed
+        static const uint64_t kSeeds[kDepth] = {
+            0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL,
+            0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL
+        };
+        uint64_t h = (uint64_t(hash) + kSeeds[row]) * kSeeds[row];
+        h += h >> 32;
+        return row * (mask_ + 1) + (size_t(h) & mask_);
+    }
+
+    void Age() {
+        for (size_t i = 0; i < counters_.size(); ++i) {
+            counters_[i] >>= 1;
+        }
+        additions_ /= 2;
+    }
+
+private:
+    std::vector<uint8_t> counters_;
+    size_t mask_;
+    size_t additions_;
+    size_t sample_size_;
+};
+
+// @brief A scan resistant cache made of three LRU segments, in the way of
+// W-TinyLFU:
+//  - window: the new items come here first. It takes window_percent of the items.
+//  - probation: the items evicted from the window stay here until they are hit again.
+//  - protected: the items hit in probation. It takes 80% of the main segments, and
+//      its LRU item is moved back to probation when it is full.
+//
+// When the window is full, its LRU item becomes a candidate of the main segments.
+// If they are full too, the admission policy A compares the candidate with the
+// LRU item of probation and only one of them is kept. With AlwaysAdmit it is a
+// segmented LRU, with TinyLFUAdmission it is W-TinyLFU.
+//
+// It is not thread safe, the same as LRUCacheH4.
+//     simcc::SegmentedLRUCache<std::string, int, simcc::TinyLFUAdmission> cache(10000, 0);
+//     cache.Insert("key", 1);
+//     int* v = cache.Find("key");
+template<
+    class K,
+    class V,
+    class A = AlwaysAdmit,
+    class S = SizeofFunctor<V>,
+    class D = NonFunctor<V>,
+    class H = std::hash<K>>
+class SegmentedLRUCache {
+public:
+    // @param size_t max_memery_size_bytes - 0 means no limit
+    // @param size_t window_percent - The percent of the items in the window segment
+    SegmentedLRUCache(size_t max_item_count, size_t max_memery_size_bytes,
+                      size_t window_percent = 1,
+                      S s = S(), D d = D(), A a = A(), H h = H());
+    ~SegmentedLRUCache();
+
+    // @brief Insert or replace the value of the key. It is not an access of
+    //     the admission policy, the Find before it has recorded one already.
+    void Insert(const K& key, const V& value);
+
+    // @brief Find the value and record the access
+    // @return NULL if it is not found. The pointer is valid until the next Insert or Erase.
+    V* Find(const K& key);
+
+    // @return false if it is not found
+    bool Erase(const K& key);
+
+    // @brief Call f(const K&, const V&) for all the items from MRU to LRU of
+    //     the window, protected and probation segments
+    template<class F>
+    void ForEach(F f) const {
+        for (int i = 0; i < kSegmentCount; ++i) {
+            for (typename List::const_iterator it = segments_[i].begin(); it != segments_[i].end(); ++it) {
+                f(it->key, it->value);
+            }
+        }
+    }
+
+public:
+    size_t size() const {
+        return map_.size();
+    }
+    size_t memory_size() const {
+        return memory_size_;
+    }
+    bool empty() const {
+        return map_.empty();
+    }
+    size_t max_size() const {
+        return max_size_;
+    }
+    size_t max_memory_size() const {
+        return max_memory_size_;
+    }
+    size_t window_size() const {
+        return segments_[kWindow].size();
+    }
+    size_t probation_size() const {
+        return segments_[kProbation].size();
+    }
+    size_t protected_size() const {
+        return segments_[kProtected].size();
+    }
+
+private:
+    enum Segment {
+        kWindow = 0,
+        kProtected = 1,
+        kProbation = 2,
+        kSegmentCount = 3,
+    };
+
+    struct Node {
+        Node(const K& k, const V& v, size_t h)
+            : key(k), value(v), hash(h), memory_size(0), segment(kWindow) {}
+        K key;
+        V value;
+        size_t hash;
+        size_t memory_size;
+        Segment segment;
+    };
+
+    typedef std::list<Node> List;
+    typedef std::unordered_map<K, typename List::iterator, H> Map;
+
+private:
+    size_t Hash(const K& key) const {
+        uint64_t h = hash_(key);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return size_t(h);
+    }
+
+    size_t ValueSize(const V& value) {
+        return sizeof_(value) + sizeof(Node) - sizeof(value) + sizeof(typename Map::value_type);
+    }
+
+    void MoveTo(typename List::iterator it, Segment segment) {
+        segments_[segment].splice(segments_[segment].begin(), segments_[it->segment], it);
+        it->segment = segment;
+    }
+
+    void OnHit(typename List::iterator it);
+    void EvictWindow();
+    void Remove(typename List::iterator it);
+
+private:
+    List segments_[kSegmentCount];
+    Map map_;
+
+    size_t max_size_;
+    size_t max_memory_size_;
+    size_t memory_size_;
+    size_t max_window_size_;
+    size_t max_protected_size_;
+
+    S sizeof_;
+    D deleter_;
+    A admission_;
+    H hash_;
+
+private:
+    SegmentedLRUCache(const SegmentedLRUCache& rhs);
+    SegmentedLRUCache& operator=(const SegmentedLRUCache& rhs);
+};
+
+template<class K, class V, class A, class S, class D, class H>
+SegmentedLRUCache<K, V, A, S, D, H>::SegmentedLRUCache(size_t maxsize, size_t maxmemsize, size_t window_percent, S s, D d, A a, H h)
+    : max_size_(maxsize)
+    , max_memory_size_(maxmemsize)
+    , memory_size_(0)
+    , sizeof_(s)
+    , deleter_(d)
+    , admission_(a)
+    , hash_(h) {
+    if (max_size_ == 0) {
+        max_size_ = 1;
+    }
+
+    if (max_memory_size_ == 0) {
+        max_memory_size_ = size_t(-1);
+    }
+
+    if (window_percent > 100) {
+        window_percent = 100;
+    }
+
+    max_window_size_ = max_size_ * window_percent / 100;
+    if (max_window_size_ == 0) {
+        max_window_size_ = 1;
+    }
+
+    size_t main_size = max_size_ > max_window_size_ ? max_size_ - max_window_size_ : 0;
+    max_protected_size_ = main_size * 8 / 10;
+    admission_.Reserve(max_size_);
+}
+
+template<class K, class V, class A, class S, class D, class H>
+SegmentedLRUCache<K, V, A, S, D, H>::~SegmentedLRUCache() {
+    for (int i = 0; i < kSegmentCount; ++i) {
+        for (typename List::iterator it = segments_[i].begin(); it != segments_[i].end(); ++it) {
+            deleter_(it->value);
+        }
+    }
+}
+
+template<class K, class V, class A, class S, class D, class H>
+void SegmentedLRUCache<K, V, A, S, D, H>::Insert(const K& key, const V& value) {
+    typename Map::iterator mit = map_.find(key);
+    if (mit != map_.end()) {
+        typename List::iterator it = mit->second;
+        memory_size_ -= it->memory_size;
+        deleter_(it->value);
+        it->value = value;
+        it->memory_size = ValueSize(value);
+        memory_size_ += it->memory_size;
+        OnHit(it);
+    } else {
+        size_t hash = Hash(key);
+        segments_[kWindow].push_front(Node(key, value, hash));
+        typename List::iterator it = segments_[kWindow].begin();
+        it->memory_size = ValueSize(value);
+        memory_size_ += it->memory_size;
+        map_.insert(typename Map::value_type(key, it));
+        if (segments_[kWindow].size() > max_window_size_) {
+            EvictWindow();
+        }
+    }
+
+    // Keep the new one at least
+    while (memory_size_ > max_memory_size_ && map_.size() > 1) {
+        for (int i = kSegmentCount - 1; i >= 0; --i) {
+            if (!segments_[i].empty() && (segments_[i].size() > 1 || i != kWindow)) {
+                Remove(--segments_[i].end());
+                break;
+            }
+        }
+    }
+}
+
+template<class K, class V, class A, class S, class D, class H>
+V* SegmentedLRUCache<K, V, A, S, D, H>::Find(const K& key) {
+    typename Map::iterator mit = map_.find(key);
+    if (mit == map_.end()) {
+        // The misses count too, so a key gets popular before it is cached
+        admission_.Record(Hash(key));
+        return NULL;
+    }
+
+    typename List::iterator it = mit->second;
+    admission_.Record(it->hash);
+    OnHit(it);
+    return &it->value;
+}
+
+template<class K, class V, class A, class S, class D, class H>
+bool SegmentedLRUCache<K, V, A, S, D, H>::Erase(const K& key) {
+    typename Map::iterator mit = map_.find(key);
+    if (mit == map_.end()) {
+        return false;
+    }
+
+    Remove(mit->second);
+    return true;
+}
+
+template<class K, class V, class A, class S, class D, class H>
+void SegmentedLRUCache<K, V, A, S, D, H>::OnHit(typename List::iterator it) {
+    if (it->segment == kWindow) {
+        MoveTo(it, kWindow);
+        return;
+    }
+
+    MoveTo(it, kProtected);
+    if (segments_[kProtected].size() > max_protected_size_) {
+        MoveTo(--segments_[kProtected].end(), kProbation);
+    }
+}
+
+template<class K, class V, class A, class S, class D, class H>
+void SegmentedLRUCache<K, V, A, S, D, H>::EvictWindow() {
+    typename List::iterator candidate = --segments_[kWindow].end();
+    if (map_.size() <= max_size_) {
+        MoveTo(candidate, kProbation);
+        return;
+    }
+
+    // The main segments are full, so either the candidate or the victim goes
+    List& victims = segments_[kProbation].empty() ? segments_[kProtected] : segments_[kProbation];
+    if (victims.empty()) {
+        Remove(candidate);
+        return;
+    }
+
+    typename List::iterator victim = --victims.end();
+    if (admission_.Admit(candidate->hash, victim->hash)) {
+        Remove(victim);
+        MoveTo(candidate, kProbation);
+    } else {
+        Remove(candidate);
+    }
+}
+
+template<class K, class V, class A, class S, class D, class H>
+void SegmentedLRUCache<K, V, A, S, D, H>::Remove(typename List::iterator it) {
+    memory_size_ -= it->memory_size;
+    deleter_(it->value);
+    map_.erase(it->key);
+    segments_[it->segment].erase(it);
+}
+}
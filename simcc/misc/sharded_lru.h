@@ -0,0 +1,240 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <mutex>
+#include <memory>
+#include <vector>
+
+#include "lru.h"
+
+namespace simcc {
+
+// @brief A thread safe LRU cache. The keys are spread over the shards by their
+// hash value. Every shard is an LRUCacheH4 with its own lock and LRU list, so
+// the threads working on different keys seldom wait for each other.
+//
+// The item count limit and the memory size limit are divided evenly among the
+// shards, so they hold approximately for the whole cache.
+//
+// The values can only be touched while their shard is locked, so there is no
+// iterator:
+//     simcc::ShardedLRUCacheH4<std::string, int> lru(10000, 0);
+//     lru.Insert("key", 1);
+//     int v = 0;
+//     if (lru.Find("key", &v)) {
+//         // ...
+//     }
+//     lru.Visit("key", [](int& v) { ++v; });
+template<
+    class K,
+    class V,
+    class S = SizeofFunctor<V>,
+    class D = NonFunctor<V>,
+    class H = std::hash<K>>
+class ShardedLRUCacheH4 {
+public:
+    typedef LRUCacheH4<K, V, S, D> LRUCache;
+
+    enum { kMinShardItemCount = 32 };
+
+    // @param size_t shard_count - It is rounded up to a power of 2, and reduced
+    //     to keep at least kMinShardItemCount items in every shard
+    ShardedLRUCacheH4(size_t max_item_count, size_t max_memery_size_bytes,
+                      size_t shard_count = 16,
+                      S s = S(), D d = D(), H h = H());
+
+    void Insert(const K& key, const V& value) {
+        Shard& shard = GetShard(key);
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        shard.lru.insert(key, value);
+    }
+
+    // @brief Copy the value of the key out and update the MRU
+    // @return false if it is not found
+    bool Find(const K& key, V* value) {
+        return Visit(key, [value](V& v) {
+            *value = v;
+        });
+    }
+
+    // @brief Call f(V&) with the shard locked if the key is found, and update the MRU
+    // @return false if it is not found
+    template<class F>
+    bool Visit(const K& key, F f) {
+        Shard& shard = GetShard(key);
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        typename LRUCache::const_iterator it = shard.lru.find(key);
+        if (it == shard.lru.end()) {
+            return false;
+        }
+
+        f(const_cast<V&>(it.value()));
+        return true;
+    }
+
+    // @brief Call f(V&) with the shard locked. If the key is not found,
+    //     the value returned by create() is inserted first.
+    template<class C, class F>
+    void FindOrInsert(const K& key, C create, F f) {
+        Shard& shard = GetShard(key);
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        typename LRUCache::const_iterator it = shard.lru.find(key);
+        if (it == shard.lru.end()) {
+            shard.lru.insert(key, create());
+            it = shard.lru.mru_begin();
+        }
+
+        f(const_cast<V&>(it.value()));
+    }
+
+    // @brief FindOrInsert of keys[0, n). The keys are grouped by their shards
+    //     first, so every shard is locked once for the whole batch.
+    //     f(size_t i, V&) is called for keys[i], in the order of i among the
+    //     keys of the same shard.
+    template<class C, class F>
+    void FindOrInsertBatch(const K* keys, size_t n, C create, F f);
+
+    // @brief Call f(const K&, const V&) for all the items. The shards are
+    //     locked one by one and every shard is visited from LRU to MRU.
+    template<class F>
+    void ForEach(F f) const {
+        for (size_t i = 0; i < shards_.size(); ++i) {
+            const Shard& shard = *shards_[i];
+            std::lock_guard<std::mutex> guard(shard.mutex);
+            for (typename LRUCache::const_iterator it = shard.lru.lru_begin(); it != shard.lru.end(); ++it) {
+                f(it.key(), it.value());
+            }
+        }
+    }
+
+public:
+    size_t size() const;
+    size_t memory_size() const;
+    size_t max_size() const {
+        return max_size_;
+    }
+    size_t max_memory_size() const {
+        return max_memory_size_;
+    }
+    size_t shard_count() const {
+        return shards_.size();
+    }
+
+private:
+    struct Shard {
+        Shard(size_t max_item_count, size_t max_memery_size_bytes, S s, D d)
+            : lru(max_item_count, max_memery_size_bytes, s, d) {}
+
+        mutable std::mutex mutex; // the lock for lru
+        LRUCache lru;
+        char padding[64]; // keep the locks of the neighbouring shards off the same cache line
+    };
+
+    size_t ShardIndex(const K& key) const {
+        // std::hash of the integers is the identity, so mix the bits up
+        uint64_t h = hash_(key);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return size_t(h) & (shards_.size() - 1);
+    }
+
+    Shard& GetShard(const K& key) {
+        return *shards_[ShardIndex(key)];
+    }
+
+private:
+    std::vector<std::unique_ptr<Shard>> shards_;
+    size_t max_size_;
+    size_t max_memory_size_;
+    H hash_;
+
+private:
+    ShardedLRUCacheH4(const ShardedLRUCacheH4& rhs);
+    ShardedLRUCacheH4& operator=(const ShardedLRUCacheH4& rhs);
+};
+
+template<class K, class V, class S, class D, class H>
+ShardedLRUCacheH4<K, V, S, D, H>::ShardedLRUCacheH4(size_t maxsize, size_t maxmemsize, size_t shard_count, S s, D d, H h)
+    : max_size_(maxsize)
+    , max_memory_size_(maxmemsize)
+    , hash_(h) {
+    size_t n = 1;
+    while (n < shard_count) {
+        n <<= 1;
+    }
+
+    while (n > 1 && max_size_ / n < kMinShardItemCount) {
+        n >>= 1;
+    }
+
+    // LRUCacheH4 takes 0 as no memory limit
+    size_t shard_max_size = (max_size_ + n - 1) / n;
+    size_t shard_max_memory_size = (max_memory_size_ + n - 1) / n;
+    shards_.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        shards_.push_back(std::unique_ptr<Shard>(new Shard(shard_max_size, shard_max_memory_size, s, d)));
+    }
+}
+
+template<class K, class V, class S, class D, class H>
+template<class C, class F>
+void ShardedLRUCacheH4<K, V, S, D, H>::FindOrInsertBatch(const K* keys, size_t n, C create, F f) {
+    // Counting sort of the indexes by their shards
+    std::vector<size_t> shard_of(n);
+    std::vector<size_t> begin(shards_.size() + 1, 0);
+    for (size_t i = 0; i < n; ++i) {
+        shard_of[i] = ShardIndex(keys[i]);
+        ++begin[shard_of[i] + 1];
+    }
+    for (size_t s = 0; s < shards_.size(); ++s) {
+        begin[s + 1] += begin[s];
+    }
+
+    std::vector<size_t> order(n);
+    std::vector<size_t> next(begin.begin(), begin.end() - 1);
+    for (size_t i = 0; i < n; ++i) {
+        order[next[shard_of[i]]++] = i;
+    }
+
+    for (size_t s = 0; s < shards_.size(); ++s) {
+        if (begin[s] == begin[s + 1]) {
+            continue;
+        }
+
+        Shard& shard = *shards_[s];
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        for (size_t j = begin[s]; j < begin[s + 1]; ++j) {
+            size_t i = order[j];
+            typename LRUCache::const_iterator it = shard.lru.find(keys[i]);
+            if (it == shard.lru.end()) {
+                shard.lru.insert(keys[i], create());
+                it = shard.lru.mru_begin();
+            }
+
+            f(i, const_cast<V&>(it.value()));
+        }
+    }
+}
+
+template<class K, class V, class S, class D, class H>
+size_t ShardedLRUCacheH4<K, V, S, D, H>::size() const {
+    size_t n = 0;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        std::lock_guard<std::mutex> guard(shards_[i]->mutex);
+        n += shards_[i]->lru.size();
+    }
+    return n;
+}
+
+template<class K, class V, class S, class D, class H>
+size_t ShardedLRUCacheH4<K, V, S, D, H>::memory_size() const {
+    size_t n = 0;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        std::lock_guard<std::mutex> guard(shards_[i]->mutex);
+        n += shards_[i]->lru.memory_size();
+    }
+    return n;
+}
+}
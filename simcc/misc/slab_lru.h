@@ -0,0 +1,408 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "lru.h"
+
+namespace simcc {
+
+// @brief An LRU cache with the same interface as LRUCacheH4, which does no
+// memory allocation after it is constructed.
+//
+// All the nodes are preallocated in a slab of max_item_count nodes and linked
+// into the LRU list and the free list by their indexes. The keys are indexed
+// by an open-addressing hash table of {node index, hash tag} buckets, so a
+// lookup mostly reads the contiguous buckets and only touches the node of the
+// key itself. Evicting an item reuses its node for the new one.
+//
+// K and V must be default constructible and assignable, the slots of the
+// removed items keep their old key and value until they are reused.
+// It is not thread safe, the same as LRUCacheH4.
+template<
+    class K,
+    class V,
+    class S = SizeofFunctor<V>,
+    class D = NonFunctor<V>,
+    class H = std::hash<K>>
+class SlabLRUCache {
+    struct Node;
+public:
+    class const_iterator {
+    public:
+        enum Direction {
+            kUnknown = 0,
+            kMRU2LRU = 1, // newest to oldest
+            kLRU2MRU = 2, // oldest to newest
+        };
+
+        const_iterator() : nodes_(NULL), index_(kNil), dir_(kUnknown) {}
+        const_iterator(const Node* nodes, uint32_t index, Direction dir)
+            : nodes_(nodes), index_(index), dir_(dir) {}
+
+        const_iterator& operator++() {
+            assert(index_ != kNil);
+            const Node& n = nodes_[index_];
+            index_ = (dir_ == kMRU2LRU ? n.older : n.newer);
+            return *this;
+        }
+        const_iterator operator++(int) {
+            const_iterator ret = *this;
+            ++*this;
+            return ret;
+        }
+
+        // All the end iterators are the same
+        bool operator==(const const_iterator& other) const {
+            return index_ == other.index_ && (index_ == kNil || nodes_ == other.nodes_);
+        }
+        bool operator!=(const const_iterator& other) const {
+            return !(*this == other);
+        }
+
+        const K& key() const {
+            assert(index_ != kNil);
+            return nodes_[index_].key;
+        }
+        const V& value() const {
+            assert(index_ != kNil);
+            return nodes_[index_].value;
+        }
+
+    private:
+        const Node* nodes_;
+        uint32_t index_;
+        Direction dir_;
+    };
+
+    typedef const_iterator iterator;
+    typedef typename const_iterator::Direction Direction;
+
+public:
+    // @param size_t max_item_count - All the nodes are allocated here
+    // @param size_t max_memery_size_bytes - 0 means no limit
+    SlabLRUCache(size_t max_item_count, size_t max_memery_size_bytes,
+                 S s = S(), D d = D(), H h = H());
+    ~SlabLRUCache();
+
+    void Insert(const K& key, const V& value) {
+        insert(key, value);
+    }
+    const_iterator Find(const K& key) {
+        return find(key);
+    }
+    const_iterator Find(const K& key) const {
+        return find(key);
+    }
+    bool Erase(const K& key) {
+        return erase(key);
+    }
+    const_iterator MRUBegin() const {
+        return mru_begin();
+    }
+    const_iterator LRUBegin() const {
+        return lru_begin();
+    }
+    const_iterator End() const {
+        return end();
+    }
+
+public:
+    // compatible for STL interface
+    void insert(const K& key, const V& value);
+    const_iterator find(const K& key); // updates the MRU
+    const_iterator find(const K& key) const; // does not update the MRU
+    bool erase(const K& key);
+    const_iterator mru_begin() const {
+        return const_iterator(&nodes_[0], mru_, const_iterator::kMRU2LRU);
+    }
+    const_iterator lru_begin() const {
+        return const_iterator(&nodes_[0], lru_, const_iterator::kLRU2MRU);
+    }
+    const_iterator end() const {
+        return const_iterator();
+    }
+
+public:
+    size_t size() const {
+        return size_;
+    }
+    size_t memory_size() const {
+        return memory_size_;
+    }
+    bool empty() const {
+        return size_ == 0;
+    }
+    size_t max_size() const {
+        return nodes_.size();
+    }
+    size_t max_memory_size() const {
+        return max_memory_size_;
+    }
+
+private:
+    enum { kNil = 0xffffffff };
+
+    struct Node {
+        Node() : hash(0), memory_size(0), older(kNil), newer(kNil) {}
+        K key;
+        V value;
+        size_t hash;
+        size_t memory_size;
+        uint32_t older; // the older node in the LRU list
+        uint32_t newer; // the newer node in the LRU list, or the next free node
+    };
+
+    struct Bucket {
+        uint32_t node; // kNil if it is empty
+        uint32_t tag;  // the high bits of the hash, to skip the other keys without touching their nodes
+    };
+
+private:
+    size_t Hash(const K& key) const {
+        // std::hash of the integers is the identity, so mix the bits up
+        uint64_t h = hash_(key);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return size_t(h);
+    }
+
+    static uint32_t Tag(size_t hash) {
+        return uint32_t(uint64_t(hash) >> 32) ^ uint32_t(hash);
+    }
+
+    size_t ValueSize(const V& value) {
+        return sizeof_(value) + sizeof(Node) - sizeof(value);
+    }
+
+    // The bucket of the key, or the empty bucket where it should be inserted
+    size_t Probe(const K& key, size_t hash) const;
+    void Unlink(uint32_t index);
+    void LinkMRU(uint32_t index);
+    void RemoveBucket(size_t bucket);
+    void Remove(size_t bucket);
+
+private:
+    std::vector<Node> nodes_;
+    std::vector<Bucket> buckets_; // a power of 2 and twice the nodes at least
+    size_t mask_;
+
+    uint32_t mru_;  // The newest node
+    uint32_t lru_;  // The oldest node
+    uint32_t free_; // The head of the free nodes
+    size_t size_;
+    size_t max_memory_size_;
+    size_t memory_size_;
+
+    S sizeof_;
+    D deleter_;
+    H hash_;
+
+private:
+    SlabLRUCache(const SlabLRUCache& rhs);
+    SlabLRUCache& operator=(const SlabLRUCache& rhs);
+};
+
+template<class K, class V, class S, class D, class H>
+SlabLRUCache<K, V, S, D, H>::SlabLRUCache(size_t maxsize, size_t maxmemsize, S s, D d, H h)
+    : mask_(0)
+    , mru_(kNil)
+    , lru_(kNil)
+    , free_(0)
+    , size_(0)
+    , max_memory_size_(maxmemsize)
+    , memory_size_(0)
+    , sizeof_(s)
+    , deleter_(d)
+    , hash_(h) {
+    if (maxsize == 0) {
+        maxsize = 1;
+    }
+
+    if (maxsize >= kNil) {
+        maxsize = kNil - 1;
+    }
+
+    if (max_memory_size_ == 0) {
+        max_memory_size_ = size_t(-1);
+    }
+
+    nodes_.resize(maxsize);
+    for (size_t i = 0; i < maxsize; ++i) {
+        nodes_[i].newer = (i + 1 < maxsize ? uint32_t(i + 1) : uint32_t(kNil));
+    }
+
+    size_t n = 2;
+    while (n < maxsize * 2) {
+        n <<= 1;
+    }
+    Bucket empty = { kNil, 0 };
+    buckets_.assign(n, empty);
+    mask_ = n - 1;
+}
+
+template<class K, class V, class S, class D, class H>
+SlabLRUCache<K, V, S, D, H>::~SlabLRUCache() {
+    for (uint32_t i = lru_; i != kNil; i = nodes_[i].newer) {
+        deleter_(nodes_[i].value);
+    }
+}
+
+template<class K, class V, class S, class D, class H>
+void SlabLRUCache<K, V, S, D, H>::insert(const K& key, const V& value) {
+    size_t hash = Hash(key);
+    size_t bucket = Probe(key, hash);
+    uint32_t index = buckets_[bucket].node;
+    if (index != kNil) {
+        Node& n = nodes_[index];
+        assert(memory_size_ >= n.memory_size);
+        memory_size_ -= n.memory_size;
+        deleter_(n.value);
+        n.value = value;
+        n.memory_size = ValueSize(value);
+        memory_size_ += n.memory_size;
+        Unlink(index);
+        LinkMRU(index);
+        return;
+    }
+
+    // if we have grown too large, remove LRU
+    bool removed = false;
+    while (size_ > 0 && (size_ >= nodes_.size() || memory_size_ >= max_memory_size_)) {
+        Remove(Probe(nodes_[lru_].key, nodes_[lru_].hash));
+        removed = true;
+    }
+
+    if (removed) {
+        // The removing may have moved the buckets
+        bucket = Probe(key, hash);
+    }
+
+    index = free_;
+    Node& n = nodes_[index];
+    free_ = n.newer;
+    n.key = key;
+    n.value = value;
+    n.hash = hash;
+    n.memory_size = ValueSize(value);
+    memory_size_ += n.memory_size;
+    buckets_[bucket].node = index;
+    buckets_[bucket].tag = Tag(hash);
+    LinkMRU(index);
+    ++size_;
+}
+
+template<class K, class V, class S, class D, class H>
+typename SlabLRUCache<K, V, S, D, H>::const_iterator SlabLRUCache<K, V, S, D, H>::find(const K& key) {
+    uint32_t index = buckets_[Probe(key, Hash(key))].node;
+    if (index == kNil) {
+        return end();
+    }
+
+    if (index != mru_) {
+        Unlink(index);
+        LinkMRU(index);
+    }
+    return const_iterator(&nodes_[0], index, const_iterator::kMRU2LRU);
+}
+
+template<class K, class V, class S, class D, class H>
+typename SlabLRUCache<K, V, S, D, H>::const_iterator SlabLRUCache<K, V, S, D, H>::find(const K& key) const {
+    uint32_t index = buckets_[Probe(key, Hash(key))].node;
+    if (index == kNil) {
+        return end();
+    }
+    return const_iterator(&nodes_[0], index, const_iterator::kMRU2LRU);
+}
+
+template<class K, class V, class S, class D, class H>
+bool SlabLRUCache<K, V, S, D, H>::erase(const K& key) {
+    size_t bucket = Probe(key, Hash(key));
+    if (buckets_[bucket].node == kNil) {
+        return false;
+    }
+
+    Remove(bucket);
+    return true;
+}
+
+template<class K, class V, class S, class D, class H>
+size_t SlabLRUCache<K, V, S, D, H>::Probe(const K& key, size_t hash) const {
+    uint32_t tag = Tag(hash);
+    size_t bucket = hash & mask_;
+    for (;;) {
+        const Bucket& b = buckets_[bucket];
+        if (b.node == kNil || (b.tag == tag && nodes_[b.node].key == key)) {
+            return bucket;
+        }
+        bucket = (bucket + 1) & mask_;
+    }
+}
+
+template<class K, class V, class S, class D, class H>
+void SlabLRUCache<K, V, S, D, H>::Unlink(uint32_t index) {
+    Node& n = nodes_[index];
+    if (n.older != kNil) {
+        nodes_[n.older].newer = n.newer;
+    } else {
+        lru_ = n.newer;
+    }
+
+    if (n.newer != kNil) {
+        nodes_[n.newer].older = n.older;
+    } else {
+        mru_ = n.older;
+    }
+}
+
+template<class K, class V, class S, class D, class H>
+void SlabLRUCache<K, V, S, D, H>::LinkMRU(uint32_t index) {
+    Node& n = nodes_[index];
+    n.older = mru_;
+    n.newer = kNil;
+    if (mru_ != kNil) {
+        nodes_[mru_].newer = index;
+    } else {
+        lru_ = index;
+    }
+    mru_ = index;
+}
+
+template<class K, class V, class S, class D, class H>
+void SlabLRUCache<K, V, S, D, H>::RemoveBucket(size_t hole) {
+    // Shift the following buckets of the probe sequence back, so there is no tombstone
+    for (size_t next = (hole + 1) & mask_;; next = (next + 1) & mask_) {
+        const Bucket& b = buckets_[next];
+        if (b.node == kNil) {
+            break;
+        }
+
+        // It stays if its home bucket is in (hole, next]
+        size_t home = nodes_[b.node].hash & mask_;
+        bool stay = (hole <= next) ? (hole < home && home <= next) : (hole < home || home <= next);
+        if (!stay) {
+            buckets_[hole] = b;
+            hole = next;
+        }
+    }
+
+    buckets_[hole].node = kNil;
+}
+
+template<class K, class V, class S, class D, class H>
+void SlabLRUCache<K, V, S, D, H>::Remove(size_t bucket) {
+    uint32_t index = buckets_[bucket].node;
+    assert(index != kNil);
+    Node& n = nodes_[index];
+    assert(memory_size_ >= n.memory_size);
+    memory_size_ -= n.memory_size;
+    deleter_(n.value);
+    RemoveBucket(bucket);
+    Unlink(index);
+    n.newer = free_;
+    free_ = index;
+    --size_;
+}
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "simcc/inner_pre.h"
+#include <stdint.h>
+#include <string>
+
+namespace simcc {
+
+// The 64-bit xxHash (XXH64), a non-cryptographic hash which is much faster
+// than MD5. The data is hashed in 4 independent lanes of 8 bytes, so the CPU
+// can work on them in parallel. The result is the same as the reference
+// implementation on the little-endian machines.
+class SIMCC_EXPORT XXHash64 {
+public:
+    // @brief
+    // @param d    The source data buffer
+    // @param len  The size of d
+    // @param seed The results of the different seeds are independent
+    // @return the hash value
+    static uint64_t Sum(const void* d, size_t len, uint64_t seed = 0);
+    static uint64_t Sum(const string& s, uint64_t seed = 0) {
+        return Sum(s.data(), s.size(), seed);
+    }
+};
+}
@@ -0,0 +1,137 @@
+#include "test_common.h"
+
+#include "simcc/misc/clock_cache.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+std::atomic<int> clock_cache_deleted(0);
+
+struct CountDeleter {
+    void operator()(int&) const {
+        clock_cache_deleted++;
+    }
+};
+}
+
+TEST_UNIT(clock_cache_test_second_chance) {
+    simcc::ClockCache<std::string, int> cache(4, 0);
+    cache.Insert("key1", 1);
+    cache.Insert("key2", 2);
+    cache.Insert("key3", 3);
+    cache.Insert("key4", 4);
+    H_TEST_ASSERT(cache.size() == 4);
+
+    // The referenced ones get a second chance
+    int v = 0;
+    H_TEST_ASSERT(cache.Find("key1", &v));
+    H_TEST_ASSERT(v == 1);
+    H_TEST_ASSERT(cache.Find("key2", &v));
+    H_TEST_ASSERT(cache.Find("key3", &v));
+    cache.Insert("key5", 5);
+    H_TEST_ASSERT(cache.size() == 4);
+    H_TEST_ASSERT(!cache.Find("key4", &v));
+    H_TEST_ASSERT(cache.Find("key5", &v));
+    H_TEST_ASSERT(v == 5);
+
+    // Replace
+    cache.Insert("key5", 50);
+    H_TEST_ASSERT(cache.size() == 4);
+    H_TEST_ASSERT(cache.Find("key5", &v));
+    H_TEST_ASSERT(v == 50);
+
+    H_TEST_ASSERT(cache.Erase("key1"));
+    H_TEST_ASSERT(!cache.Erase("key1"));
+    H_TEST_ASSERT(!cache.Find("key1", &v));
+    H_TEST_ASSERT(cache.size() == 3);
+
+    int sum = 0;
+    cache.ForEach([&sum](const std::string&, const int & value) {
+        sum += value;
+    });
+    H_TEST_ASSERT(sum == 2 + 3 + 50);
+}
+
+TEST_UNIT(clock_cache_test_erase_keeps_probe_sequence) {
+    // Many keys share the slots, erasing must not hide the others
+    simcc::ClockCache<int, int> cache(1000, 0);
+    for (int i = 0; i < 1000; ++i) {
+        cache.Insert(i, i);
+    }
+
+    for (int i = 0; i < 1000; i += 3) {
+        H_TEST_ASSERT(cache.Erase(i));
+    }
+
+    int v = 0;
+    for (int i = 0; i < 1000; ++i) {
+        H_TEST_ASSERT(cache.Find(i, &v) == (i % 3 != 0));
+    }
+}
+
+TEST_UNIT(clock_cache_test_memory_limit) {
+    clock_cache_deleted = 0;
+    {
+        simcc::ClockCache<int, int, simcc::SizeofFunctor<int>, CountDeleter> cache(1000, 0);
+        cache.Insert(0, 0);
+        size_t item_size = cache.memory_size();
+
+        simcc::ClockCache<int, int, simcc::SizeofFunctor<int>, CountDeleter> limited(1000, item_size * 10);
+        for (int i = 0; i < 100; ++i) {
+            limited.Insert(i, i);
+        }
+        H_TEST_ASSERT(limited.size() == 10);
+        H_TEST_ASSERT(limited.memory_size() == item_size * 10);
+    }
+
+    // All of them are deleted, the retired ones and the ones in the cache
+    H_TEST_ASSERT(clock_cache_deleted == 101);
+}
+
+TEST_UNIT(clock_cache_test_threads) {
+    clock_cache_deleted = 0;
+    const int kReaders = 3;
+    const int kKeys = 2000;
+    int inserted = 0;
+    {
+        simcc::ClockCache<int, int, simcc::SizeofFunctor<int>, CountDeleter> cache(500, 0);
+        std::atomic<bool> stop(false);
+        std::atomic<int> wrong(0);
+        std::atomic<int> hits(0);
+        std::vector<std::thread> readers;
+        for (int t = 0; t < kReaders; ++t) {
+            readers.push_back(std::thread([&cache, &stop, &wrong, &hits, t]() {
+                int v = 0;
+                for (int i = t; !stop; i = (i + 7) % kKeys) {
+                    if (cache.Find(i, &v)) {
+                        hits++;
+                        if (v != i * 2) {
+                            wrong++;
+                        }
+                    }
+                }
+            }));
+        }
+
+        for (int round = 0; round < 20; ++round) {
+            for (int i = 0; i < kKeys; ++i) {
+                cache.Insert((i * 13 + round) % kKeys, (i * 13 + round) % kKeys * 2);
+                ++inserted;
+                if (i % 5 == 0) {
+                    cache.Erase(i);
+                }
+            }
+        }
+
+        stop = true;
+        for (auto& t : readers) {
+            t.join();
+        }
+
+        H_TEST_ASSERT(wrong == 0);
+        H_TEST_ASSERT(cache.size() <= 500);
+    }
+    H_TEST_ASSERT(clock_cache_deleted == inserted);
+}
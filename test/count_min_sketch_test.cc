@@ -0,0 +1,141 @@
+#include "test_common.h"
+
+#include "simcc/misc/count_min_sketch.h"
+#include "simcc/misc/dgram_filter.h"
+#include "simcc/misc/xxhash64.h"
+
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+uint64_t Key(int i) {
+    return simcc::XXHash64::Sum(&i, sizeof(i));
+}
+
+bool Near(double a, double b) {
+    return a - b < 0.0001 && b - a < 0.0001;
+}
+}
+
+TEST_UNIT(count_min_sketch_test_sliding_window) {
+    simcc::SlidingCountMinSketch sketch(1000, 4, 10);
+    H_TEST_ASSERT(sketch.width() == 1024);
+    H_TEST_ASSERT(sketch.memory_size() == 2 * 4 * 1024 * 4);
+
+    int64_t now = 1000;
+    for (int i = 0; i < 10; ++i) {
+        sketch.Add(Key(1), now);
+    }
+    sketch.Add(Key(2), now, 3);
+    H_TEST_ASSERT(Near(sketch.Estimate(Key(1), now + 9), 10));
+    H_TEST_ASSERT(Near(sketch.Estimate(Key(2), now + 9), 3));
+    H_TEST_ASSERT(Near(sketch.Estimate(Key(3), now + 9), 0));
+
+    // The previous window is counted by the part still in the sliding window
+    sketch.Add(Key(1), now + 12);
+    H_TEST_ASSERT(Near(sketch.Estimate(Key(1), now + 12), 1 + 10 * 0.8));
+    H_TEST_ASSERT(Near(sketch.Estimate(Key(1), now + 15), 1 + 10 * 0.5));
+
+    // Out of the window
+    H_TEST_ASSERT(Near(sketch.Estimate(Key(1), now + 20), 1));
+    H_TEST_ASSERT(Near(sketch.Estimate(Key(1), now + 45), 0));
+    H_TEST_ASSERT(Near(sketch.Estimate(Key(2), now + 45), 0));
+}
+
+TEST_UNIT(count_min_sketch_test_clock_from_zero) {
+    // The window starting at 0 is a window like the others
+    simcc::SlidingCountMinSketch sketch(1024, 4, 10);
+    sketch.Add(Key(1), 0, 10);
+    H_TEST_ASSERT(Near(sketch.Estimate(Key(1), 9), 10));
+    H_TEST_ASSERT(Near(sketch.Estimate(Key(1), 15), 10 * 0.5));
+    H_TEST_ASSERT(Near(sketch.Estimate(Key(1), 20), 0));
+}
+
+TEST_UNIT(count_min_sketch_test_window_boundary) {
+    simcc::SlidingCountMinSketch sketch(1 << 20, 4, 10);
+    sketch.Add(Key(1), 1005, 100);
+    H_TEST_ASSERT(Near(sketch.Estimate(Key(1), 1010), 100));
+
+    // At the next boundary the counts of [1000, 1010) are out of the window,
+    // also for the threads estimating while the window is moved
+    const int kThreads = 4;
+    std::atomic<int> wrong(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.push_back(std::thread([&sketch, &wrong]() {
+            for (int i = 0; i < 100; ++i) {
+                if (sketch.Estimate(Key(1), 1020) > 0.0) {
+                    wrong++;
+                }
+            }
+        }));
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    H_TEST_ASSERT(wrong == 0);
+}
+
+TEST_UNIT(count_min_sketch_test_overestimate_only) {
+    // A small sketch with lots of keys, no key is underestimated
+    simcc::SlidingCountMinSketch sketch(256, 4, 60);
+    int64_t now = 1000;
+    for (int i = 0; i < 2000; ++i) {
+        sketch.Add(Key(i), now, uint32_t(i % 7 + 1));
+    }
+
+    for (int i = 0; i < 2000; ++i) {
+        H_TEST_ASSERT(sketch.Estimate(Key(i), now) >= i % 7 + 1);
+    }
+}
+
+TEST_UNIT(count_min_sketch_test_deadline) {
+    simcc::DeadlineSketch deadlines(1024, 4);
+    H_TEST_ASSERT(deadlines.Get(Key(1)) == 0);
+    deadlines.Set(Key(1), 100);
+    deadlines.Set(Key(1), 50);
+    H_TEST_ASSERT(deadlines.Get(Key(1)) == 100);
+    deadlines.Set(Key(1), 200);
+    H_TEST_ASSERT(deadlines.Get(Key(1)) == 200);
+    H_TEST_ASSERT(deadlines.Get(Key(2)) == 0);
+}
+
+TEST_UNIT(count_min_sketch_test_dgram_filter) {
+    const char* conf =
+        "dgram_filter_enable=true\n"
+        "dgram_filter_mode=sketch\n"
+        "dgram_filter_max_threshold=3\n"
+        "dgram_filter_block_second=600\n"
+        "dgram_filter_sketch_width=262144\n"
+        "dgram_filter_sketch_depth=3\n";
+    simcc::INIParser ini;
+    H_TEST_ASSERT(ini.Parse(conf, strlen(conf)));
+    simcc::DgramFilter<60> filter;
+    H_TEST_ASSERT(simcc::DgramFilter<60>::Initialize(ini, &filter));
+    H_TEST_ASSERT(filter.Dump().find("SlidingCountMinSketch(262144x3)") != std::string::npos);
+
+    H_TEST_ASSERT(!filter.IsNeedFilter("packet", "127.0.0.1"));
+    H_TEST_ASSERT(!filter.IsNeedFilter("packet", "127.0.0.1"));
+    H_TEST_ASSERT(!filter.IsNeedFilter("packet", "127.0.0.1"));
+    H_TEST_ASSERT(filter.IsNeedFilter("packet", "127.0.0.1"));
+    H_TEST_ASSERT(filter.IsNeedFilter("packet", "127.0.0.1"));
+    H_TEST_ASSERT(!filter.IsNeedFilter("packet", "127.0.0.2"));
+
+    // The different packets take no more memory and seldom collide with it
+    size_t passed = 0;
+    for (int i = 0; i < 100000; ++i) {
+        if (!filter.IsNeedFilter("packet" + std::to_string(i), "127.0.0.1")) {
+            passed++;
+        }
+    }
+    H_TEST_ASSERT(passed > 99000);
+    H_TEST_ASSERT(filter.IsNeedFilter("packet", "127.0.0.1"));
+
+    // The unknown modes are rejected
+    simcc::INIParser bad;
+    H_TEST_ASSERT(bad.Parse("dgram_filter_mode=bloom\n", 23));
+    H_TEST_ASSERT(!simcc::DgramFilter<60>::Initialize(bad, &filter));
+}
@@ -0,0 +1,107 @@
+#include "test_common.h"
+
+#include "simcc/misc/dgram_filter.h"
+#include "simcc/timestamp.h"
+
+#include <iostream>
+#include <vector>
+
+namespace {
+typedef simcc::DgramFilter<60> Filter;
+
+bool IsSet(const std::vector<uint64_t>& bitmap, size_t i) {
+    return (bitmap[i / 64] >> (i % 64)) & 1;
+}
+}
+
+TEST_UNIT(dgram_filter_batch_test_same_as_one_by_one) {
+    Filter expected;
+    Filter actual;
+    H_TEST_ASSERT(expected.Initialize(true, 5, 4096, 1, 600, 8));
+    H_TEST_ASSERT(actual.Initialize(true, 5, 4096, 1, 600, 8));
+
+    std::string ip1("127.0.0.1");
+    std::string ip2("127.0.0.2");
+    std::vector<std::string> data;
+    for (int i = 0; i < 100; ++i) {
+        data.push_back("packet" + std::to_string(i % 13));
+    }
+    data[7].clear(); // The empty ones are never filtered
+
+    for (int round = 0; round < 3; ++round) {
+        std::vector<Filter::Packet> packets;
+        for (size_t i = 0; i < data.size(); ++i) {
+            Filter::Packet p = { data[i].data(), data[i].size(), i % 3 == 0 ? &ip1 : (i % 3 == 1 ? &ip2 : NULL) };
+            packets.push_back(p);
+        }
+
+        std::vector<uint64_t> bitmap(2, ~uint64_t(0));
+        size_t filtered = actual.IsNeedFilter(&packets[0], packets.size(), &bitmap[0]);
+        size_t expected_filtered = 0;
+        for (size_t i = 0; i < data.size(); ++i) {
+            bool f = expected.IsNeedFilter(data[i], packets[i].ip ? *packets[i].ip : std::string());
+            H_TEST_ASSERT(f == IsSet(bitmap, i));
+            expected_filtered += f;
+        }
+        H_TEST_ASSERT(filtered == expected_filtered);
+        H_TEST_ASSERT(round == 0 || filtered > 0);
+        H_TEST_ASSERT(!IsSet(bitmap, 7));
+        H_TEST_ASSERT(!IsSet(bitmap, 100) && !IsSet(bitmap, 127));
+    }
+}
+
+TEST_UNIT(dgram_filter_batch_test_sketch) {
+    Filter filter;
+    H_TEST_ASSERT(filter.InitializeSketch(true, 2, 600, 4096, 4));
+    std::string data("packet");
+    std::vector<Filter::Packet> packets(5);
+    for (size_t i = 0; i < packets.size(); ++i) {
+        Filter::Packet p = { data.data(), data.size(), NULL };
+        packets[i] = p;
+    }
+
+    uint64_t bitmap = 0;
+    H_TEST_ASSERT(filter.IsNeedFilter(&packets[0], packets.size(), &bitmap) == 3);
+    H_TEST_ASSERT(bitmap == 0x1c);
+    H_TEST_ASSERT(filter.IsNeedFilter(&packets[0], 0, &bitmap) == 0);
+}
+
+#ifdef H_BENCHMARK_TESTING
+TEST_UNIT(dgram_filter_batch_test_benchmark) {
+    const size_t kBatch = 64;
+    const int kRounds = 20000;
+    std::vector<std::string> data;
+    for (int i = 0; i < 4096; ++i) {
+        data.push_back(std::string(200, 'p') + std::to_string(i));
+    }
+    std::string ip("127.0.0.1");
+
+    Filter one;
+    H_TEST_ASSERT(one.Initialize(true, 1000000, 1 << 20, 1024, 600, 16));
+    simcc::Timestamp start = simcc::Timestamp::Now();
+    for (int r = 0; r < kRounds; ++r) {
+        for (size_t i = 0; i < kBatch; ++i) {
+            one.IsNeedFilter(data[(r * kBatch + i) % data.size()], ip);
+        }
+    }
+    simcc::Duration one_cost = simcc::Timestamp::Now() - start;
+
+    Filter batch;
+    H_TEST_ASSERT(batch.Initialize(true, 1000000, 1 << 20, 1024, 600, 16));
+    std::vector<Filter::Packet> packets(kBatch);
+    uint64_t bitmap = 0;
+    start = simcc::Timestamp::Now();
+    for (int r = 0; r < kRounds; ++r) {
+        for (size_t i = 0; i < kBatch; ++i) {
+            const std::string& d = data[(r * kBatch + i) % data.size()];
+            Filter::Packet p = { d.data(), d.size(), &ip };
+            packets[i] = p;
+        }
+        batch.IsNeedFilter(&packets[0], kBatch, &bitmap);
+    }
+    simcc::Duration batch_cost = simcc::Timestamp::Now() - start;
+
+    std::cout << ">>>>>>>>>>>>>>>> one by one cost=" << one_cost.Milliseconds() << "ms\n";
+    std::cout << ">>>>>>>>>>>>>>>> batch of " << kBatch << " cost=" << batch_cost.Milliseconds() << "ms\n";
+}
+#endif
@@ -0,0 +1,78 @@
+#include "test_common.h"
+
+#include "simcc/misc/dgram_filter.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+// Wait for the beginning of the next second, so the test does not cross the seconds by chance
+time_t NextSecond() {
+    time_t now = time(NULL);
+    while (time(NULL) == now) {
+        usleep(1000);
+    }
+    return time(NULL);
+}
+
+void SleepUntil(time_t t) {
+    while (time(NULL) < t) {
+        usleep(1000);
+    }
+}
+}
+
+TEST_UNIT(dgram_filter_window_test_slide) {
+    simcc::DgramFilter<2> filter;
+    H_TEST_ASSERT(filter.Initialize(true, 3, 1024, 1, 0));
+
+    time_t start = NextSecond();
+    H_TEST_ASSERT(!filter.IsNeedFilter("packet", "127.0.0.1"));
+    H_TEST_ASSERT(!filter.IsNeedFilter("packet", "127.0.0.1"));
+
+    // The packets of the first second are out of the window
+    SleepUntil(start + 2);
+    H_TEST_ASSERT(!filter.IsNeedFilter("packet", "127.0.0.1"));
+    H_TEST_ASSERT(!filter.IsNeedFilter("packet", "127.0.0.1"));
+    H_TEST_ASSERT(!filter.IsNeedFilter("packet", "127.0.0.1"));
+    H_TEST_ASSERT(filter.IsNeedFilter("packet", "127.0.0.1"));
+    H_TEST_ASSERT(!filter.IsNeedFilter("packet", "127.0.0.2"));
+}
+
+TEST_UNIT(dgram_filter_window_test_evicted_while_counting) {
+    // The Stats are evicted by the other threads while they are counted
+    const int kThreads = 4;
+    simcc::DgramFilter<60> filter;
+    H_TEST_ASSERT(filter.Initialize(true, 1000000, 64, 1, 600, 1));
+
+    std::atomic<int> passed(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.push_back(std::thread([&filter, &passed, t]() {
+            for (int i = 0; i < 20000; ++i) {
+                if (!filter.IsNeedFilter("packet" + std::to_string((i * 7 + t) % 200), "127.0.0.1")) {
+                    passed++;
+                }
+            }
+        }));
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    H_TEST_ASSERT(passed == kThreads * 20000);
+}
+
+TEST_UNIT(dgram_filter_window_test_max_threshold) {
+    // The packets of a second are counted in 16 bits, a larger threshold is clamped
+    typedef simcc::DgramFilter<60> Filter;
+    Filter filter;
+    H_TEST_ASSERT(filter.Initialize(true, 100000, 1024, 1, 600));
+    for (int i = 0; i < Filter::kMaxThreshold; ++i) {
+        H_TEST_ASSERT(!filter.IsNeedFilter("packet", "127.0.0.1"));
+    }
+    H_TEST_ASSERT(filter.IsNeedFilter("packet", "127.0.0.1"));
+    H_TEST_ASSERT(!filter.IsNeedFilter("packet", "127.0.0.2"));
+}
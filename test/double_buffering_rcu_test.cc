@@ -0,0 +1,129 @@
+#include "test_common.h"
+
+#include "simcc/misc/double_buffering.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+std::atomic<int> rcu_target_alive(0);
+
+class RCUTarget : public simcc::DoubleBuffering::Target {
+public:
+    RCUTarget() : value_(0) {
+        rcu_target_alive++;
+    }
+    ~RCUTarget() {
+        value_ = -1;
+        rcu_target_alive--;
+    }
+
+    bool Initialize(const std::string& c) {
+        value_ = std::stoi(c);
+        return value_ >= 0;
+    }
+
+    int value() const {
+        return value_;
+    }
+private:
+    int value_;
+};
+typedef simcc::RefPtr<RCUTarget> RCUTargetPtr;
+
+simcc::DoubleBuffering::TargetPtr Creator() {
+    return simcc::DoubleBuffering::TargetPtr(new RCUTarget);
+}
+}
+
+TEST_UNIT(double_buffering_rcu_test_reload) {
+    rcu_target_alive = 0;
+    {
+        simcc::DoubleBuffering db(&Creator);
+        H_TEST_ASSERT(db.Get().IsNull());
+        H_TEST_ASSERT(db.version() == 0);
+
+        H_TEST_ASSERT(db.Reload("1"));
+        RCUTargetPtr t1 = db.Get();
+        H_TEST_ASSERT(t1->value() == 1);
+        H_TEST_ASSERT(t1->RefCount() == 2);
+        H_TEST_ASSERT(db.version() == 1);
+
+        // A failed one changes nothing
+        H_TEST_ASSERT(!db.Reload("-1"));
+        H_TEST_ASSERT(db.Get() == t1);
+        H_TEST_ASSERT(db.version() == 1);
+        H_TEST_ASSERT(rcu_target_alive == 1);
+
+        // The old one is only kept by its readers
+        H_TEST_ASSERT(db.Reload("2"));
+        H_TEST_ASSERT(RCUTargetPtr(db.Get())->value() == 2);
+        H_TEST_ASSERT(t1->RefCount() == 1);
+        H_TEST_ASSERT(rcu_target_alive == 2);
+        t1 = NULL;
+        H_TEST_ASSERT(rcu_target_alive == 1);
+
+        H_TEST_ASSERT(db.Reload("3"));
+        H_TEST_ASSERT(rcu_target_alive == 1);
+        H_TEST_ASSERT(db.version() == 3);
+    }
+    H_TEST_ASSERT(rcu_target_alive == 0);
+}
+
+TEST_UNIT(double_buffering_rcu_test_local_snapshot) {
+    simcc::DoubleBuffering db(&Creator);
+    simcc::DoubleBuffering::LocalSnapshot snapshot(&db);
+    H_TEST_ASSERT(snapshot.Get().IsNull());
+
+    H_TEST_ASSERT(db.Reload("1"));
+    RCUTargetPtr t1 = snapshot.Get();
+    H_TEST_ASSERT(t1->value() == 1);
+    H_TEST_ASSERT(snapshot.Get().get() == t1.get());
+    H_TEST_ASSERT(t1->RefCount() == 3);
+
+    H_TEST_ASSERT(db.Reload("2"));
+    H_TEST_ASSERT(t1->RefCount() == 2); // still kept by the snapshot
+    H_TEST_ASSERT(RCUTargetPtr(snapshot.Get())->value() == 2);
+    H_TEST_ASSERT(t1->RefCount() == 1);
+}
+
+TEST_UNIT(double_buffering_rcu_test_threads) {
+    rcu_target_alive = 0;
+    {
+        simcc::DoubleBuffering db(&Creator);
+        H_TEST_ASSERT(db.Reload("0"));
+
+        const int kReaders = 4;
+        std::atomic<bool> stop(false);
+        std::atomic<int> wrong(0);
+        std::vector<std::thread> readers;
+        for (int r = 0; r < kReaders; ++r) {
+            readers.push_back(std::thread([&db, &stop, &wrong, r]() {
+                simcc::DoubleBuffering::LocalSnapshot snapshot(&db);
+                int last = 0;
+                while (!stop) {
+                    RCUTargetPtr t = (r % 2 == 0 ? db.Get() : snapshot.Get());
+                    // The versions never go back
+                    if (t->value() < last) {
+                        wrong++;
+                    }
+                    last = t->value();
+                }
+            }));
+        }
+
+        for (int i = 1; i <= 2000; ++i) {
+            H_TEST_ASSERT(db.Reload(std::to_string(i)));
+        }
+        stop = true;
+        for (auto& t : readers) {
+            t.join();
+        }
+
+        H_TEST_ASSERT(wrong == 0);
+        H_TEST_ASSERT(RCUTargetPtr(db.Get())->value() == 2000);
+        H_TEST_ASSERT(rcu_target_alive == 1);
+    }
+    H_TEST_ASSERT(rcu_target_alive == 0);
+}
@@ -0,0 +1,249 @@
+#include "test_common.h"
+
+#include "simcc/misc/double_buffering.h"
+#include "simcc/file_util.h"
+
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+std::atomic<int> reload_running(0);
+std::atomic<int> reload_max_running(0);
+
+// The reloads of "latched" wait in Initialize until the test opens it, so
+// the test knows one is running
+class Latch {
+public:
+    Latch() : entered_(false), opened_(false) {}
+
+    void Enter() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        entered_ = true;
+        cond_.notify_all();
+        cond_.wait(lock, [this]() {
+            return opened_;
+        });
+    }
+
+    bool WaitEntered() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cond_.wait_for(lock, std::chrono::seconds(10), [this]() {
+            return entered_;
+        });
+    }
+
+    void Open() {
+        std::lock_guard<std::mutex> g(mutex_);
+        opened_ = true;
+        cond_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool entered_;
+    bool opened_;
+};
+Latch reload_latch;
+
+// The conf is its data, or the file of its data if it is a .tmp file
+class ReloadTarget : public simcc::DoubleBuffering::Target {
+public:
+    bool Initialize(const std::string& c) {
+        int running = ++reload_running;
+        int max = reload_max_running;
+        while (running > max && !reload_max_running.compare_exchange_weak(max, running)) {
+        }
+
+        if (simcc::FileUtil::GetFileNameExtension(c) == "tmp") {
+            std::ifstream f(c.c_str());
+            std::getline(f, data_);
+        } else {
+            data_ = c;
+        }
+
+        if (data_ == "latched") {
+            reload_latch.Enter();
+        }
+        if (data_.find("slow") != std::string::npos) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        reload_running--;
+        return data_ != "bad";
+    }
+
+    // The data is short, it is its own digest
+    std::string MD5() const {
+        return data_;
+    }
+
+    const std::string& data() const {
+        return data_;
+    }
+private:
+    std::string data_;
+};
+typedef simcc::RefPtr<ReloadTarget> ReloadTargetPtr;
+
+simcc::DoubleBuffering::TargetPtr Creator() {
+    return simcc::DoubleBuffering::TargetPtr(new ReloadTarget);
+}
+
+// Collects the results of the background reloads
+class Results {
+public:
+    void Add(const std::string& name, simcc::DoubleBufferingManager::ReloadResult r) {
+        std::lock_guard<std::mutex> g(mutex_);
+        names_.push_back(name);
+        results_.push_back(r);
+        times_.push_back(simcc::Timestamp::Now());
+        cond_.notify_all();
+    }
+
+    bool WaitFor(size_t count) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cond_.wait_for(lock, std::chrono::seconds(10), [this, count]() {
+            return results_.size() >= count;
+        });
+    }
+
+    simcc::DoubleBufferingManager::ReloadResult result(size_t i) {
+        std::lock_guard<std::mutex> g(mutex_);
+        return results_[i];
+    }
+
+    simcc::Timestamp time(size_t i) {
+        std::lock_guard<std::mutex> g(mutex_);
+        return times_[i];
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> g(mutex_);
+        return results_.size();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::vector<std::string> names_;
+    std::vector<simcc::DoubleBufferingManager::ReloadResult> results_;
+    std::vector<simcc::Timestamp> times_;
+};
+
+std::string Data(simcc::DoubleBufferingManager& m, const std::string& name) {
+    ReloadTargetPtr t = m.Get(name)->Get();
+    return t->data();
+}
+}
+
+TEST_UNIT(double_buffering_reload_test_async) {
+    simcc::DoubleBufferingManager m;
+    Results results;
+    m.set_listener(std::bind(&Results::Add, &results, std::placeholders::_1, std::placeholders::_2));
+    H_TEST_ASSERT(m.Add("a", "1", &Creator));
+    H_TEST_ASSERT(!m.AsyncReload("a", "2")); // Not started
+    H_TEST_ASSERT(m.Start(2, simcc::Duration(0.0), simcc::Duration(1.0)));
+    H_TEST_ASSERT(!m.Start(2, simcc::Duration(0.0), simcc::Duration(1.0)));
+    H_TEST_ASSERT(!m.AsyncReload("none", "2"));
+
+    H_TEST_ASSERT(m.AsyncReload("a", "2"));
+    H_TEST_ASSERT(results.WaitFor(1));
+    H_TEST_ASSERT(results.result(0) == simcc::DoubleBufferingManager::kReloaded);
+    H_TEST_ASSERT(Data(m, "a") == "2");
+    H_TEST_ASSERT(m.Get("a")->version() == 2);
+
+    // The same MD5 is not published
+    H_TEST_ASSERT(m.AsyncReload("a", "2"));
+    H_TEST_ASSERT(results.WaitFor(2));
+    H_TEST_ASSERT(results.result(1) == simcc::DoubleBufferingManager::kUnchanged);
+    H_TEST_ASSERT(m.Get("a")->version() == 2);
+
+    H_TEST_ASSERT(m.AsyncReload("a", "bad"));
+    H_TEST_ASSERT(results.WaitFor(3));
+    H_TEST_ASSERT(results.result(2) == simcc::DoubleBufferingManager::kFailed);
+    H_TEST_ASSERT(Data(m, "a") == "2");
+    m.Stop();
+    H_TEST_ASSERT(!m.AsyncReload("a", "3"));
+}
+
+TEST_UNIT(double_buffering_reload_test_merge_and_rate_limit) {
+    simcc::DoubleBufferingManager m;
+    Results results;
+    m.set_listener(std::bind(&Results::Add, &results, std::placeholders::_1, std::placeholders::_2));
+    H_TEST_ASSERT(m.Add("a", "0", &Creator));
+    H_TEST_ASSERT(m.Start(4, simcc::Duration(0.2), simcc::Duration(1.0)));
+
+    // The requests while one is running are merged into one of the latest conf
+    H_TEST_ASSERT(m.AsyncReload("a", "latched"));
+    H_TEST_ASSERT(reload_latch.WaitEntered());
+    H_TEST_ASSERT(m.AsyncReload("a", "slow2"));
+    H_TEST_ASSERT(m.AsyncReload("a", "slow3"));
+    reload_latch.Open();
+    H_TEST_ASSERT(results.WaitFor(2));
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    H_TEST_ASSERT(results.size() == 2);
+    H_TEST_ASSERT(Data(m, "a") == "slow3");
+    H_TEST_ASSERT(m.Get("a")->version() == 3);
+    H_TEST_ASSERT((results.time(1) - results.time(0)).Seconds() >= 0.2);
+}
+
+TEST_UNIT(double_buffering_reload_test_bounded_workers) {
+    simcc::DoubleBufferingManager m;
+    Results results;
+    m.set_listener(std::bind(&Results::Add, &results, std::placeholders::_1, std::placeholders::_2));
+    const char* names[] = { "a", "b", "c", "d", "e", "f" };
+    for (size_t i = 0; i < H_ARRAYSIZE(names); ++i) {
+        H_TEST_ASSERT(m.Add(names[i], "0", &Creator));
+    }
+
+    reload_max_running = 0;
+    H_TEST_ASSERT(m.Start(2, simcc::Duration(0.0), simcc::Duration(1.0)));
+    for (size_t i = 0; i < H_ARRAYSIZE(names); ++i) {
+        H_TEST_ASSERT(m.AsyncReload(names[i], std::string("slow") + names[i]));
+    }
+    H_TEST_ASSERT(results.WaitFor(H_ARRAYSIZE(names)));
+    H_TEST_ASSERT(reload_max_running <= 2);
+    for (size_t i = 0; i < H_ARRAYSIZE(names); ++i) {
+        H_TEST_ASSERT(Data(m, names[i]) == std::string("slow") + names[i]);
+    }
+}
+
+TEST_UNIT(double_buffering_reload_test_watch) {
+    const std::string path = "double_buffering_reload_test.tmp";
+    {
+        std::ofstream f(path.c_str());
+        f << "1\n";
+    }
+
+    simcc::DoubleBufferingManager m;
+    Results results;
+    m.set_listener(std::bind(&Results::Add, &results, std::placeholders::_1, std::placeholders::_2));
+    H_TEST_ASSERT(m.Add("file", path, &Creator));
+    H_TEST_ASSERT(Data(m, "file") == "1");
+    H_TEST_ASSERT(!m.Watch("none", path));
+    H_TEST_ASSERT(m.Start(1, simcc::Duration(0.0), simcc::Duration(0.05)));
+    H_TEST_ASSERT(m.Watch("file", path));
+
+    // Not changed, not reloaded
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    H_TEST_ASSERT(results.size() == 0);
+
+    // Replaced atomically, or the half written file may be loaded
+    {
+        std::ofstream f((path + ".new").c_str());
+        f << "22\n";
+    }
+    H_TEST_ASSERT(::rename((path + ".new").c_str(), path.c_str()) == 0);
+    H_TEST_ASSERT(results.WaitFor(1));
+    H_TEST_ASSERT(results.result(0) == simcc::DoubleBufferingManager::kReloaded);
+    H_TEST_ASSERT(Data(m, "file") == "22");
+    m.Stop();
+    simcc::FileUtil::Unlink(path);
+}
@@ -0,0 +1,185 @@
+#include "test_common.h"
+
+#include "simcc/misc/double_buffering.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace {
+class VersionTarget : public simcc::DoubleBuffering::Target {
+public:
+    bool Initialize(const std::string& c) {
+        data_ = c;
+        return true;
+    }
+
+    size_t MemorySize() const {
+        return data_.size();
+    }
+private:
+    std::string data_;
+};
+
+simcc::DoubleBuffering::TargetPtr Creator() {
+    return simcc::DoubleBuffering::TargetPtr(new VersionTarget);
+}
+}
+
+TEST_UNIT(double_buffering_versions_test_stats) {
+    simcc::DoubleBuffering db(&Creator);
+    H_TEST_ASSERT(db.versions().empty());
+
+    H_TEST_ASSERT(db.Reload("aaaa"));
+    std::vector<simcc::DoubleBuffering::VersionStats> v = db.versions();
+    H_TEST_ASSERT(v.size() == 1);
+    H_TEST_ASSERT(v[0].id == 1);
+    H_TEST_ASSERT(v[0].state == simcc::DoubleBuffering::kCurrent);
+    H_TEST_ASSERT(v[0].references == 0);
+    H_TEST_ASSERT(v[0].memory_size == 4);
+
+    simcc::DoubleBuffering::TargetPtr t1 = db.Get();
+    H_TEST_ASSERT(db.versions()[0].references == 1);
+
+    // The old one is kept by its reader
+    H_TEST_ASSERT(db.Reload("bb"));
+    v = db.versions();
+    H_TEST_ASSERT(v.size() == 2);
+    H_TEST_ASSERT(v[0].id == 1 && v[0].state == simcc::DoubleBuffering::kRetired && v[0].references == 1);
+    H_TEST_ASSERT(v[1].id == 2 && v[1].state == simcc::DoubleBuffering::kCurrent && v[1].references == 0);
+    H_TEST_ASSERT(db.memory_size() == 6);
+
+    // Not published yet
+    simcc::DoubleBuffering::TargetPtr t3 = db.Create("c");
+    v = db.versions();
+    H_TEST_ASSERT(v.size() == 3);
+    H_TEST_ASSERT(v[2].id == 3 && v[2].state == simcc::DoubleBuffering::kBuilding && v[2].references == 1);
+
+    t1 = NULL;
+    t3 = NULL;
+    v = db.versions();
+    H_TEST_ASSERT(v.size() == 1);
+    H_TEST_ASSERT(v[0].id == 2);
+    H_TEST_ASSERT(db.memory_size() == 2);
+}
+
+TEST_UNIT(double_buffering_versions_test_max_versions) {
+    simcc::DoubleBuffering db(&Creator);
+    db.set_max_versions(2, simcc::Duration(0.05));
+    H_TEST_ASSERT(db.Reload("1"));
+    H_TEST_ASSERT(db.Reload("2"));
+
+    // The current one and the retired one kept by t2
+    simcc::DoubleBuffering::TargetPtr t2 = db.Get();
+    H_TEST_ASSERT(db.Reload("3"));
+    bool throttled = false;
+    H_TEST_ASSERT(db.Create("4", &throttled).IsNull());
+    H_TEST_ASSERT(throttled);
+    H_TEST_ASSERT(!db.Reload("4"));
+    H_TEST_ASSERT(db.versions().size() == 2);
+    H_TEST_ASSERT(db.version() == 3);
+
+    // It waits for t2 to be dropped
+    db.set_max_versions(2, simcc::Duration(10.0));
+    std::thread reader([&t2]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        t2 = NULL;
+    });
+    H_TEST_ASSERT(db.Reload("4"));
+    reader.join();
+    H_TEST_ASSERT(db.version() == 4);
+    H_TEST_ASSERT(db.versions().size() == 1);
+
+    // No limit
+    db.set_max_versions(0, simcc::Duration(0.0));
+    std::vector<simcc::DoubleBuffering::TargetPtr> readers;
+    for (int i = 0; i < 5; ++i) {
+        readers.push_back(db.Get());
+        H_TEST_ASSERT(db.Reload(std::to_string(i)));
+    }
+    H_TEST_ASSERT(db.versions().size() == 6);
+}
+
+TEST_UNIT(double_buffering_versions_test_manager_throttled) {
+    std::atomic<int> throttled(0);
+    std::atomic<int> reloaded(0);
+    simcc::DoubleBufferingManager m;
+    m.set_listener([&throttled, &reloaded](const std::string&, simcc::DoubleBufferingManager::ReloadResult r) {
+        if (r == simcc::DoubleBufferingManager::kThrottled) {
+            throttled++;
+        } else if (r == simcc::DoubleBufferingManager::kReloaded) {
+            reloaded++;
+        }
+    });
+    H_TEST_ASSERT(m.Add("a", "1", &Creator));
+    H_TEST_ASSERT(m.Reload("a", "2"));
+    simcc::DoubleBuffering* db = m.Get("a");
+    db->set_max_versions(2, simcc::Duration(0.0));
+    simcc::DoubleBuffering::TargetPtr t2 = db->Get();
+    H_TEST_ASSERT(m.Reload("a", "3"));
+
+    H_TEST_ASSERT(m.Start(1, simcc::Duration(0.0), simcc::Duration(1.0)));
+    H_TEST_ASSERT(m.AsyncReload("a", "4"));
+    for (int i = 0; i < 1000 && throttled == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    H_TEST_ASSERT(throttled > 0);
+    H_TEST_ASSERT(reloaded == 0);
+
+    // It is retried after the old one drains
+    t2 = NULL;
+    for (int i = 0; i < 1000 && reloaded == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    H_TEST_ASSERT(reloaded == 1);
+    H_TEST_ASSERT(db->version() == 4);
+    m.Stop();
+}
+
+TEST_UNIT(double_buffering_versions_test_idle_local_snapshot) {
+    std::atomic<int> throttled(0);
+    std::atomic<int> dropped(0);
+    std::atomic<int> reloaded(0);
+    simcc::DoubleBufferingManager m;
+    m.set_listener([&](const std::string&, simcc::DoubleBufferingManager::ReloadResult r) {
+        if (r == simcc::DoubleBufferingManager::kThrottled) {
+            throttled++;
+        } else if (r == simcc::DoubleBufferingManager::kDropped) {
+            dropped++;
+        } else if (r == simcc::DoubleBufferingManager::kReloaded) {
+            reloaded++;
+        }
+    });
+    m.set_max_throttled_retries(3);
+    H_TEST_ASSERT(m.Add("a", "1", &Creator));
+    simcc::DoubleBuffering* db = m.Get("a");
+    db->set_max_versions(2, simcc::Duration(0.0));
+
+    // The reader read once and is idle since, its snapshot keeps version 1
+    simcc::DoubleBuffering::LocalSnapshot snapshot(db);
+    H_TEST_ASSERT(!snapshot.Get().IsNull());
+    H_TEST_ASSERT(m.Reload("a", "2"));
+
+    // The retries back off and give up
+    simcc::Timestamp start = simcc::Timestamp::Now();
+    H_TEST_ASSERT(m.Start(1, simcc::Duration(0.0), simcc::Duration(1.0)));
+    H_TEST_ASSERT(m.AsyncReload("a", "3"));
+    for (int i = 0; i < 1000 && dropped == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    H_TEST_ASSERT(dropped == 1);
+    H_TEST_ASSERT(throttled == 3);
+    H_TEST_ASSERT((simcc::Timestamp::Now() - start).Seconds() >= 0.1 + 0.2 + 0.4);
+    H_TEST_ASSERT(db->version() == 2);
+
+    // It is reloaded after the reader wakes up
+    H_TEST_ASSERT(!snapshot.Get().IsNull());
+    H_TEST_ASSERT(db->versions().size() == 1);
+    H_TEST_ASSERT(m.AsyncReload("a", "3"));
+    for (int i = 0; i < 1000 && reloaded == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    H_TEST_ASSERT(reloaded == 1);
+    H_TEST_ASSERT(db->version() == 3);
+    m.Stop();
+}
@@ -0,0 +1,187 @@
+#include "test_common.h"
+
+#include "simcc/flat_ini_parser.h"
+#include "simcc/ini_parser.h"
+#include "simcc/http_data_parser.h"
+
+#include <vector>
+
+TEST_UNIT(flat_ini_parser_test_default_section) {
+    const char* rawdata = "mid=ac9219aa5232c4e519ae5fcb4d77ae5b\r\n"
+                          "product=xxxxxxse\r\n"
+                          "  version = 4.4 \r\n"
+                          "appext=";
+    simcc::FlatINIParser parser;
+    H_TEST_ASSERT(parser.Parse(rawdata, strlen(rawdata), "\r\n", "="));
+    H_TEST_ASSERT(parser.ok());
+    H_TEST_ASSERT(parser.size() == 4);
+
+    bool found = false;
+    H_TEST_ASSERT(parser.Get("mid", &found) == "ac9219aa5232c4e519ae5fcb4d77ae5b");
+    H_TEST_ASSERT(found);
+    H_TEST_ASSERT(parser.Get("product") == "xxxxxxse");
+    H_TEST_ASSERT(parser.Get("version") == "4.4");
+    H_TEST_ASSERT(parser.GetDouble("", "version") > 4.3);
+    H_TEST_ASSERT(parser.Get("appext", &found).empty());
+    H_TEST_ASSERT(found);
+    H_TEST_ASSERT(parser.Get("not_exist", &found).empty());
+    H_TEST_ASSERT(!found);
+}
+
+TEST_UNIT(flat_ini_parser_test_sections) {
+    const char* rawdata = "; comment\n"
+                          "a=1\n"
+                          "[s1]\n"
+                          "# comment\n"
+                          "a=2\n"
+                          "b = true\n"
+                          "\n"
+                          "[ s2 ]\n"
+                          "// comment\n"
+                          "a=3\n"
+                          "[s1]\n"
+                          "a=4\n";
+    simcc::FlatINIParser parser;
+    H_TEST_ASSERT(parser.Parse(rawdata, strlen(rawdata)));
+    H_TEST_ASSERT(parser.size() == 4);
+    H_TEST_ASSERT(parser.GetInteger("", "a") == 1);
+    H_TEST_ASSERT(parser.GetInteger("s1", "a") == 4);
+    H_TEST_ASSERT(parser.GetBool("s1", "b"));
+    H_TEST_ASSERT(parser.GetInteger("s2", "a") == 3);
+    H_TEST_ASSERT(parser.GetInteger("s3", "a", 9) == 9);
+    H_TEST_ASSERT(parser.Get("S1", "a").empty());
+
+    // The overridden value is skipped and the rest is in the input order
+    std::vector<std::string> v;
+    parser.Visit([&v](const simcc::Slice& section, const simcc::Slice& key, const simcc::Slice& value) {
+        v.push_back(section.ToString() + "." + key.ToString() + "=" + value.ToString());
+    });
+    H_TEST_ASSERT(v.size() == 4);
+    H_TEST_ASSERT(v[0] == ".a=1");
+    H_TEST_ASSERT(v[1] == "s1.b=true");
+    H_TEST_ASSERT(v[2] == "s2.a=3");
+    H_TEST_ASSERT(v[3] == "s1.a=4");
+}
+
+TEST_UNIT(flat_ini_parser_test_case_insensitive) {
+    std::string rawdata = "[Section]\nKey=Value\nkey=value2\n";
+    simcc::FlatINIParser parser(false);
+    H_TEST_ASSERT(parser.Parse(rawdata.data(), rawdata.size()));
+    H_TEST_ASSERT(parser.size() == 1);
+    H_TEST_ASSERT(parser.Get("SECTION", "KEY") == "value2");
+    H_TEST_ASSERT(parser.Get("section", "key") == "value2");
+}
+
+TEST_UNIT(flat_ini_parser_test_query_string) {
+    std::string rawdata = "a=1&&b=2&c=&=4&d&e=5";
+    simcc::FlatINIParser parser(true, true);
+    H_TEST_ASSERT(parser.Parse(rawdata.data(), rawdata.size(), "&", "="));
+    H_TEST_ASSERT(parser.error() == simcc::INIParser::kErrorCannotFindKVSeperator);
+    H_TEST_ASSERT(parser.size() == 4);
+    H_TEST_ASSERT(parser.Get("a") == "1");
+    H_TEST_ASSERT(parser.Get("b") == "2");
+    H_TEST_ASSERT(parser.Get("c").empty());
+    H_TEST_ASSERT(parser.Get("e") == "5");
+
+    simcc::FlatINIParser strict;
+    H_TEST_ASSERT(!strict.Parse(rawdata.data(), rawdata.size(), "&", "="));
+    H_TEST_ASSERT(strict.error() == simcc::INIParser::kErrorCannotFindKVSeperator);
+}
+
+TEST_UNIT(flat_ini_parser_test_multi_char_separator) {
+    std::string rawdata = "a:1||||c:3||d::4";
+    simcc::FlatINIParser parser;
+    H_TEST_ASSERT(parser.Parse(rawdata.data(), rawdata.size(), "||", ":"));
+    H_TEST_ASSERT(parser.Get("a") == "1");
+    H_TEST_ASSERT(parser.Get("c") == "3");
+    H_TEST_ASSERT(parser.Get("d") == ":4");
+
+    rawdata = "a::=1;;b::=2";
+    H_TEST_ASSERT(parser.Parse(rawdata.data(), rawdata.size(), ";;", "::="));
+    H_TEST_ASSERT(parser.size() == 2);
+    H_TEST_ASSERT(parser.Get("b") == "2");
+}
+
+TEST_UNIT(flat_ini_parser_test_same_as_ini_parser) {
+    std::string rawdata;
+    for (int i = 0; i < 1000; ++i) {
+        if (i % 100 == 0) {
+            rawdata += "[section" + std::to_string(i / 100) + "]\n";
+        }
+        rawdata += "key" + std::to_string(i % 150) + " = value" + std::to_string(i) + "\n";
+    }
+
+    simcc::INIParser ini;
+    H_TEST_ASSERT(ini.Parse(rawdata.data(), rawdata.size()));
+    simcc::FlatINIParser flat;
+    H_TEST_ASSERT(flat.Parse(rawdata.data(), rawdata.size()));
+
+    size_t count = 0;
+    const simcc::INIParser::SectionMap& m = ini.GetSectionMap();
+    for (auto sit = m.begin(); sit != m.end(); ++sit) {
+        for (auto it = sit->second.begin(); it != sit->second.end(); ++it) {
+            bool found = false;
+            H_TEST_ASSERT(flat.Get(sit->first, it->first, &found) == it->second);
+            H_TEST_ASSERT(found);
+            ++count;
+        }
+    }
+    H_TEST_ASSERT(count == flat.size());
+}
+
+TEST_UNIT(flat_ini_parser_test_zero_copy) {
+    std::string rawdata = "name=a+b%20c&empty=&plain=xyz&bad=%zz";
+    simcc::FlatINIParser parser(true, true);
+    parser.set_zero_copy(true);
+    H_TEST_ASSERT(parser.Parse(rawdata.data(), rawdata.size(), "&", "="));
+
+    // The values point into the source buffer
+    simcc::Slice value = parser.Get("plain");
+    H_TEST_ASSERT(value == "xyz");
+    H_TEST_ASSERT(value.data() >= rawdata.data() && value.data() < rawdata.data() + rawdata.size());
+
+    bool found = false;
+    H_TEST_ASSERT(parser.Get("name") == "a+b%20c");
+    H_TEST_ASSERT(parser.GetURLDecoded("name", &found) == "a b c");
+    H_TEST_ASSERT(found);
+    H_TEST_ASSERT(parser.GetURLDecoded("plain") == "xyz");
+    H_TEST_ASSERT(parser.GetURLDecoded("bad") == "%zz");
+    H_TEST_ASSERT(parser.GetURLDecoded("empty", &found).empty());
+    H_TEST_ASSERT(found);
+    H_TEST_ASSERT(parser.GetURLDecoded("not_exist", &found).empty());
+    H_TEST_ASSERT(!found);
+}
+
+TEST_UNIT(flat_ini_parser_test_uri_parser) {
+    std::string d[][3] = {
+        {"http://www.a.com/bv.aspx?x=y&to=a", "to", "a"},
+        {"http://www.a.com/bv.aspx?x=y&to=a&", "to", "a"},
+        {"http://www.a.com/bv.aspx?to=b&x=y&to=a&xxx", "to", "a"},
+        {"http://www.a.com/bv.aspx?to=&x=y", "to", ""},
+        {"/?a&to=c", "to", "c"},
+    };
+
+    for (size_t i = 0; i < H_ARRAYSIZE(d); i++) {
+        simcc::URIParser::ssmap kv;
+        H_TEST_ASSERT(simcc::URIParser::Parse(d[i][0].data(), d[i][0].size(), kv));
+        H_TEST_ASSERT(kv[d[i][1]] == d[i][2]);
+
+        std::string uri;
+        kv.clear();
+        H_TEST_ASSERT(simcc::URIParser::Parse(d[i][0].data(), d[i][0].size(), uri, &kv));
+        H_TEST_ASSERT(uri == d[i][0].substr(0, d[i][0].find('?')));
+        H_TEST_ASSERT(kv[d[i][1]] == d[i][2]);
+
+        simcc::FlatINIParser ini;
+        H_TEST_ASSERT(simcc::URIParser::Parse(d[i][0].data(), d[i][0].size(), ini));
+        H_TEST_ASSERT(ini.Get(d[i][1]) == d[i][2]);
+    }
+
+    // The existing keys are kept
+    simcc::URIParser::ssmap kv;
+    kv["x"] = "old";
+    std::string s = "/a?x=new&y=1";
+    H_TEST_ASSERT(simcc::URIParser::Parse(s.data(), s.size(), kv));
+    H_TEST_ASSERT(kv["x"] == "old");
+    H_TEST_ASSERT(kv["y"] == "1");
+}
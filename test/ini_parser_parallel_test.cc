@@ -0,0 +1,151 @@
+#include "test_common.h"
+
+#include "simcc/ini_parser.h"
+#include "simcc/file_util.h"
+
+#include <vector>
+
+namespace {
+// About 4MB, the sections and the duplicated keys cross the pieces
+std::string MakeINI() {
+    std::string s = "; the default section\ntop = 1\n";
+    for (int i = 0; i < 100000; ++i) {
+        if (i % 7000 == 0) {
+            s += "\n  [ Section" + std::to_string(i / 7000 % 5) + " ]\n";
+        }
+        if (i % 1000 == 0) {
+            s += "# comment " + std::to_string(i) + "\n";
+        }
+        s += "key" + std::to_string(i % 20000) + " = value_" + std::to_string(i) + "_padding_padding\n";
+    }
+    s += "last = no new line";
+    return s;
+}
+}
+
+TEST_UNIT(ini_parser_parallel_test_same_as_sequential) {
+    std::string s = MakeINI();
+    for (int c = 0; c < 2; ++c) {
+        bool case_sensitive = (c == 0);
+        simcc::INIParser sequential(case_sensitive, false, true);
+        H_TEST_ASSERT(sequential.Parse(s.data(), s.size()));
+
+        simcc::INIParser parallel(case_sensitive, false, true);
+        H_TEST_ASSERT(parallel.ParseParallel(s.data(), s.size(), 4));
+        H_TEST_ASSERT(parallel.ok());
+        H_TEST_ASSERT(parallel.GetSectionMap() == sequential.GetSectionMap());
+        H_TEST_ASSERT(parallel.Serialize(true) == sequential.Serialize(true));
+        H_TEST_ASSERT(parallel.Get(case_sensitive ? "Section4" : "section4", "last") == "no new line");
+    }
+}
+
+TEST_UNIT(ini_parser_parallel_test_long_sections) {
+    // The middle pieces have no section line, they are in the section where
+    // the first piece ends. The other one has no section at all.
+    std::string with_sections = "a = 1\n[first]\n";
+    std::string without_sections;
+    for (int i = 0; i < 100000; ++i) {
+        std::string line = "key" + std::to_string(i % 30000) + " = value_" + std::to_string(i) + "_padding_padding\n";
+        with_sections += line;
+        without_sections += line;
+    }
+    with_sections += "[last]\nb = 2\n";
+
+    std::string inputs[] = { with_sections, without_sections };
+    for (size_t i = 0; i < H_ARRAYSIZE(inputs); ++i) {
+        const std::string& s = inputs[i];
+        simcc::INIParser sequential(true, false, true);
+        H_TEST_ASSERT(sequential.Parse(s.data(), s.size()));
+
+        std::vector<std::string> actual;
+        simcc::INIParser parallel(true, false, true);
+        parallel.SetParseListener([&actual](simcc::INIParser&, const std::string & section, const std::string & key, const std::string&) {
+            actual.push_back(section + "." + key);
+        });
+        H_TEST_ASSERT(parallel.ParseParallel(s.data(), s.size(), 4));
+        H_TEST_ASSERT(parallel.GetSectionMap() == sequential.GetSectionMap());
+        H_TEST_ASSERT(parallel.Serialize(true) == sequential.Serialize(true));
+        H_TEST_ASSERT(actual.size() == 100000 + (i == 0 ? 2 : 0));
+        H_TEST_ASSERT(actual[actual.size() / 2].find(i == 0 ? "first.key" : ".key") == 0);
+    }
+}
+
+TEST_UNIT(ini_parser_parallel_test_listener) {
+    std::string s = MakeINI();
+    std::vector<std::string> expected;
+    simcc::INIParser sequential;
+    sequential.SetParseListener([&expected](simcc::INIParser&, const std::string & section, const std::string & key, const std::string & value) {
+        expected.push_back(section + "." + key + "=" + value);
+    });
+    H_TEST_ASSERT(sequential.Parse(s.data(), s.size()));
+
+    std::vector<std::string> actual;
+    simcc::INIParser parallel;
+    parallel.SetParseListener([&actual](simcc::INIParser&, const std::string & section, const std::string & key, const std::string & value) {
+        actual.push_back(section + "." + key + "=" + value);
+    });
+    H_TEST_ASSERT(parallel.ParseParallel(s.data(), s.size(), 3));
+    H_TEST_ASSERT(actual == expected);
+}
+
+TEST_UNIT(ini_parser_parallel_test_error) {
+    std::string s = MakeINI();
+    s.insert(s.size() / 2, "\nbad line\n");
+
+    simcc::INIParser strict;
+    H_TEST_ASSERT(!strict.ParseParallel(s.data(), s.size(), 4));
+    H_TEST_ASSERT(strict.error() == simcc::INIParser::kErrorCannotFindKVSeperator);
+
+    simcc::INIParser sequential(true, true);
+    H_TEST_ASSERT(sequential.Parse(s.data(), s.size()));
+    simcc::INIParser compatible(true, true);
+    H_TEST_ASSERT(compatible.ParseParallel(s.data(), s.size(), 4));
+    H_TEST_ASSERT(compatible.error() == simcc::INIParser::kErrorCannotFindKVSeperator);
+    H_TEST_ASSERT(compatible.GetSectionMap() == sequential.GetSectionMap());
+}
+
+TEST_UNIT(ini_parser_parallel_test_file) {
+    std::string path = "ini_parser_parallel_test_file.tmp";
+    std::string s = MakeINI();
+    H_TEST_ASSERT(simcc::FileUtil::WriteFile(path, s.data(), s.size()));
+
+    simcc::INIParser sequential;
+    H_TEST_ASSERT(sequential.Parse(path));
+    simcc::INIParser parallel;
+    H_TEST_ASSERT(parallel.ParseFileParallel(path));
+    H_TEST_ASSERT(parallel.GetSectionMap() == sequential.GetSectionMap());
+    simcc::FileUtil::Unlink(path);
+
+    // A small one is parsed in the current thread
+    simcc::INIParser small;
+    H_TEST_ASSERT(small.ParseParallel("a=1\n[s]\nb=2", 11, 8));
+    H_TEST_ASSERT(small.Get("s", "b") == "2");
+
+    simcc::INIParser not_exist;
+    H_TEST_ASSERT(!not_exist.ParseFileParallel(path));
+}
+
+#ifdef H_BENCHMARK_TESTING
+#include "simcc/timestamp.h"
+#include <iostream>
+
+TEST_UNIT(ini_parser_parallel_test_benchmark) {
+    std::string s = MakeINI();
+    for (int i = 0; i < 4; ++i) {
+        s += MakeINI();
+    }
+
+    simcc::Timestamp start = simcc::Timestamp::Now();
+    simcc::INIParser sequential;
+    H_TEST_ASSERT(sequential.Parse(s.data(), s.size()));
+    simcc::Duration sequential_cost = simcc::Timestamp::Now() - start;
+
+    start = simcc::Timestamp::Now();
+    simcc::INIParser parallel;
+    H_TEST_ASSERT(parallel.ParseParallel(s.data(), s.size(), 4));
+    simcc::Duration parallel_cost = simcc::Timestamp::Now() - start;
+
+    std::cout << ">>>>>>>>>>>>>>>> " << s.size() / 1024 / 1024 << "MB sequential cost=" << sequential_cost.Milliseconds() << "ms\n";
+    std::cout << ">>>>>>>>>>>>>>>> 4 threads cost=" << parallel_cost.Milliseconds() << "ms\n";
+}
+#endif
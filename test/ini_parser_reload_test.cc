@@ -0,0 +1,84 @@
+#include "test_common.h"
+
+#include "simcc/ini_parser.h"
+
+#include <vector>
+
+namespace {
+const char* kTypes[] = {"+", "-", "*"};
+
+struct ChangeRecorder {
+    std::vector<std::string> changes;
+
+    void OnValue(simcc::INIParser& parser, const std::string& section, const std::string& key, const std::string& value) {
+        changes.push_back(std::string(kTypes[parser.change_type()]) + section + "." + key + "=" + value);
+    }
+};
+}
+
+TEST_UNIT(ini_parser_reload_test_changes) {
+    std::string v1 = "a=1\nb=2\n[s1]\nx=1\ny=2\n[s2]\nz=1\n";
+    std::string v2 = "a=1\nb=3\nc=4\n[s1]\ny=2\n[s3]\nw=1\n";
+
+    ChangeRecorder recorder;
+    simcc::INIParser parser;
+    parser.SetParseListener(std::bind(&ChangeRecorder::OnValue, &recorder, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
+    H_TEST_ASSERT(parser.Parse(v1.data(), v1.size()));
+    H_TEST_ASSERT(recorder.changes.size() == 5);
+    H_TEST_ASSERT(recorder.changes[0] == "+.a=1");
+
+    // Only the differences are reported, in the order of the section map
+    recorder.changes.clear();
+    H_TEST_ASSERT(parser.Reload(v2.data(), v2.size()));
+    const char* expected[] = {
+        "*.b=3",
+        "+.c=4",
+        "-s1.x=1",
+        "-s2.z=1",
+        "+s3.w=1",
+    };
+    H_TEST_ASSERT(recorder.changes.size() == H_ARRAYSIZE(expected));
+    for (size_t i = 0; i < H_ARRAYSIZE(expected); ++i) {
+        H_TEST_ASSERT(recorder.changes[i] == expected[i]);
+    }
+
+    simcc::INIParser fresh;
+    H_TEST_ASSERT(fresh.Parse(v2.data(), v2.size()));
+    H_TEST_ASSERT(parser.GetSectionMap() == fresh.GetSectionMap());
+
+    // Nothing changed
+    recorder.changes.clear();
+    H_TEST_ASSERT(parser.Reload(v2.data(), v2.size()));
+    H_TEST_ASSERT(recorder.changes.empty());
+}
+
+TEST_UNIT(ini_parser_reload_test_failure) {
+    std::string v1 = "a=1\n";
+    std::string v2 = "a=2\nbad line\n";
+
+    ChangeRecorder recorder;
+    simcc::INIParser parser;
+    H_TEST_ASSERT(parser.Parse(v1.data(), v1.size()));
+    parser.SetParseListener(std::bind(&ChangeRecorder::OnValue, &recorder, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
+
+    // The current data is kept
+    H_TEST_ASSERT(!parser.Reload(v2.data(), v2.size()));
+    H_TEST_ASSERT(parser.error() == simcc::INIParser::kErrorCannotFindKVSeperator);
+    H_TEST_ASSERT(parser.Get("a") == "1");
+    H_TEST_ASSERT(recorder.changes.empty());
+}
+
+TEST_UNIT(ini_parser_reload_test_keep_sequence) {
+    std::string v1 = "[s]\nb=1\na=1\n";
+    std::string v2 = "[s]\nc=1\nb=2\n";
+    simcc::INIParser parser(true, false, true);
+    H_TEST_ASSERT(parser.Parse(v1.data(), v1.size()));
+
+    // The sequence listener of the last parsing must be gone
+    H_TEST_ASSERT(parser.Parse("d=1", 3));
+    H_TEST_ASSERT(parser.Serialize(true) == "[s]\nb=1\na=1\n[]\nd=1\n");
+
+    // The sequence is replaced too
+    H_TEST_ASSERT(parser.Reload(v2.data(), v2.size()));
+    H_TEST_ASSERT(parser.Serialize(true) == "[s]\nc=1\nb=2\n");
+}
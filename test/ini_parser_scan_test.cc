@@ -0,0 +1,59 @@
+#include "test_common.h"
+
+#include "simcc/ini_parser.h"
+
+TEST_UNIT(ini_parser_scan_test_not_null_terminated) {
+    // Only the first part of the buffer is parsed
+    std::string s = "a=1\nb=2\nc=3";
+    simcc::INIParser parser;
+    H_TEST_ASSERT(parser.Parse(s.data(), 7, "\n", "="));
+    H_TEST_ASSERT(parser.Get("a") == "1");
+    H_TEST_ASSERT(parser.Get("b") == "2");
+    bool found = true;
+    parser.Get("c", &found);
+    H_TEST_ASSERT(!found);
+
+    // The key/value separator is after the end
+    simcc::INIParser strict;
+    H_TEST_ASSERT(!strict.Parse(s.data(), 9, "\n", "="));
+    H_TEST_ASSERT(strict.error() == simcc::INIParser::kErrorCannotFindKVSeperator);
+}
+
+TEST_UNIT(ini_parser_scan_test_multi_char_separator) {
+    std::string s = "a:1||||c:3||d::4|| e : x|y ";
+    simcc::INIParser parser;
+    H_TEST_ASSERT(parser.Parse(s.data(), s.size(), "||", ":"));
+    H_TEST_ASSERT(parser.Get("a") == "1");
+    H_TEST_ASSERT(parser.Get("c") == "3");
+    H_TEST_ASSERT(parser.Get("d") == ":4");
+    H_TEST_ASSERT(parser.Get("e") == "x|y");
+
+    s = "k1::=v1\r\nk2 ::= v2:=\r\n";
+    simcc::INIParser parser2;
+    H_TEST_ASSERT(parser2.Parse(s.data(), s.size(), "\r\n", "::="));
+    H_TEST_ASSERT(parser2.Get("k1") == "v1");
+    H_TEST_ASSERT(parser2.Get("k2") == "v2:=");
+}
+
+TEST_UNIT(ini_parser_scan_test_long_lines) {
+    // Longer than a SIMD block on both sides of the separator
+    std::string key(40, 'k');
+    std::string value(70, 'v');
+    std::string s = "; comment\n[section]\n  " + key + "\t=\t" + value + "  \n# " + key + "=x\nshort=1";
+    simcc::INIParser parser;
+    H_TEST_ASSERT(parser.Parse(s.data(), s.size()));
+    H_TEST_ASSERT(parser.Get("section", key) == value);
+    H_TEST_ASSERT(parser.Get("section", "short") == "1");
+    H_TEST_ASSERT(parser.GetKeyValueMap("section").size() == 2);
+}
+
+TEST_UNIT(ini_parser_scan_test_compatible) {
+    // A line without the key/value separator is skipped if there are more pairs after it
+    std::string s = "a=1&xxx&b=2&yyy";
+    simcc::INIParser parser(true, true);
+    H_TEST_ASSERT(parser.Parse(s.data(), s.size(), "&", "="));
+    H_TEST_ASSERT(parser.error() == simcc::INIParser::kErrorCannotFindKVSeperator);
+    H_TEST_ASSERT(parser.Get("a") == "1");
+    H_TEST_ASSERT(parser.Get("b") == "2");
+    H_TEST_ASSERT(parser.GetDefaultKeyValueMap().size() == 2);
+}
@@ -0,0 +1,173 @@
+#include "test_common.h"
+
+#include "simcc/ini_snapshot.h"
+#include "simcc/data_stream.h"
+#include "simcc/file_util.h"
+#include "simcc/misc/md5.h"
+
+#include <algorithm>
+
+namespace {
+const char* kINI = "a = 1\n"
+                   "[S1]\n"
+                   "Key1 = v1\n"
+                   "key2 = v2\n"
+                   "[s2]\n"
+                   "k = \n"
+                   "[S1]\n"
+                   "key0 = v0\n"
+                   "Key1 = v1-new\n";
+}
+
+TEST_UNIT(ini_snapshot_test_query) {
+    std::string source(kINI);
+    std::string md5 = simcc::MD5::Sumh(source);
+    for (int c = 0; c < 2; ++c) {
+        bool case_sensitive = (c == 0);
+        simcc::INIParser ini(case_sensitive);
+        H_TEST_ASSERT(ini.Parse(source.data(), source.size()));
+
+        simcc::DataStream image;
+        H_TEST_ASSERT(simcc::INISnapshot::Write(ini, md5, image));
+
+        simcc::INISnapshot snapshot;
+        H_TEST_ASSERT(snapshot.Attach(image.data(), image.size(), md5));
+        H_TEST_ASSERT(snapshot.is_open());
+        H_TEST_ASSERT(snapshot.size() == 5);
+        H_TEST_ASSERT(snapshot.case_sensitive() == case_sensitive);
+        H_TEST_ASSERT(!snapshot.has_sequence());
+        H_TEST_ASSERT(snapshot.source_md5() == md5);
+
+        bool found = false;
+        H_TEST_ASSERT(snapshot.Get("a", &found) == "1");
+        H_TEST_ASSERT(found);
+        H_TEST_ASSERT(snapshot.Get("S1", "Key1") == "v1-new");
+        H_TEST_ASSERT(snapshot.Get("S1", "key0") == "v0");
+        H_TEST_ASSERT(snapshot.Get("s2", "k", &found).empty());
+        H_TEST_ASSERT(found);
+        snapshot.Get("s3", "k", &found);
+        H_TEST_ASSERT(!found);
+
+        // The same as INIParser::Get
+        snapshot.Get("s1", "KEY2", &found);
+        H_TEST_ASSERT(found == !case_sensitive);
+        ini.Get("s1", "KEY2", &found);
+        H_TEST_ASSERT(found == !case_sensitive);
+
+        // Stale or broken images are rejected
+        H_TEST_ASSERT(!snapshot.Attach(image.data(), image.size(), simcc::MD5::Sumh("other")));
+        H_TEST_ASSERT(!snapshot.is_open());
+        H_TEST_ASSERT(!snapshot.Attach(image.data(), image.size() - 1));
+        std::string broken(image.data(), image.size());
+        broken[0] = 'X';
+        H_TEST_ASSERT(!snapshot.Attach(broken.data(), broken.size()));
+
+        // The image of the other byte order, the byte order mark follows the magic and the version
+        std::string swapped(image.data(), image.size());
+        std::reverse(swapped.begin() + 12, swapped.begin() + 16);
+        H_TEST_ASSERT(!snapshot.Attach(swapped.data(), swapped.size()));
+    }
+}
+
+TEST_UNIT(ini_snapshot_test_restore) {
+    std::string source(kINI);
+    std::string md5 = simcc::MD5::Sumh(source);
+    std::string path = "ini_snapshot_test_restore.tmp";
+
+    simcc::INIParser ini(true, false, true);
+    H_TEST_ASSERT(ini.Parse(source.data(), source.size()));
+    H_TEST_ASSERT(ini.SaveSnapshot(path, md5));
+
+    simcc::INIParser loaded(true, false, true);
+    H_TEST_ASSERT(loaded.LoadSnapshot(path, md5));
+    H_TEST_ASSERT(loaded.GetSectionMap() == ini.GetSectionMap());
+    H_TEST_ASSERT(loaded.Serialize(true) == ini.Serialize(true));
+    H_TEST_ASSERT(loaded.Serialize(false) == ini.Serialize(false));
+
+    // The options must match
+    simcc::INIParser case_insensitive(false);
+    H_TEST_ASSERT(!case_insensitive.LoadSnapshot(path, md5));
+    simcc::INIParser compatible(true, true, true);
+    H_TEST_ASSERT(!compatible.LoadSnapshot(path, md5));
+    simcc::INIParser trimmed(true, false, true);
+    trimmed.set_trim_chars(" ");
+    H_TEST_ASSERT(!trimmed.LoadSnapshot(path, md5));
+    H_TEST_ASSERT(!loaded.LoadSnapshot(path, simcc::MD5::Sumh("other")));
+
+    simcc::INISnapshot snapshot;
+    H_TEST_ASSERT(snapshot.Open(path));
+    H_TEST_ASSERT(snapshot.has_sequence());
+    H_TEST_ASSERT(snapshot.Get("S1", "key2") == "v2");
+    snapshot.Close();
+    simcc::FileUtil::Unlink(path);
+}
+
+TEST_UNIT(ini_snapshot_test_parse_with_snapshot) {
+    std::string path = "ini_snapshot_test_parse_with_snapshot.ini";
+    std::string snapshot_path = path + ".snapshot";
+    std::string source(kINI);
+    H_TEST_ASSERT(simcc::FileUtil::WriteFile(path, source.data(), source.size()));
+    simcc::FileUtil::Unlink(snapshot_path);
+
+    // The first time it is parsed and the snapshot is written
+    simcc::INIParser first;
+    H_TEST_ASSERT(first.ParseWithSnapshot(path, snapshot_path));
+    H_TEST_ASSERT(simcc::FileUtil::IsFileExist(snapshot_path));
+
+    simcc::INIParser second;
+    H_TEST_ASSERT(second.ParseWithSnapshot(path, snapshot_path));
+    H_TEST_ASSERT(second.GetSectionMap() == first.GetSectionMap());
+    H_TEST_ASSERT(second.Get("S1", "Key1") == "v1-new");
+
+    // A changed file makes the snapshot stale
+    source += "b = 2\n";
+    H_TEST_ASSERT(simcc::FileUtil::WriteFile(path, source.data(), source.size()));
+    simcc::INIParser third;
+    H_TEST_ASSERT(third.ParseWithSnapshot(path, snapshot_path));
+    H_TEST_ASSERT(third.Get("S1", "b") == "2");
+
+    simcc::INISnapshot snapshot;
+    H_TEST_ASSERT(snapshot.Open(snapshot_path, simcc::MD5::Sumh(source)));
+    H_TEST_ASSERT(snapshot.Get("S1", "b") == "2");
+    snapshot.Close();
+
+    simcc::FileUtil::Unlink(path);
+    simcc::FileUtil::Unlink(snapshot_path);
+}
+
+TEST_UNIT(ini_snapshot_test_empty_section) {
+    std::string path = "ini_snapshot_test_empty_section.ini";
+    std::string snapshot_path = path + ".snapshot";
+    std::string source("a = 1\n[bar]\nk = v\n[baz]");
+    H_TEST_ASSERT(simcc::FileUtil::WriteFile(path, source.data(), source.size()));
+    simcc::FileUtil::Unlink(snapshot_path);
+
+    simcc::INIParser parsed;
+    H_TEST_ASSERT(parsed.Parse(source.data(), source.size()));
+    std::string empty_section;
+    for (auto it = parsed.GetSectionMap().begin(); it != parsed.GetSectionMap().end(); ++it) {
+        if (it->second.empty()) {
+            empty_section = it->first;
+        }
+    }
+    H_TEST_ASSERT(!empty_section.empty());
+
+    // The sections without any key are restored too
+    simcc::INIParser first;
+    H_TEST_ASSERT(first.ParseWithSnapshot(path, snapshot_path));
+    simcc::INIParser second;
+    H_TEST_ASSERT(second.ParseWithSnapshot(path, snapshot_path));
+    H_TEST_ASSERT(second.GetSectionMap() == parsed.GetSectionMap());
+
+    // They are not keys
+    simcc::INISnapshot snapshot;
+    H_TEST_ASSERT(snapshot.Open(snapshot_path, simcc::MD5::Sumh(source)));
+    bool found = true;
+    H_TEST_ASSERT(snapshot.Get(empty_section, "", &found).empty());
+    H_TEST_ASSERT(!found);
+    H_TEST_ASSERT(snapshot.Get("bar", "k") == "v");
+    snapshot.Close();
+
+    simcc::FileUtil::Unlink(path);
+    simcc::FileUtil::Unlink(snapshot_path);
+}
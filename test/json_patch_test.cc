@@ -0,0 +1,100 @@
+#include "test_common.h"
+
+#include "simcc/json/json.h"
+
+namespace {
+simcc::json::ObjectPtr Load(const char* s) {
+    return simcc::json::JSONParser::Load(s);
+}
+
+bool Equals(const simcc::json::ObjectPtr& a, const simcc::json::ObjectPtr& b) {
+    return a && b && a->Equals(*b);
+}
+}
+
+TEST_UNIT(json_patch_test_diff_and_apply) {
+    const char* from = "{\"a\":1,\"b\":{\"c\":\"x\",\"d\":[1,2,3]},\"e/f\":true,\"g\":null,\"h\":[{\"i\":1}]}";
+    const char* to = "{\"a\":2,\"b\":{\"c\":\"x\",\"d\":[1,5]},\"g\":null,\"h\":[{\"i\":1},{\"j\":2}],\"k\":[]}";
+    simcc::json::ObjectPtr f = Load(from);
+    simcc::json::ObjectPtr t = Load(to);
+    H_TEST_ASSERT(f && t);
+
+    simcc::json::JSONArrayPtr patch = simcc::json::JSONPatch::Diff(f.get(), t.get());
+    H_TEST_ASSERT(patch->size() == 6);
+    simcc::json::JSONObject* op = patch->GetJSONObject(0);
+    H_TEST_ASSERT(op->GetString("op") == "replace");
+    H_TEST_ASSERT(op->GetString("path") == "/a");
+    H_TEST_ASSERT(op->GetInteger("value") == 2);
+    H_TEST_ASSERT(patch->GetJSONObject(2)->GetString("path") == "/b/d/2");
+    H_TEST_ASSERT(patch->GetJSONObject(3)->GetString("op") == "remove");
+    H_TEST_ASSERT(patch->GetJSONObject(3)->GetString("path") == "/e~1f");
+
+    // Apply the serialized patch to a new copy of the original document
+    simcc::json::JSONArray shipped;
+    H_TEST_ASSERT(shipped.Parse(patch->ToString()) > 0);
+    simcc::json::ObjectPtr doc = Load(from);
+    H_TEST_ASSERT(simcc::json::JSONPatch::Apply(shipped, doc));
+    H_TEST_ASSERT(Equals(doc, t));
+
+    // No difference
+    H_TEST_ASSERT(simcc::json::JSONPatch::Diff(t.get(), doc.get())->empty());
+
+    // The root is replaced if the types are different
+    simcc::json::ObjectPtr arr = Load("[1]");
+    patch = simcc::json::JSONPatch::Diff(f.get(), arr.get());
+    H_TEST_ASSERT(patch->size() == 1);
+    H_TEST_ASSERT(simcc::json::JSONPatch::Apply(*patch, f));
+    H_TEST_ASSERT(Equals(f, arr));
+    H_TEST_ASSERT(f.get() != arr.get());
+}
+
+TEST_UNIT(json_patch_test_rfc6902_operations) {
+    simcc::json::ObjectPtr doc = Load("{\"foo\":[\"bar\",\"baz\"],\"q\":{\"x\":1}}");
+    simcc::json::JSONArray patch;
+    H_TEST_ASSERT(patch.Parse(
+        "[{\"op\":\"add\",\"path\":\"/foo/1\",\"value\":\"qux\"},"
+        "{\"op\":\"add\",\"path\":\"/foo/-\",\"value\":\"end\"},"
+        "{\"op\":\"test\",\"path\":\"/foo/1\",\"value\":\"qux\"},"
+        "{\"op\":\"copy\",\"from\":\"/q\",\"path\":\"/r\"},"
+        "{\"op\":\"move\",\"from\":\"/foo/0\",\"path\":\"/q/y\"},"
+        "{\"op\":\"replace\",\"path\":\"/r/x\",\"value\":2},"
+        "{\"op\":\"remove\",\"path\":\"/foo/2\"}]") > 0);
+    H_TEST_ASSERT(simcc::json::JSONPatch::Apply(patch, doc));
+    H_TEST_ASSERT(Equals(doc, Load("{\"foo\":[\"qux\",\"baz\"],\"q\":{\"x\":1,\"y\":\"bar\"},\"r\":{\"x\":2}}")));
+}
+
+TEST_UNIT(json_patch_test_failure) {
+    const char* ops[] = {
+        "[{\"op\":\"test\",\"path\":\"/a\",\"value\":2}]",
+        "[{\"op\":\"remove\",\"path\":\"/nonexistent\"}]",
+        "[{\"op\":\"replace\",\"path\":\"/b/5\",\"value\":2}]",
+        "[{\"op\":\"add\",\"path\":\"/b/01\",\"value\":2}]",
+        "[{\"op\":\"move\",\"from\":\"/b\",\"path\":\"/b/0\"}]",
+        "[{\"op\":\"add\",\"path\":\"a\",\"value\":2}]",
+        "[{\"op\":\"unknown\",\"path\":\"/a\"}]",
+        "[{\"op\":\"add\",\"path\":\"/a\",\"value\":2},{\"op\":\"remove\",\"path\":\"/x/y\"}]",
+    };
+
+    for (size_t i = 0; i < H_ARRAYSIZE(ops); ++i) {
+        simcc::json::ObjectPtr doc = Load("{\"a\":1,\"b\":[1,2]}");
+        simcc::json::JSONArray patch;
+        H_TEST_ASSERT(patch.Parse(ops[i]) > 0);
+        size_t failed = 100;
+        H_TEST_ASSERT(!simcc::json::JSONPatch::Apply(patch, doc, &failed));
+        H_TEST_ASSERT(failed == patch.size() - 1);
+    }
+}
+
+TEST_UNIT(json_patch_test_pointer) {
+    std::vector<std::string> tokens;
+    H_TEST_ASSERT(simcc::json::JSONPatch::ParsePointer("/a~1b/~0c/", tokens));
+    H_TEST_ASSERT(tokens.size() == 3);
+    H_TEST_ASSERT(tokens[0] == "a/b");
+    H_TEST_ASSERT(tokens[1] == "~c");
+    H_TEST_ASSERT(tokens[2] == "");
+    H_TEST_ASSERT(!simcc::json::JSONPatch::ParsePointer("/a~2", tokens));
+
+    std::string p;
+    simcc::json::JSONPatch::AppendPointerToken("a/b~", p);
+    H_TEST_ASSERT(p == "/a~1b~0");
+}
@@ -0,0 +1,137 @@
+#include "test_common.h"
+
+#include "simcc/json/json.h"
+#include "simcc/file_util.h"
+#include "simcc/utility.h"
+
+#include <vector>
+
+namespace {
+const char* kDebugString =
+    "id: 1024\n"
+    "name: \"\\346\\226\\260\\346\\265\\252\"\n"
+    "ratio: 0.5\n"
+    "enabled: true\n"
+    "type: TYPE_USER\n"
+    "# a comment line\n"
+    "tag: \"a\"\n"
+    "tag: \"b\"\n"
+    "user {\n"
+    "  uid: -7\n"
+    "  score: [1, 2, 3]\n"
+    "  addr <\n"
+    "    city: 'bj'\n"
+    "  >\n"
+    "}\n"
+    "user {\n"
+    "  uid: 8\n"
+    "}\n";
+}
+
+TEST_UNIT(json_protobuf_test_parse) {
+    simcc::json::JSONObject jo;
+    H_TEST_ASSERT(jo.ParseProtobuf(kDebugString) == strlen(kDebugString));
+    H_TEST_ASSERT(jo.ok());
+    H_TEST_ASSERT(jo.GetInteger("id") == 1024);
+    H_TEST_ASSERT(jo.GetString("name") == "\xe6\x96\xb0\xe6\xb5\xaa");
+    H_TEST_ASSERT(simcc::Util::Equals(jo.GetDouble("ratio"), 0.5, 0.00001));
+    H_TEST_ASSERT(jo.GetBool("enabled"));
+    H_TEST_ASSERT(jo.GetString("type") == "TYPE_USER");
+
+    simcc::json::JSONArray* tags = jo.GetJSONArray("tag");
+    H_TEST_ASSERT(tags && tags->size() == 2);
+    H_TEST_ASSERT(tags->GetString(0) == "a");
+    H_TEST_ASSERT(tags->GetString(1) == "b");
+
+    simcc::json::JSONArray* users = jo.GetJSONArray("user");
+    H_TEST_ASSERT(users && users->size() == 2);
+    simcc::json::JSONObject* u0 = users->GetJSONObject(0);
+    H_TEST_ASSERT(u0->GetInteger("uid") == -7);
+    H_TEST_ASSERT(u0->GetJSONArray("score")->size() == 3);
+    H_TEST_ASSERT(u0->GetJSONArray("score")->GetInteger(2) == 3);
+    H_TEST_ASSERT(u0->GetJSONObject("addr")->GetString("city") == "bj");
+    H_TEST_ASSERT(users->GetJSONObject(1)->GetInteger("uid") == 8);
+}
+
+TEST_UNIT(json_protobuf_test_short_debug_string) {
+    simcc::json::JSONObject jo;
+    const char* s = "a: 1 b { c: \"x\\ty\" \"z\" } d: 1.5f e: [] f: 18446744073709551615";
+    H_TEST_ASSERT(jo.ParseProtobuf(s, strlen(s)) > 0);
+    H_TEST_ASSERT(jo.GetInteger("a") == 1);
+    H_TEST_ASSERT(jo.GetJSONObject("b")->GetString("c") == "x\tyz");
+    H_TEST_ASSERT(simcc::Util::Equals(jo.GetDouble("d"), 1.5, 0.00001));
+    H_TEST_ASSERT(jo.GetJSONArray("e")->empty());
+    H_TEST_ASSERT(jo.GetString("f") == "18446744073709551615");
+}
+
+TEST_UNIT(json_protobuf_test_error) {
+    const char* s[] = {
+        "a: \"unterminated",
+        "a { b: 1",
+        "a 1",
+        "a: [1, 2",
+        "a: 1.2.3",
+    };
+    simcc::json::JSONParser::ErrorCode ec[] = {
+        simcc::json::JSONParser::kJSONStringNotQuoted,
+        simcc::json::JSONParser::kJSONObjectNotEndWithBraces,
+        simcc::json::JSONParser::kKeyValueSeperatorError,
+        simcc::json::JSONParser::kJSONArrayNotEndWithBrackets,
+        simcc::json::JSONParser::kInvalidIntegerOrDoubleString,
+    };
+    for (size_t i = 0; i < H_ARRAYSIZE(s); ++i) {
+        simcc::json::JSONObject jo;
+        H_TEST_ASSERT(jo.ParseProtobuf(s[i]) == 0);
+        H_TEST_ASSERT(jo.error() == ec[i]);
+    }
+}
+
+TEST_UNIT(json_protobuf_test_truncated_list) {
+    // Not terminated by '\0', nothing after the buffer is read
+    const char* s[] = { "a: [1, ", "a: [", "a: [ " };
+    for (size_t i = 0; i < H_ARRAYSIZE(s); ++i) {
+        std::vector<char> buf(s[i], s[i] + strlen(s[i]));
+        simcc::json::JSONObject jo;
+        H_TEST_ASSERT(jo.ParseProtobuf(&buf[0], buf.size()) == 0);
+        H_TEST_ASSERT(jo.error() == simcc::json::JSONParser::kBlankValue);
+    }
+}
+
+TEST_UNIT(json_protobuf_test_reader) {
+    std::string path = "json_protobuf_test_reader.tmp";
+    {
+        std::string content = "id: 1\nuser {\n  uid: 1\n}\n\n\r\nid: 2\n\nid: 3";
+        H_TEST_ASSERT(simcc::FileUtil::WriteFile(path, content.data(), content.size()));
+        simcc::json::ProtobufDebugStringReader reader;
+        H_TEST_ASSERT(reader.Open(path));
+        simcc::json::JSONObjectPtr record;
+        for (int i = 1; i <= 3; ++i) {
+            H_TEST_ASSERT(reader.Next(record));
+            H_TEST_ASSERT(record->GetInteger("id") == i);
+        }
+        H_TEST_ASSERT(record->GetInteger("id") == 3);
+        H_TEST_ASSERT(!reader.Next(record));
+        H_TEST_ASSERT(reader.ok());
+        H_TEST_ASSERT(reader.record_count() == 3);
+    }
+
+    {
+        std::string content = "id: 1 name: \"a\"\nid: 2\r\nid: {\nid: 4\n";
+        H_TEST_ASSERT(simcc::FileUtil::WriteFile(path, content.data(), content.size()));
+        simcc::json::ProtobufDebugStringReader reader(simcc::json::ProtobufDebugStringReader::kNewLine);
+        H_TEST_ASSERT(reader.Open(path));
+        simcc::json::JSONObjectPtr record;
+        H_TEST_ASSERT(reader.Next(record));
+        H_TEST_ASSERT(record->GetString("name") == "a");
+        H_TEST_ASSERT(reader.Next(record));
+        H_TEST_ASSERT(record->GetInteger("id") == 2);
+        H_TEST_ASSERT(!reader.Next(record));
+        H_TEST_ASSERT(!reader.ok());
+        H_TEST_ASSERT(reader.Next(record));
+        H_TEST_ASSERT(record->GetInteger("id") == 4);
+        H_TEST_ASSERT(!reader.Next(record));
+        H_TEST_ASSERT(reader.ok());
+    }
+
+    simcc::FileUtil::Unlink(path);
+}
@@ -0,0 +1,55 @@
+#include "test_common.h"
+
+#include "simcc/json/json.h"
+
+namespace {
+std::string Quote(const std::string& s, bool utf8_to_unicode = true) {
+    simcc::json::JSONString js(s);
+    return js.ToString(false, utf8_to_unicode);
+}
+}
+
+TEST_UNIT(json_quote_test_ascii) {
+    H_TEST_ASSERT(Quote("") == "\"\"");
+    H_TEST_ASSERT(Quote("abc") == "\"abc\"");
+    H_TEST_ASSERT(Quote("a/b</c") == "\"a/b</c\"");
+
+    // The special characters at every offset of a 8 bytes block
+    std::string plain = "0123456789abcdef";
+    for (size_t i = 0; i <= plain.size(); ++i) {
+        std::string s = plain;
+        s.insert(i, "\"\\\t\n\r\b\f");
+        std::string expected = "\"" + plain.substr(0, i) + "\\\"\\\\\\t\\n\\r\\b\\f" + plain.substr(i) + "\"";
+        H_TEST_ASSERT(Quote(s) == expected);
+    }
+}
+
+TEST_UNIT(json_quote_test_unicode) {
+    // CJK characters after a long ASCII run
+    H_TEST_ASSERT(Quote("hello world, \xe4\xb8\xad\xe6\x96\x87") == "\"hello world, \\u4e2d\\u6587\"");
+    H_TEST_ASSERT(Quote("\xc3\xa9") == "\"\\u00e9\"");
+
+    // Out of BMP, a UTF-16 surrogate pair
+    H_TEST_ASSERT(Quote("\xf0\x9f\x98\x80") == "\"\\ud83d\\ude00\"");
+
+    // Not UTF-8, e.g. GBK, is written as it is
+    H_TEST_ASSERT(Quote("\xd6\xd0") == "\"\xd6\xd0\"");
+
+    // A truncated UTF-8 sequence at the end
+    H_TEST_ASSERT(Quote("ab\xe4\xb8") == "\"ab\xe4\xb8\"");
+
+    H_TEST_ASSERT(Quote("\xe4\xb8\xad\xe6\x96\x87 0123456789", false) == "\"\xe4\xb8\xad\xe6\x96\x87 0123456789\"");
+}
+
+TEST_UNIT(json_quote_test_round_trip) {
+    std::string s;
+    for (int i = 0; i < 100; ++i) {
+        s += "\xe4\xb8\xad\xe6\x96\x87 text \"quoted\"\t\xf0\x9f\x98\x80/";
+    }
+
+    simcc::json::JSONObject jo;
+    jo.Put("k", s);
+    simcc::json::JSONObject parsed;
+    H_TEST_ASSERT(parsed.Parse(jo.ToString()) > 0);
+    H_TEST_ASSERT(parsed.GetString("k") == s);
+}
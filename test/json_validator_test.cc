@@ -0,0 +1,141 @@
+#include "test_common.h"
+
+#include "simcc/json/json.h"
+
+namespace {
+// Parse the text with the DOM parser and return its error code
+simcc::json::JSONParser::ErrorCode Parse(const std::string& s) {
+    if (!s.empty() && s[0] == '[') {
+        simcc::json::JSONArray ja;
+        ja.Parse(s.data(), s.size());
+        return ja.error();
+    }
+
+    simcc::json::JSONObject jo;
+    jo.Parse(s.data(), s.size());
+    return jo.error();
+}
+
+// Parse the text with the DOM parser and return its error location
+size_t ParseErrorLocation(const std::string& s) {
+    if (!s.empty() && s[0] == '[') {
+        simcc::json::JSONArray ja;
+        ja.Parse(s.data(), s.size());
+        return ja.error_location();
+    }
+
+    simcc::json::JSONObject jo;
+    jo.Parse(s.data(), s.size());
+    return jo.error_location();
+}
+}
+
+TEST_UNIT(json_validator_test_valid) {
+    const char* s[] = {
+        "{}",
+        "[]",
+        " /* comment */ {\"a\" : 1, \"b\":[1, 2.5, -3e2, 0x1F, 017], } // tail\n",
+        "{\"a\":{\"b\":{\"c\":[true,false,null,'single',\"\\u4e2d\\ud83d\\ude00\\n\"]}}}",
+        "[1,,2;3,]",
+        "{\"k\":\"\xe4\xb8\xad\xe6\x96\x87 a long string which is longer than eight bytes\"}",
+    };
+
+    for (size_t i = 0; i < H_ARRAYSIZE(s); ++i) {
+        simcc::json::JSONValidator v;
+        H_TEST_ASSERT(v.Validate(s[i]));
+        H_TEST_ASSERT(v.ok());
+        H_TEST_ASSERT(Parse(s[i]) == simcc::json::JSONParser::kNoError);
+    }
+}
+
+TEST_UNIT(json_validator_test_same_error_as_parser) {
+    const char* s[] = {
+        "{\"a\":1",
+        "{\"a\" 1}",
+        "{a:1}",
+        "{\"a\":}",
+        "{\"a\":abc}",
+        "{\"a\":0x1G}",
+        "{\"a\":\"unterminated}",
+        "{\"a\":\"bad escape \\x\"}",
+        "{\"a\":\"\\ud83d\"}",
+        "{\"unterminated:1}",
+        "{\"a\":1} /* unterminated comment",
+        "{\"a\":[1\t2]}",
+        "[1, {\"a\":1 \"b\":2}]",
+    };
+
+    for (size_t i = 0; i < H_ARRAYSIZE(s); ++i) {
+        simcc::json::JSONValidator v;
+        H_TEST_ASSERT(!v.Validate(s[i]));
+        if (i != 10) {
+            // The parser ignores the data after the top level value
+            H_TEST_ASSERT(v.error() == Parse(s[i]));
+        }
+    }
+}
+
+TEST_UNIT(json_validator_test_error_location) {
+    simcc::json::JSONValidator v;
+    std::string s = "{\"a\":1, \"b\" 2}";
+    H_TEST_ASSERT(!v.Validate(s));
+    H_TEST_ASSERT(v.error() == simcc::json::JSONParser::kKeyValueSeperatorError);
+    H_TEST_ASSERT(v.error_location() == s.find('2'));
+
+    s = "{\"a\":1} x";
+    H_TEST_ASSERT(!v.Validate(s));
+    H_TEST_ASSERT(v.error() == simcc::json::JSONParser::kInvalidCharacter);
+    H_TEST_ASSERT(v.error_location() == s.size() - 1);
+
+    H_TEST_ASSERT(!v.Validate(NULL, 0));
+    H_TEST_ASSERT(v.error() == simcc::json::JSONParser::kParameterWrong);
+}
+
+TEST_UNIT(json_validator_test_error_location_vs_parser) {
+    // The validator reports the offending character, the parser reports
+    // where its tokener stopped
+    struct {
+        const char* s;
+        size_t validator;
+        size_t parser;
+    } cases[] = {
+        { "{\"a\" 1}", 5, 5 },
+        { "{a:1}", 1, 1 },
+        { "{\"a\":0x1g}", 8, 8 },
+        { "{\"a\":tru}", 5, 7 }, // The start of the token vs its end
+        { "{\"a\":\"x\\q\"}", 7, 9 }, // The backslash vs after the string
+        { "{\"a\":[1,}", 8, 6 },
+        { "[1,2", 4, 3 }, // The end of the text vs the last token
+        { "{\"a\":\"abc", 9, 10 },
+    };
+
+    for (size_t i = 0; i < H_ARRAYSIZE(cases); ++i) {
+        std::string s = cases[i].s;
+        simcc::json::JSONValidator v(false);
+        H_TEST_ASSERT(!v.Validate(s));
+        H_TEST_ASSERT(v.error() == Parse(s));
+        H_TEST_ASSERT(v.error_location() == cases[i].validator);
+        H_TEST_ASSERT(ParseErrorLocation(s) == cases[i].parser);
+        H_TEST_ASSERT(v.error_location() <= s.size());
+    }
+}
+
+TEST_UNIT(json_validator_test_utf8) {
+    // an overlong encoding, a truncated sequence and a GBK string
+    const char* s[] = {
+        "{\"a\":\"0123456789\xc0\xaf\"}",
+        "{\"a\":\"\xe4\xb8\"}",
+        "{\"a\":\"\xd6\xd0\xce\xc4\"}",
+    };
+    size_t location[] = { 16, 6, 6 };
+
+    for (size_t i = 0; i < H_ARRAYSIZE(s); ++i) {
+        simcc::json::JSONValidator v;
+        H_TEST_ASSERT(!v.Validate(s[i]));
+        H_TEST_ASSERT(v.error() == simcc::json::JSONParser::kInvalidCharacter);
+        H_TEST_ASSERT(v.error_location() == location[i]);
+
+        simcc::json::JSONValidator nocheck(false);
+        H_TEST_ASSERT(nocheck.Validate(s[i]));
+    }
+}
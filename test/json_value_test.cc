@@ -0,0 +1,69 @@
+#include "test_common.h"
+
+#include "simcc/json/json.h"
+
+#include <thread>
+
+#ifndef H_OS_WINDOWS
+namespace {
+typedef simcc::json::ValueFreeList<sizeof(simcc::json::JSONInteger)> IntegerFreeList;
+
+// Destroyed after the free list of its thread, which is constructed later
+struct LateHolder {
+    simcc::json::JSONIntegerPtr value;
+    size_t* cached_after_release;
+    ~LateHolder() {
+        value = NULL;
+        *cached_after_release = IntegerFreeList::size();
+    }
+};
+}
+
+TEST_UNIT(json_value_test_free_list) {
+    typedef simcc::json::ValueFreeList<sizeof(simcc::json::JSONInteger)> FreeList;
+    simcc::json::JSONInteger* i = new simcc::json::JSONInteger(1);
+    void* p = i;
+    size_t cached = FreeList::size();
+    delete i;
+    H_TEST_ASSERT(FreeList::size() == cached + 1);
+
+    // The last freed block is reused first
+    simcc::json::JSONIntegerPtr j = new simcc::json::JSONInteger(2);
+    H_TEST_ASSERT(static_cast<void*>(j.get()) == p);
+    H_TEST_ASSERT(FreeList::size() == cached);
+    H_TEST_ASSERT(j->value() == 2);
+}
+
+TEST_UNIT(json_value_test_free_list_destroyed) {
+    size_t cached = 1;
+    std::thread t([&cached]() {
+        static thread_local LateHolder holder;
+        holder.cached_after_release = &cached;
+        delete new simcc::json::JSONInteger(1); // The free list is constructed after the holder
+        holder.value = new simcc::json::JSONInteger(2);
+    });
+    t.join();
+
+    // The value released after the free list is destroyed goes to operator delete
+    H_TEST_ASSERT(cached == 0);
+}
+#endif
+
+TEST_UNIT(json_value_test_reparse) {
+    const char* s = "{\"a\":1,\"b\":2.5,\"c\":true,\"d\":\"a short string\",\"e\":[1,2,3,\"a string longer than the small string buffer\",null]}";
+    for (int i = 0; i < 3; ++i) {
+        simcc::json::JSONObject jo;
+        H_TEST_ASSERT(jo.Parse(s) > 0);
+        H_TEST_ASSERT(jo.GetInteger("a") == 1);
+        H_TEST_ASSERT(jo.GetJSONDouble("b")->Equals(2.5));
+        H_TEST_ASSERT(jo.GetBool("c"));
+        H_TEST_ASSERT(jo.GetString("d") == "a short string");
+        simcc::json::JSONArray* a = jo.GetJSONArray("e");
+        H_TEST_ASSERT(a->size() == 5);
+        H_TEST_ASSERT(a->GetInteger(2) == 3);
+        H_TEST_ASSERT(a->GetString(3) == "a string longer than the small string buffer");
+        simcc::json::JSONObject copy;
+        H_TEST_ASSERT(copy.Parse(jo.ToString()) > 0);
+        H_TEST_ASSERT(copy.Equals(jo));
+    }
+}
@@ -0,0 +1,149 @@
+#include "test_common.h"
+
+#include "simcc/misc/lru_snapshot.h"
+#include "simcc/file_util.h"
+
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+namespace {
+typedef simcc::LRUCacheH4<std::string, int64_t, simcc::SizeofFunctor<int64_t>, simcc::NonFunctor<int64_t>, true> LRU;
+
+int64_t lru_snapshot_now = 1000000;
+
+int64_t FakeClock() {
+    return lru_snapshot_now;
+}
+
+std::vector<std::string> Keys(const LRU& lru) {
+    std::vector<std::string> keys;
+    for (LRU::const_iterator it = lru.mru_begin(); it != lru.end(); ++it) {
+        keys.push_back(it.key());
+    }
+    return keys;
+}
+}
+
+TEST_UNIT(lru_snapshot_test_save_load) {
+    std::string path = "lru_snapshot_test_save_load.tmp";
+    LRU lru(100, 0);
+    lru.set_clock(&FakeClock);
+    for (int64_t i = 0; i < 10; ++i) {
+        lru.insert("key" + std::to_string(i), i);
+    }
+    lru.insert("ttl", 100, 60000);
+    lru.insert("expired", 200, 10);
+    lru.find("key3");
+    lru_snapshot_now += 100;
+    H_TEST_ASSERT(simcc::LRUCacheSnapshot::Save(lru, path));
+
+    // The same order without the expired one
+    LRU loaded(100, 0);
+    loaded.set_clock(&FakeClock);
+    H_TEST_ASSERT(simcc::LRUCacheSnapshot::Load(path, loaded));
+    std::vector<std::string> expected = Keys(lru);
+    expected.erase(std::find(expected.begin(), expected.end(), "expired"));
+    H_TEST_ASSERT(Keys(loaded) == expected);
+    H_TEST_ASSERT(loaded.mru_begin().key() == "key3");
+    H_TEST_ASSERT(loaded.find("key5").value() == 5);
+
+    // The TTL is kept
+    H_TEST_ASSERT(loaded.find("ttl").expire_ms() > lru_snapshot_now + 50000);
+    H_TEST_ASSERT(loaded.find("ttl").expire_ms() <= lru_snapshot_now + 59900);
+    H_TEST_ASSERT(loaded.find("key1").expire_ms() == 0);
+
+    // A smaller cache gets the most recent ones
+    LRU small(3, 0);
+    H_TEST_ASSERT(simcc::LRUCacheSnapshot::Load(path, small));
+    H_TEST_ASSERT(small.size() == 3);
+    std::vector<std::string> top(expected.begin(), expected.begin() + 3);
+    H_TEST_ASSERT(Keys(small) == top);
+
+    // Broken ones are rejected
+    simcc::DataStream ds;
+    H_TEST_ASSERT(ds.ReadFile(path));
+    simcc::DataStream truncated(const_cast<char*>(ds.data()), ds.size() - 1, false);
+    LRU broken(100, 0);
+    H_TEST_ASSERT(!simcc::LRUCacheSnapshot::Read(truncated, broken));
+    H_TEST_ASSERT(!simcc::LRUCacheSnapshot::Load(path + ".not_exist", broken));
+
+    simcc::FileUtil::Unlink(path);
+}
+
+TEST_UNIT(lru_snapshot_test_background) {
+    std::string path = "lru_snapshot_test_background.tmp";
+    {
+        LRU lru(10000, 0);
+        for (int64_t i = 0; i < 5000; ++i) {
+            lru.insert(std::to_string(i), i);
+        }
+        H_TEST_ASSERT(simcc::LRUCacheSnapshot::Save(lru, path));
+    }
+
+    LRU lru(10000, 0);
+    std::mutex mutex;
+    simcc::LRUCacheLoader<LRU> loader;
+    H_TEST_ASSERT(loader.Start(path, &lru, &mutex));
+
+    // Serving meanwhile, the new values win
+    for (int64_t i = 0; i < 5000; i += 10) {
+        std::lock_guard<std::mutex> guard(mutex);
+        lru.insert(std::to_string(i), -i);
+    }
+
+    loader.Wait();
+    H_TEST_ASSERT(loader.done());
+    H_TEST_ASSERT(loader.ok());
+    H_TEST_ASSERT(lru.size() == 5000);
+    H_TEST_ASSERT(loader.loaded() >= 4500);
+    for (int64_t i = 0; i < 5000; ++i) {
+        H_TEST_ASSERT(lru.find(std::to_string(i)).value() == (i % 10 == 0 ? -i : i));
+    }
+
+    simcc::LRUCacheLoader<LRU> missing;
+    H_TEST_ASSERT(missing.Start(path + ".not_exist", &lru, &mutex));
+    missing.Wait();
+    H_TEST_ASSERT(!missing.ok());
+
+    simcc::FileUtil::Unlink(path);
+}
+
+TEST_UNIT(lru_snapshot_test_expired_while_saved) {
+    std::string path = "lru_snapshot_test_expired_while_saved.tmp";
+    LRU lru(100, 0);
+    lru.set_clock(&FakeClock);
+    lru.insert("old1", 1);
+    lru.insert("old2", 2);
+    for (int64_t i = 0; i < 5; ++i) {
+        lru.insert("short" + std::to_string(i), i, 1000);
+    }
+    H_TEST_ASSERT(simcc::LRUCacheSnapshot::Save(lru, path));
+
+    // Saved a minute ago, the short ones at the MRU end are expired by now
+    simcc::DataStream ds;
+    H_TEST_ASSERT(ds.ReadFile(path));
+    char* saved_time = const_cast<char*>(ds.data()) + 8 + sizeof(uint32_t);
+    int64_t t = 0;
+    memcpy(&t, saved_time, sizeof(t));
+    t -= 60;
+    memcpy(saved_time, &t, sizeof(t));
+
+    std::vector<simcc::LRUCacheSnapshot::Item<std::string, int64_t>> items;
+    simcc::DataStream copy;
+    copy.write(ds.data(), ds.size());
+    H_TEST_ASSERT(simcc::LRUCacheSnapshot::ReadItems(copy, items));
+    H_TEST_ASSERT(items.size() == 2);
+
+    // They must not take the places of the live ones
+    LRU small(2, 0);
+    H_TEST_ASSERT(simcc::LRUCacheSnapshot::Read(ds, small));
+    H_TEST_ASSERT(small.size() == 2);
+    std::vector<std::string> expected;
+    expected.push_back("old2");
+    expected.push_back("old1");
+    H_TEST_ASSERT(Keys(small) == expected);
+
+
+    simcc::FileUtil::Unlink(path);
+}
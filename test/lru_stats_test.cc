@@ -0,0 +1,139 @@
+#include "test_common.h"
+
+#include "simcc/misc/lru_stats.h"
+
+namespace {
+int64_t lru_stats_now = 1000000;
+
+int64_t FakeClock() {
+    return lru_stats_now;
+}
+
+typedef simcc::LRUCacheH4<int, int, simcc::SizeofFunctor<int>, simcc::NonFunctor<int>, true> LRU;
+
+bool Near(double a, double b) {
+    return a - b < 0.0001 && b - a < 0.0001;
+}
+}
+
+TEST_UNIT(lru_stats_test_counters) {
+    LRU lru(3, 0);
+    lru.set_clock(&FakeClock);
+    lru.insert(1, 1);
+    lru.insert(2, 2);
+    lru.insert(2, 20);
+    lru.insert(3, 3, 100);
+    lru.insert(4, 4); // evicts 1
+    H_TEST_ASSERT(lru.find(2) != lru.end());
+    H_TEST_ASSERT(lru.find(1) == lru.end());
+    const LRU& const_lru = lru;
+    H_TEST_ASSERT(const_lru.find(4) != lru.end());
+    H_TEST_ASSERT(lru.erase(4));
+
+    lru_stats_now += 1000;
+    H_TEST_ASSERT(lru.find(3) == lru.end());
+
+    simcc::LRUCacheStats s = lru.stats();
+    H_TEST_ASSERT(s.hits == 2);
+    H_TEST_ASSERT(s.misses == 2);
+    H_TEST_ASSERT(s.inserts == 4);
+    H_TEST_ASSERT(s.updates == 1);
+    H_TEST_ASSERT(s.evictions_by_count == 1);
+    H_TEST_ASSERT(s.evictions_by_memory == 0);
+    H_TEST_ASSERT(s.expirations == 1);
+    H_TEST_ASSERT(s.erases == 1);
+    H_TEST_ASSERT(s.evicted_bytes > 0);
+    H_TEST_ASSERT(s.size == 1);
+    H_TEST_ASSERT(s.max_size == 3);
+    H_TEST_ASSERT(Near(s.hit_ratio(), 0.5));
+
+    lru.ResetStats();
+    s = lru.stats();
+    H_TEST_ASSERT(s.hits == 0 && s.misses == 0 && s.inserts == 0 && s.evicted_bytes == 0);
+    H_TEST_ASSERT(Near(s.hit_ratio(), 0.0));
+}
+
+TEST_UNIT(lru_stats_test_evicted_by_memory) {
+    LRU probe(1, 0);
+    probe.insert(0, 0);
+    size_t item_size = probe.memory_size();
+
+    LRU lru(100, item_size * 3);
+    for (int i = 0; i < 10; ++i) {
+        lru.insert(i, i);
+    }
+    simcc::LRUCacheStats s = lru.stats();
+    H_TEST_ASSERT(s.evictions_by_count == 0);
+    H_TEST_ASSERT(s.evictions_by_memory == 7);
+    H_TEST_ASSERT(s.evicted_bytes == item_size * 7);
+}
+
+TEST_UNIT(lru_stats_test_ghost) {
+    LRU lru(10, 0);
+    lru.set_ghost_size(16);
+    for (int i = 0; i < 20; ++i) {
+        lru.insert(i, i);
+    }
+
+    // 0 would be a hit with 10 more items, 9 with 1 more
+    H_TEST_ASSERT(lru.find(0) == lru.end());
+    H_TEST_ASSERT(lru.find(9) == lru.end());
+    simcc::LRUCacheStats s = lru.stats();
+    H_TEST_ASSERT(s.ghost_hits[0] == 1);
+    H_TEST_ASSERT(s.ghost_hits[9] == 1);
+    H_TEST_ASSERT(Near(s.EstimatedHitRatio(0), 0.0));
+    H_TEST_ASSERT(Near(s.EstimatedHitRatio(1), 0.5));
+    H_TEST_ASSERT(Near(s.EstimatedHitRatio(9), 0.5));
+    H_TEST_ASSERT(Near(s.EstimatedHitRatio(10), 1.0));
+
+    // Inserted again, it is not a ghost any more
+    lru.insert(9, 9);
+    lru.erase(9);
+    H_TEST_ASSERT(lru.find(9) == lru.end());
+    H_TEST_ASSERT(lru.stats().ghost_hits[0] == 1);
+
+    // Only the last ghost_size evicted keys are kept
+    for (int i = 20; i < 40; ++i) {
+        lru.insert(i, i);
+    }
+    H_TEST_ASSERT(lru.find(0) == lru.end());
+    H_TEST_ASSERT(lru.stats().ghost_hits[9] == 1);
+    H_TEST_ASSERT(lru.find(20) == lru.end());
+    H_TEST_ASSERT(lru.stats().ghost_hits[9] == 2);
+
+    lru.set_ghost_size(0);
+    H_TEST_ASSERT(lru.find(21) == lru.end());
+    H_TEST_ASSERT(lru.stats().ghost_hits[9] == 2);
+}
+
+TEST_UNIT(lru_stats_test_json) {
+    LRU lru(10, 0);
+    lru.set_ghost_size(32);
+    for (int i = 0; i < 30; ++i) {
+        lru.insert(i, i);
+    }
+    for (int i = 0; i < 30; ++i) {
+        lru.find(i);
+    }
+
+    std::string s = simcc::ToJSON(lru.stats())->ToString();
+    simcc::json::JSONObject jo;
+    H_TEST_ASSERT(jo.Parse(s));
+    H_TEST_ASSERT(jo.GetInteger("hits") == 10);
+    H_TEST_ASSERT(jo.GetInteger("misses") == 20);
+    H_TEST_ASSERT(jo.GetInteger("evictions_by_count") == 20);
+    H_TEST_ASSERT(jo.GetInteger("max_memory_size") == 0);
+    H_TEST_ASSERT(jo.GetInteger("ghost_size") == 32);
+    simcc::json::JSONArray* estimated = jo.GetJSONArray("estimated");
+    H_TEST_ASSERT(estimated && estimated->size() == simcc::LRUCacheStats::kGhostBucketCount);
+
+    // The ratio grows with the size
+    double last = 0;
+    for (size_t i = 0; i < estimated->size(); ++i) {
+        simcc::json::JSONObject* e = estimated->GetJSONObject(int(i));
+        H_TEST_ASSERT(e->GetInteger("max_size") == int64_t(10 + (i + 1) * 2));
+        H_TEST_ASSERT(e->GetDouble("hit_ratio") >= last);
+        last = e->GetDouble("hit_ratio");
+    }
+    H_TEST_ASSERT(last > 0.3);
+}
@@ -0,0 +1,137 @@
+#include "test_common.h"
+
+#include "simcc/misc/lru.h"
+
+namespace {
+int64_t lru_ttl_now = 1000000;
+int lru_ttl_deleted = 0;
+
+int64_t FakeClock() {
+    return lru_ttl_now;
+}
+
+struct CountDeleter {
+    void operator()(int&) const {
+        lru_ttl_deleted++;
+    }
+};
+
+typedef simcc::LRUCacheH4<std::string, int, simcc::SizeofFunctor<int>, CountDeleter, true> LRU;
+}
+
+TEST_UNIT(lru_ttl_test_find_misses_expired) {
+    lru_ttl_now = 1000000;
+    lru_ttl_deleted = 0;
+    LRU lru(100, 0, simcc::SizeofFunctor<int>(), CountDeleter());
+    lru.set_clock(&FakeClock);
+    lru.insert("forever", 1);
+    lru.insert("short", 2, 500);
+    lru.insert("long", 3, 5000);
+    H_TEST_ASSERT(lru.size() == 3);
+
+    lru_ttl_now += 499;
+    H_TEST_ASSERT(lru.find("short") != lru.end());
+
+    // It is expired exactly at the time
+    lru_ttl_now += 1;
+    const LRU& const_lru = lru;
+    H_TEST_ASSERT(const_lru.find("short") == lru.end());
+    H_TEST_ASSERT(lru.find("short") == lru.end());
+    H_TEST_ASSERT(lru.size() == 2);
+    H_TEST_ASSERT(lru_ttl_deleted == 1);
+
+    // Inserting again resets the TTL
+    lru.insert("long", 30, 5000);
+    lru_ttl_now += 4999;
+    H_TEST_ASSERT(lru.find("long").value() == 30);
+    lru.insert("long", 300);
+    lru_ttl_now += 1000000;
+    H_TEST_ASSERT(lru.find("long").value() == 300);
+    H_TEST_ASSERT(lru.find("forever").value() == 1);
+}
+
+TEST_UNIT(lru_ttl_test_removed_by_wheel) {
+    lru_ttl_now = 2000000;
+    lru_ttl_deleted = 0;
+    {
+        LRU lru(1000, 0, simcc::SizeofFunctor<int>(), CountDeleter());
+        lru.set_clock(&FakeClock);
+        lru.set_ttl_resolution_ms(10);
+        for (int i = 0; i < 100; ++i) {
+            lru.insert(std::to_string(i), i, (i + 1) * 10);
+        }
+        lru.insert("forever", -1);
+
+        // The slot of the current tick is not passed yet
+        lru_ttl_now += 255;
+        H_TEST_ASSERT(lru.RemoveExpired() == 24);
+        H_TEST_ASSERT(lru.size() == 77);
+
+        // They are removed by the other operations too
+        lru_ttl_now += 10;
+        H_TEST_ASSERT(lru.find("forever") != lru.end());
+        H_TEST_ASSERT(lru.size() == 76);
+
+        // Longer than a round of the wheel
+        lru.insert("round", 0, LRU::kWheelSlotCount * 10 * 3 + 5);
+        lru_ttl_now += 1000;
+        H_TEST_ASSERT(lru.RemoveExpired() == 75);
+        H_TEST_ASSERT(lru.size() == 2);
+        lru_ttl_now += LRU::kWheelSlotCount * 10 * 2;
+        H_TEST_ASSERT(lru.RemoveExpired() == 0);
+        H_TEST_ASSERT(lru.find("round") != lru.end());
+        lru_ttl_now += 10000;
+        H_TEST_ASSERT(lru.RemoveExpired() == 1);
+        H_TEST_ASSERT(lru.size() == 1);
+        H_TEST_ASSERT(lru.mru_begin().key() == "forever");
+        H_TEST_ASSERT(lru.lru_begin().key() == "forever");
+        H_TEST_ASSERT(lru_ttl_deleted == 101);
+    }
+    H_TEST_ASSERT(lru_ttl_deleted == 102);
+}
+
+TEST_UNIT(lru_ttl_test_default_ttl_and_eviction) {
+    lru_ttl_now = 3000000;
+    LRU lru(3, 0, simcc::SizeofFunctor<int>(), CountDeleter());
+    lru.set_clock(&FakeClock);
+    lru.set_default_ttl_ms(100);
+    lru.insert("a", 1);
+    lru.insert("b", 2);
+    lru.insert("c", 3, 0);
+    lru.insert("d", 4);
+    H_TEST_ASSERT(lru.size() == 3);
+    H_TEST_ASSERT(lru.find("a") == lru.end());
+
+    H_TEST_ASSERT(lru.erase("b"));
+    H_TEST_ASSERT(!lru.erase("b"));
+    lru_ttl_now += 1000;
+    H_TEST_ASSERT(lru.RemoveExpired() == 1);
+    H_TEST_ASSERT(lru.size() == 1);
+    H_TEST_ASSERT(lru.find("c").value() == 3);
+
+    lru.insert("e", 5);
+    lru.insert("f", 6);
+    H_TEST_ASSERT(lru.size() == 3);
+    H_TEST_ASSERT(lru.lru_begin().key() == "c");
+    H_TEST_ASSERT(lru.mru_begin().key() == "f");
+}
+
+TEST_UNIT(lru_ttl_test_without_ttl) {
+    // The items of a cache without TTL are smaller, and the TTLs are ignored
+    typedef simcc::LRUCacheH4<std::string, int> NoTTL;
+    H_TEST_ASSERT(sizeof(simcc::LRUCacheH4Value<std::string, int>) + sizeof(int64_t) + 2 * sizeof(void*)
+                  == sizeof(simcc::LRUCacheH4Value<std::string, int, true>));
+
+    lru_ttl_now = 4000000;
+    NoTTL lru(10, 0);
+    lru.set_clock(&FakeClock);
+    lru.insert("a", 1, 100);
+    LRU with_ttl(10, 0, simcc::SizeofFunctor<int>(), CountDeleter());
+    with_ttl.insert("a", 1);
+    H_TEST_ASSERT(with_ttl.memory_size() - lru.memory_size() == sizeof(int64_t) + 2 * sizeof(void*));
+
+    lru_ttl_now += 1000;
+    H_TEST_ASSERT(lru.RemoveExpired() == 0);
+    H_TEST_ASSERT(lru.find("a").value() == 1);
+    H_TEST_ASSERT(lru.find("a").expire_ms() == 0);
+}
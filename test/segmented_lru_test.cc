@@ -0,0 +1,222 @@
+#include "test_common.h"
+
+#include "simcc/misc/segmented_lru.h"
+#include "simcc/random.h"
+
+#include <math.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+namespace {
+typedef simcc::LRUCacheH4<uint32_t, uint32_t> LRU;
+typedef simcc::SegmentedLRUCache<uint32_t, uint32_t> SLRU;
+typedef simcc::SegmentedLRUCache<uint32_t, uint32_t, simcc::TinyLFUAdmission> TinyLFU;
+
+int segmented_lru_deleted = 0;
+
+// Counts the recorded accesses
+struct CountAdmission {
+    static int records;
+    void Reserve(size_t) {}
+    void Record(size_t) {
+        records++;
+    }
+    bool Admit(size_t, size_t) {
+        return true;
+    }
+};
+int CountAdmission::records = 0;
+
+struct CountDeleter {
+    void operator()(int&) const {
+        segmented_lru_deleted++;
+    }
+};
+
+// The keys of [0, n) with the probability of the key k in proportion to 1/(k+1)^s
+class ZipfGenerator {
+public:
+    ZipfGenerator(uint32_t n, double s, uint32_t seed) : random_(seed) {
+        cdf_.resize(n);
+        double sum = 0;
+        for (uint32_t i = 0; i < n; ++i) {
+            sum += 1.0 / pow(double(i + 1), s);
+            cdf_[i] = sum;
+        }
+        for (uint32_t i = 0; i < n; ++i) {
+            cdf_[i] /= sum;
+        }
+    }
+
+    uint32_t Next() {
+        double u = double(random_.Next()) / 2147483647.0;
+        return uint32_t(std::lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin());
+    }
+
+private:
+    simcc::Random random_;
+    std::vector<double> cdf_;
+};
+
+// The Zipf keys, with a scan of one-off keys every scan_interval accesses if it is not 0
+std::vector<uint32_t> MakeTrace(size_t count, uint32_t scan_interval, uint32_t scan_length) {
+    ZipfGenerator zipf(100000, 0.9, 301);
+    std::vector<uint32_t> trace;
+    uint32_t one_off = 100000;
+    while (trace.size() < count) {
+        trace.push_back(zipf.Next());
+        if (scan_interval != 0 && trace.size() % scan_interval == 0) {
+            for (uint32_t i = 0; i < scan_length; ++i) {
+                trace.push_back(one_off++);
+            }
+        }
+    }
+    return trace;
+}
+
+double HitRatio(LRU& cache, const std::vector<uint32_t>& trace) {
+    size_t hits = 0;
+    for (size_t i = 0; i < trace.size(); ++i) {
+        if (cache.find(trace[i]) != cache.end()) {
+            ++hits;
+        } else {
+            cache.insert(trace[i], trace[i]);
+        }
+    }
+    return double(hits) / trace.size();
+}
+
+template<class Cache>
+double HitRatio(Cache& cache, const std::vector<uint32_t>& trace) {
+    size_t hits = 0;
+    for (size_t i = 0; i < trace.size(); ++i) {
+        if (cache.Find(trace[i])) {
+            ++hits;
+        } else {
+            cache.Insert(trace[i], trace[i]);
+        }
+    }
+    return double(hits) / trace.size();
+}
+}
+
+TEST_UNIT(segmented_lru_test_basic) {
+    segmented_lru_deleted = 0;
+    {
+        simcc::SegmentedLRUCache<std::string, int, simcc::AlwaysAdmit, simcc::SizeofFunctor<int>, CountDeleter> cache(10, 0, 20);
+        for (int i = 0; i < 10; ++i) {
+            cache.Insert(std::to_string(i), i);
+        }
+        H_TEST_ASSERT(cache.size() == 10);
+        H_TEST_ASSERT(cache.window_size() == 2);
+        H_TEST_ASSERT(cache.probation_size() == 8);
+
+        // The hit ones are protected
+        H_TEST_ASSERT(*cache.Find("0") == 0);
+        H_TEST_ASSERT(*cache.Find("1") == 1);
+        H_TEST_ASSERT(cache.protected_size() == 2);
+        for (int i = 10; i < 20; ++i) {
+            cache.Insert(std::to_string(i), i);
+        }
+        H_TEST_ASSERT(cache.size() == 10);
+        H_TEST_ASSERT(cache.Find("0") != NULL);
+        H_TEST_ASSERT(cache.Find("1") != NULL);
+        H_TEST_ASSERT(cache.Find("2") == NULL);
+        H_TEST_ASSERT(segmented_lru_deleted == 10);
+
+        cache.Insert("0", 100);
+        H_TEST_ASSERT(*cache.Find("0") == 100);
+        H_TEST_ASSERT(segmented_lru_deleted == 11);
+        H_TEST_ASSERT(cache.Erase("0"));
+        H_TEST_ASSERT(!cache.Erase("0"));
+        H_TEST_ASSERT(cache.size() == 9);
+        H_TEST_ASSERT(segmented_lru_deleted == 12);
+
+        size_t n = 0;
+        cache.ForEach([&n](const std::string&, const int&) {
+            ++n;
+        });
+        H_TEST_ASSERT(n == 9);
+    }
+    H_TEST_ASSERT(segmented_lru_deleted == 21);
+}
+
+TEST_UNIT(segmented_lru_test_record_once) {
+    // A miss and the fill after it are one access, the same as a hit
+    simcc::SegmentedLRUCache<uint32_t, uint32_t, CountAdmission> cache(10, 0);
+    CountAdmission::records = 0;
+    H_TEST_ASSERT(cache.Find(1) == NULL);
+    cache.Insert(1, 1);
+    H_TEST_ASSERT(CountAdmission::records == 1);
+    H_TEST_ASSERT(cache.Find(1) != NULL);
+    H_TEST_ASSERT(CountAdmission::records == 2);
+    cache.Insert(1, 2);
+    H_TEST_ASSERT(CountAdmission::records == 2);
+}
+
+TEST_UNIT(segmented_lru_test_memory_limit) {
+    SLRU cache(1000, 0);
+    cache.Insert(0, 0);
+    size_t item_size = cache.memory_size();
+
+    SLRU limited(1000, item_size * 10);
+    for (uint32_t i = 0; i < 100; ++i) {
+        limited.Insert(i, i);
+    }
+    H_TEST_ASSERT(limited.size() == 10);
+    H_TEST_ASSERT(limited.memory_size() == item_size * 10);
+    H_TEST_ASSERT(limited.Find(99) != NULL);
+}
+
+TEST_UNIT(segmented_lru_test_scan_resistant) {
+    // The hot keys are accessed 10 times, then comes a scan of the one-off keys
+    LRU lru(1000, 0);
+    TinyLFU tinylfu(1000, 0);
+    std::vector<uint32_t> hot;
+    for (uint32_t round = 0; round < 10; ++round) {
+        for (uint32_t i = 0; i < 500; ++i) {
+            hot.push_back(i);
+        }
+    }
+    HitRatio(lru, hot);
+    HitRatio(tinylfu, hot);
+
+    std::vector<uint32_t> scan;
+    for (uint32_t i = 0; i < 5000; ++i) {
+        scan.push_back(1000000 + i);
+    }
+    HitRatio(lru, scan);
+    HitRatio(tinylfu, scan);
+
+    std::vector<uint32_t> again(hot.begin(), hot.begin() + 500);
+    H_TEST_ASSERT(HitRatio(lru, again) < 0.01);
+    H_TEST_ASSERT(HitRatio(tinylfu, again) > 0.95);
+}
+
+TEST_UNIT(segmented_lru_test_zipf_hit_ratio) {
+    std::vector<uint32_t> trace = MakeTrace(200000, 1000, 1000);
+    LRU lru(1000, 0);
+    TinyLFU tinylfu(1000, 0);
+    double lru_ratio = HitRatio(lru, trace);
+    double tinylfu_ratio = HitRatio(tinylfu, trace);
+    H_TEST_ASSERT(tinylfu_ratio > lru_ratio);
+}
+
+#ifdef H_BENCHMARK_TESTING
+TEST_UNIT(segmented_lru_test_benchmark) {
+    const char* names[] = {"zipf", "zipf+scan"};
+    for (int t = 0; t < 2; ++t) {
+        std::vector<uint32_t> trace = MakeTrace(2000000, t == 0 ? 0 : 10000, 20000);
+        for (size_t capacity = 1000; capacity <= 100000; capacity *= 10) {
+            LRU lru(capacity, 0);
+            SLRU slru(capacity, 0);
+            TinyLFU tinylfu(capacity, 0);
+            std::cout << names[t] << " capacity=" << capacity
+                      << " LRUCacheH4=" << HitRatio(lru, trace)
+                      << " SLRU=" << HitRatio(slru, trace)
+                      << " W-TinyLFU=" << HitRatio(tinylfu, trace) << "\n";
+        }
+    }
+}
+#endif
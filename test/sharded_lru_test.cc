@@ -0,0 +1,122 @@
+#include "test_common.h"
+
+#include "simcc/misc/sharded_lru.h"
+#include "simcc/misc/dgram_filter.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+std::atomic<int> sharded_lru_deleted(0);
+
+struct CountDeleter {
+    void operator()(int&) const {
+        sharded_lru_deleted++;
+    }
+};
+}
+
+TEST_UNIT(sharded_lru_test_single_shard) {
+    // A small cache has only one shard and works the same as LRUCacheH4
+    simcc::ShardedLRUCacheH4<std::string, int> lru(2, 0, 16);
+    H_TEST_ASSERT(lru.shard_count() == 1);
+    lru.Insert("key1", 1);
+    lru.Insert("key2", 2);
+    int v = 0;
+    H_TEST_ASSERT(lru.Find("key1", &v));
+    H_TEST_ASSERT(v == 1);
+    lru.Insert("key3", 3);
+    H_TEST_ASSERT(lru.size() == 2);
+    H_TEST_ASSERT(!lru.Find("key2", &v));
+    H_TEST_ASSERT(lru.Visit("key3", [](int & value) {
+        value += 10;
+    }));
+    H_TEST_ASSERT(lru.Find("key3", &v));
+    H_TEST_ASSERT(v == 13);
+
+    lru.FindOrInsert("key4", []() {
+        return 4;
+    }, [](int & value) {
+        value *= 2;
+    });
+    H_TEST_ASSERT(lru.Find("key4", &v));
+    H_TEST_ASSERT(v == 8);
+    H_TEST_ASSERT(!lru.Find("key1", &v));
+}
+
+TEST_UNIT(sharded_lru_test_limits) {
+    simcc::ShardedLRUCacheH4<int, int> lru(1000, 0, 10);
+    H_TEST_ASSERT(lru.shard_count() == 16);
+    for (int i = 0; i < 100000; ++i) {
+        lru.Insert(i, i);
+    }
+
+    // Every shard keeps at most 63 items
+    H_TEST_ASSERT(lru.size() <= 1008);
+    H_TEST_ASSERT(lru.size() > 900);
+
+    size_t n = 0;
+    lru.ForEach([&n](const int & k, const int & v) {
+        H_TEST_ASSERT(k == v);
+        H_TEST_ASSERT(k >= 90000);
+        ++n;
+    });
+    H_TEST_ASSERT(n == lru.size());
+}
+
+TEST_UNIT(sharded_lru_test_threads) {
+    sharded_lru_deleted = 0;
+    const int kThreads = 4;
+    const int kCount = 20000;
+    {
+        simcc::ShardedLRUCacheH4<int, int, simcc::SizeofFunctor<int>, CountDeleter> lru(512, 0, 8, simcc::SizeofFunctor<int>(), CountDeleter());
+        std::vector<std::thread> threads;
+        for (int t = 0; t < kThreads; ++t) {
+            threads.push_back(std::thread([&lru, t]() {
+                for (int i = 0; i < kCount; ++i) {
+                    int key = (i * 7 + t) % 2000;
+                    lru.FindOrInsert(key, []() {
+                        return 0;
+                    }, [](int & v) {
+                        ++v;
+                    });
+                }
+            }));
+        }
+
+        for (auto& t : threads) {
+            t.join();
+        }
+
+        H_TEST_ASSERT(lru.size() <= 512);
+    }
+    H_TEST_ASSERT(sharded_lru_deleted > 0);
+}
+
+TEST_UNIT(sharded_lru_test_dgram_filter_threads) {
+    // The threads checking the same packet together must not let more than max_threshold of them pass
+    const int kThreads = 4;
+    const uint32_t kMaxThreshold = 100;
+    simcc::DgramFilter<60> filter;
+    H_TEST_ASSERT(filter.Initialize(true, kMaxThreshold, 4096, 1, 600, 8));
+
+    std::atomic<int> passed(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.push_back(std::thread([&filter, &passed]() {
+            for (int i = 0; i < 1000; ++i) {
+                if (!filter.IsNeedFilter("packet", "127.0.0.1")) {
+                    passed++;
+                }
+                filter.IsNeedFilter("packet" + std::to_string(i), "127.0.0.1");
+            }
+        }));
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    H_TEST_ASSERT(passed == int(kMaxThreshold));
+}
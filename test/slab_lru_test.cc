@@ -0,0 +1,142 @@
+#include "test_common.h"
+
+#include "simcc/misc/slab_lru.h"
+#include "simcc/random.h"
+#include "simcc/timestamp.h"
+
+#include <iostream>
+#include <vector>
+
+namespace {
+int slab_lru_deleted = 0;
+
+struct CountDeleter {
+    void operator()(int64_t&) const {
+        slab_lru_deleted++;
+    }
+};
+
+template<class Cache>
+std::vector<std::pair<int, int>> Items(const Cache& cache) {
+    std::vector<std::pair<int, int>> items;
+    for (auto it = cache.mru_begin(); it != cache.end(); ++it) {
+        items.push_back(std::make_pair(it.key(), it.value()));
+    }
+    return items;
+}
+}
+
+TEST_UNIT(slab_lru_test_basic) {
+    simcc::SlabLRUCache<std::string, int64_t> lru(2, 1000);
+    lru.insert("key1", 1);
+    H_TEST_ASSERT(lru.size() == 1);
+    lru.insert("key2", 2);
+    H_TEST_ASSERT(lru.size() == 2);
+    lru.insert("key3", 3);
+    H_TEST_ASSERT(lru.size() == 2);
+    auto it = lru.find("key1");
+    H_TEST_ASSERT(it == lru.end());
+    it = lru.find("key2");
+    H_TEST_ASSERT(it != lru.end());
+    H_TEST_ASSERT(it.value() == 2);
+    lru.insert("key4", 4);
+    H_TEST_ASSERT(lru.find("key2") != lru.end());
+    H_TEST_ASSERT(lru.find("key3") == lru.end());
+    H_TEST_ASSERT(lru.find("key4") != lru.end());
+
+    H_TEST_ASSERT(lru.Erase("key2"));
+    H_TEST_ASSERT(!lru.Erase("key2"));
+    H_TEST_ASSERT(lru.size() == 1);
+    H_TEST_ASSERT(lru.mru_begin().key() == "key4");
+    lru.insert("key5", 5);
+    lru.insert("key4", 40);
+    H_TEST_ASSERT(lru.mru_begin().value() == 40);
+    H_TEST_ASSERT(lru.lru_begin().key() == "key5");
+}
+
+TEST_UNIT(slab_lru_test_memory_limit) {
+    slab_lru_deleted = 0;
+    {
+        simcc::SlabLRUCache<std::string, int64_t, simcc::SizeofFunctor<int64_t>, CountDeleter> probe(1, 0);
+        probe.insert("key", 0);
+        size_t item_size = probe.memory_size();
+
+        simcc::SlabLRUCache<std::string, int64_t, simcc::SizeofFunctor<int64_t>, CountDeleter> lru(1000, item_size * 2);
+        for (int64_t i = 0; i < 10; ++i) {
+            lru.insert("key" + std::to_string(i), i);
+        }
+        H_TEST_ASSERT(lru.size() == 2);
+        H_TEST_ASSERT(lru.memory_size() == item_size * 2);
+        H_TEST_ASSERT(slab_lru_deleted == 8);
+    }
+    H_TEST_ASSERT(slab_lru_deleted == 11);
+}
+
+TEST_UNIT(slab_lru_test_same_as_lru) {
+    // The same operations give the same items in the same order as LRUCacheH4
+    simcc::LRUCacheH4<int, int> expected(300, 0);
+    simcc::SlabLRUCache<int, int> actual(300, 0);
+    simcc::Random random(17);
+    for (int i = 0; i < 100000; ++i) {
+        int key = int(random.Uniform(1000));
+        if (random.Onein(3)) {
+            bool found = expected.find(key) != expected.end();
+            H_TEST_ASSERT(found == (actual.find(key) != actual.end()));
+        } else {
+            expected.insert(key, i);
+            actual.insert(key, i);
+        }
+
+        if (i % 10000 == 0) {
+            H_TEST_ASSERT(Items(expected) == Items(actual));
+        }
+    }
+
+    H_TEST_ASSERT(expected.size() == actual.size());
+    H_TEST_ASSERT(Items(expected) == Items(actual));
+
+    // Erase most of them and fill it again
+    std::vector<std::pair<int, int>> items = Items(actual);
+    for (size_t i = 0; i < items.size(); i += 2) {
+        H_TEST_ASSERT(actual.erase(items[i].first));
+    }
+    for (size_t i = 0; i < items.size(); ++i) {
+        H_TEST_ASSERT((actual.find(items[i].first) != actual.end()) == (i % 2 == 1));
+    }
+    for (int i = 0; i < 1000; ++i) {
+        actual.insert(i, i);
+    }
+    H_TEST_ASSERT(actual.size() == 300);
+    H_TEST_ASSERT(actual.lru_begin().key() == 700);
+}
+
+#ifdef H_BENCHMARK_TESTING
+namespace {
+template<class Cache>
+simcc::Duration Churn(Cache& cache, const std::vector<int>& keys) {
+    simcc::Timestamp start = simcc::Timestamp::Now();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (cache.find(keys[i]) == cache.end()) {
+            cache.insert(keys[i], int(i));
+        }
+    }
+    return simcc::Timestamp::Now() - start;
+}
+}
+
+TEST_UNIT(slab_lru_test_benchmark) {
+    // Most of them miss, so the items are evicted and inserted all the time
+    simcc::Random random(17);
+    std::vector<int> keys(5000000);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        keys[i] = int(random.Uniform(300000));
+    }
+
+    simcc::LRUCacheH4<int, int> lru(100000, 0);
+    simcc::SlabLRUCache<int, int> slab(100000, 0);
+    simcc::Duration lru_cost = Churn(lru, keys);
+    simcc::Duration slab_cost = Churn(slab, keys);
+    std::cout << ">>>>>>>>>>>>>>>> LRUCacheH4 cost=" << lru_cost.Milliseconds() << "ms\n";
+    std::cout << ">>>>>>>>>>>>>>>> SlabLRUCache cost=" << slab_cost.Milliseconds() << "ms\n";
+}
+#endif
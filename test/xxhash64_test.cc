@@ -0,0 +1,66 @@
+#include "test_common.h"
+
+#include "simcc/misc/xxhash64.h"
+#include "simcc/misc/dgram_filter.h"
+#include "simcc/timestamp.h"
+
+#include <iostream>
+
+TEST_UNIT(xxhash64_test_sum) {
+    // The results of the reference implementation
+    H_TEST_ASSERT(simcc::XXHash64::Sum("", 0) == 0xEF46DB3751D8E999ULL);
+    H_TEST_ASSERT(simcc::XXHash64::Sum(std::string("abc")) == 0x44BC2CF5AD770999ULL);
+    H_TEST_ASSERT(simcc::XXHash64::Sum(std::string("The quick brown fox jumps over the lazy dog")) == 0x0B242D361FDA71BCULL);
+
+    // The unaligned data and all the lengths of the tail
+    std::string s(100, 'x');
+    for (size_t i = 0; i < s.size(); ++i) {
+        s[i] = char(i * 31 + 7);
+    }
+    std::string copy = " " + s;
+    for (size_t len = 0; len <= s.size(); ++len) {
+        H_TEST_ASSERT(simcc::XXHash64::Sum(s.data(), len) == simcc::XXHash64::Sum(copy.data() + 1, len));
+        H_TEST_ASSERT(simcc::XXHash64::Sum(s.data(), len, 1) != simcc::XXHash64::Sum(s.data(), len));
+    }
+}
+
+TEST_UNIT(xxhash64_test_dgram_filter_fingerprint) {
+    simcc::DgramXXHash64Fingerprint fingerprint;
+    H_TEST_ASSERT(fingerprint("packet", 6, "127.0.0.1", false) == fingerprint("packet", 6, "127.0.0.1", true));
+    H_TEST_ASSERT(fingerprint("packet", 6, "127.0.0.1", false) != fingerprint("packet", 6, "127.0.0.2", false));
+    H_TEST_ASSERT(fingerprint("packet", 6, "", false) == simcc::XXHash64::Sum("packet", 6));
+
+    // The MD5 one is still there
+    simcc::DgramFilter<60, simcc::DgramMD5Fingerprint> filter;
+    H_TEST_ASSERT(filter.Initialize(true, 2, 1024, 1, 600));
+    filter.set_debug(true);
+    H_TEST_ASSERT(!filter.IsNeedFilter("packet", "127.0.0.1"));
+    H_TEST_ASSERT(!filter.IsNeedFilter("packet", "127.0.0.1"));
+    H_TEST_ASSERT(filter.IsNeedFilter("packet", "127.0.0.1"));
+    H_TEST_ASSERT(!filter.IsNeedFilter("packet", "127.0.0.2"));
+}
+
+#ifdef H_BENCHMARK_TESTING
+TEST_UNIT(xxhash64_test_benchmark) {
+    const int kLoops = 1000000;
+    std::string packet(512, 'p');
+    uint64_t sum = 0;
+
+    simcc::Timestamp start = simcc::Timestamp::Now();
+    for (int i = 0; i < kLoops; ++i) {
+        packet[0] = char(i);
+        sum += simcc::MD5::Sum(packet).size();
+    }
+    simcc::Duration md5_cost = simcc::Timestamp::Now() - start;
+
+    start = simcc::Timestamp::Now();
+    for (int i = 0; i < kLoops; ++i) {
+        packet[0] = char(i);
+        sum += simcc::XXHash64::Sum(packet);
+    }
+    simcc::Duration xxhash_cost = simcc::Timestamp::Now() - start;
+
+    std::cout << ">>>>>>>>>>>>>>>> MD5 cost=" << md5_cost.Milliseconds() << "ms\n";
+    std::cout << ">>>>>>>>>>>>>>>> XXHash64 cost=" << xxhash_cost.Milliseconds() << "ms sum=" << sum << "\n";
+}
+#endif